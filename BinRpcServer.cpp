@@ -0,0 +1,371 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BinRpcServer.h"
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "lasersharkbinrpcmethods.h"
+#include "twostepbinrpcmethods.h"
+#include "debug.h"
+
+// How long the accept thread blocks waiting for a connection, this bounds how long stopping it takes.
+#define BINRPC_POLL_MS 100
+
+// Beyond this new connections are closed straight away, each one holds a thread.
+#define BINRPC_MAX_CONNECTIONS 16
+
+
+BinRpcServer::BinRpcServer(LaserSharkJSONServer *lasershark, TwoStepJSONServer *twostep, int port,
+	const std::string &socket_path)
+{
+	this->lasershark = lasershark;
+	this->twostep = twostep;
+	this->port = port;
+	this->socket_path = socket_path;
+	tcp_fd = -1;
+	unix_fd = -1;
+	thread = NULL;
+	thread_should_exit = false;
+}
+
+
+BinRpcServer::~BinRpcServer()
+{
+	StopListening();
+}
+
+
+/*
+	Returns false if the port or socket could not be listened on or the server thread started.
+*/
+bool BinRpcServer::StartListening()
+{
+	if (thread) {
+		return true;
+	}
+
+	if (port && (tcp_fd = listenTcp()) < 0) {
+		return false;
+	}
+	if (!socket_path.empty() && (unix_fd = listenUnix()) < 0) {
+		if (tcp_fd >= 0) {
+			close(tcp_fd);
+			tcp_fd = -1;
+		}
+		return false;
+	}
+
+	thread_should_exit = false;
+	try {
+		thread = new std::thread(&BinRpcServer::serve, this);
+	} catch (std::system_error e) {
+		std::cerr << "Error allocating thread: " << e.what() << std::endl;
+		StopListening();
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+	Closes every open connection, calls already running are finished first.
+*/
+bool BinRpcServer::StopListening()
+{
+	bool was_listening = thread != NULL;
+
+	thread_should_exit = true;
+	if (thread) {
+		thread->join();
+		delete thread;
+		thread = NULL;
+	}
+	reapConnections(true);
+
+	if (tcp_fd >= 0) {
+		close(tcp_fd);
+		tcp_fd = -1;
+	}
+	if (unix_fd >= 0) {
+		close(unix_fd);
+		unlink(socket_path.c_str());
+		unix_fd = -1;
+	}
+
+	return was_listening;
+}
+
+
+int BinRpcServer::listenTcp()
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		std::cerr << "Error creating binary RPC socket: " << strerror(errno) << std::endl;
+		return -1;
+	}
+
+	int reuse = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+		std::cerr << "Error listening for binary RPC on port " << port << ": " << strerror(errno) << std::endl;
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+int BinRpcServer::listenUnix()
+{
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (socket_path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "Binary RPC socket path too long: " << socket_path << std::endl;
+		return -1;
+	}
+	strcpy(addr.sun_path, socket_path.c_str());
+
+	// A socket left behind by an earlier run would stop the bind, anything else at the path is left alone.
+	struct stat st;
+	if (stat(socket_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+		unlink(socket_path.c_str());
+	}
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		std::cerr << "Error creating binary RPC socket: " << strerror(errno) << std::endl;
+		return -1;
+	}
+	if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 8) != 0) {
+		std::cerr << "Error listening for binary RPC on " << socket_path << ": " << strerror(errno) << std::endl;
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+
+void BinRpcServer::serve()
+{
+	D(std::cout << "Binary RPC server thread starting" << std::endl;)
+
+	while (!thread_should_exit) {
+		struct pollfd pfds[2];
+		int nfds = 0;
+		if (tcp_fd >= 0) {
+			pfds[nfds].fd = tcp_fd;
+			pfds[nfds].events = POLLIN;
+			nfds++;
+		}
+		if (unix_fd >= 0) {
+			pfds[nfds].fd = unix_fd;
+			pfds[nfds].events = POLLIN;
+			nfds++;
+		}
+		if (poll(pfds, nfds, BINRPC_POLL_MS) <= 0) {
+			continue;
+		}
+
+		reapConnections(false);
+
+		for (int i = 0; i < nfds; i++) {
+			if (!(pfds[i].revents & POLLIN)) {
+				continue;
+			}
+			int fd = accept(pfds[i].fd, NULL, NULL);
+			if (fd < 0) {
+				continue;
+			}
+			if (pfds[i].fd == tcp_fd) {
+				int nodelay = 1;
+				setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+			}
+
+			connections_mutex.lock();
+			if (connections.size() >= BINRPC_MAX_CONNECTIONS) {
+				connections_mutex.unlock();
+				std::cerr << "Too many binary RPC connections, closing the newest." << std::endl;
+				close(fd);
+				continue;
+			}
+			Connection *connection = new Connection;
+			connection->fd = fd;
+			connection->done = false;
+			try {
+				connection->thread = new std::thread(&BinRpcServer::serveConnection, this, connection);
+				connections.push_back(connection);
+			} catch (std::system_error e) {
+				std::cerr << "Error allocating thread: " << e.what() << std::endl;
+				close(fd);
+				delete connection;
+			}
+			connections_mutex.unlock();
+		}
+	}
+
+	D(std::cout << "Binary RPC server thread exiting" << std::endl;)
+}
+
+
+/*
+	Joins the threads of connections that have closed, or of all of them after waking them up.
+*/
+void BinRpcServer::reapConnections(bool all)
+{
+	connections_mutex.lock();
+	std::list<Connection*>::iterator it = connections.begin();
+	while (it != connections.end()) {
+		Connection *connection = *it;
+		if (!all && !connection->done) {
+			it++;
+			continue;
+		}
+		// Wakes a thread waiting on its next request, the fd is only closed once it has let go of it.
+		shutdown(connection->fd, SHUT_RDWR);
+		connection->thread->join();
+		delete connection->thread;
+		close(connection->fd);
+		delete connection;
+		it = connections.erase(it);
+	}
+	connections_mutex.unlock();
+}
+
+
+void BinRpcServer::serveConnection(Connection *connection)
+{
+	bool lasershark_api;
+	if (handshake(connection->fd, lasershark_api)) {
+		std::string request;
+		while (!thread_should_exit && binRpcReceiveFrame(connection->fd, request)) {
+			if (!binRpcSendFrame(connection->fd, handleRequest(lasershark_api, request))) {
+				break;
+			}
+		}
+	}
+	connection->done = true;
+}
+
+
+/*
+	Picks the API from the spec hash the client sends. Returns false if the connection should be closed.
+*/
+bool BinRpcServer::handshake(int fd, bool &lasershark_api)
+{
+	std::string hello;
+	if (!binRpcReceiveFrame(fd, hello)) {
+		return false;
+	}
+
+	BinRpcWriter response;
+	try {
+		BinRpcReader reader(hello);
+		if (reader.getUint32() != BINRPC_MAGIC) {
+			throw std::runtime_error("Not a binary RPC client.");
+		}
+		uint32_t spec_hash = reader.getUint32();
+		if (spec_hash == LASERSHARKBINRPC_SPEC_HASH) {
+			lasershark_api = true;
+		} else if (spec_hash == TWOSTEPBINRPC_SPEC_HASH && twostep) {
+			lasershark_api = false;
+		} else if (spec_hash == TWOSTEPBINRPC_SPEC_HASH) {
+			throw std::runtime_error("TwoStep not available.");
+		} else {
+			throw std::runtime_error("The client was generated from a spec this server doesn't serve.");
+		}
+	} catch (std::runtime_error e) {
+		response.putUint8(BINRPC_ERROR);
+		response.putString(e.what());
+		binRpcSendFrame(fd, response.data());
+		return false;
+	}
+
+	response.putUint8(BINRPC_OK);
+	return binRpcSendFrame(fd, response.data());
+}
+
+
+std::string BinRpcServer::handleRequest(bool lasershark_api, const std::string &request)
+{
+	const BinRpcMethod *methods = lasershark_api ? LaserSharkBinRpcMethods : TwoStepBinRpcMethods;
+	unsigned int method_count = lasershark_api ? LASERSHARKBINRPC_METHOD_COUNT : TWOSTEPBINRPC_METHOD_COUNT;
+	BinRpcWriter response;
+
+	try {
+		BinRpcReader reader(request);
+		unsigned int id = reader.getUint16();
+		if (id >= method_count) {
+			std::ostringstream oss;
+			oss << "Unknown method " << id << ".";
+			throw std::runtime_error(oss.str());
+		}
+		const BinRpcMethod &method = methods[id];
+
+		Json::Value params(Json::objectValue);
+		for (unsigned int i = 0; i < method.param_count; i++) {
+			params[method.params[i].name] = reader.getValue(method.params[i].type);
+		}
+
+		Json::Value result;
+		jsonrpc::Procedure proc(method.name, jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, NULL);
+		if (lasershark_api) {
+			lasershark->handleMethodCall(&proc, params, result);
+		} else {
+			twostep->handleMethodCall(&proc, params, result);
+		}
+
+		if (method.bare) {
+			response.putUint8(BINRPC_OK);
+			response.putString(result.asString());
+		} else if (!result["success"].asBool()) {
+			response.putUint8(BINRPC_FAILED);
+			response.putString(result["message"].asString());
+		} else {
+			response.putUint8(BINRPC_OK);
+			for (unsigned int i = 0; i < method.return_count; i++) {
+				response.putValue(method.returns[i].type, result[method.returns[i].name]);
+			}
+		}
+	} catch (std::exception &e) {
+		response = BinRpcWriter();
+		response.putUint8(BINRPC_ERROR);
+		response.putString(e.what());
+	}
+
+	return response.data();
+}
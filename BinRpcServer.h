@@ -0,0 +1,80 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BINRPCSERVER_H_
+#define _BINRPCSERVER_H_
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <string>
+
+#include "BinRpc.h"
+#include "LaserSharkJSONServer.h"
+#include "TwoStepJSONServer.h"
+
+
+/*
+	Serves both APIs over the binary protocol in BinRpc.h, on a TCP port, a Unix socket or both. Each connection
+	picks an API with the spec hash it sends first and gets a thread of its own, so a monitoring client can keep one
+	open and poll without any HTTP or JSON text. Calls are handed to the JSON servers themselves, so they are queued
+	and cached exactly as they would be over JSON-RPC.
+*/
+class BinRpcServer
+{
+	public:
+		BinRpcServer(LaserSharkJSONServer *lasershark, TwoStepJSONServer *twostep, int port,
+			const std::string &socket_path);
+		~BinRpcServer();
+
+		bool StartListening();
+		bool StopListening();
+
+	private:
+		struct Connection
+		{
+			int fd;
+			std::thread *thread;
+			std::atomic<bool> done;
+		};
+
+		int listenTcp();
+		int listenUnix();
+		void serve();
+		void serveConnection(Connection *connection);
+		bool handshake(int fd, bool &lasershark_api);
+		std::string handleRequest(bool lasershark_api, const std::string &request);
+		void reapConnections(bool all);
+
+		LaserSharkJSONServer *lasershark;
+		TwoStepJSONServer *twostep; // NULL when only the LaserShark is in use.
+		int port; // 0 to not listen on TCP.
+		std::string socket_path; // Empty to not listen on a Unix socket.
+
+		int tcp_fd;
+		int unix_fd;
+		std::thread *thread;
+		std::atomic<bool> thread_should_exit;
+
+		std::mutex connections_mutex;
+		std::list<Connection*> connections;
+};
+
+#endif //_BINRPCSERVER_H_
@@ -0,0 +1,76 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "CombinedJSONServer.h"
+#include "KeepAliveHttpServer.h"
+#include "lasersharkbinrpcmethods.h"
+#include "twostepbinrpcmethods.h"
+
+
+CombinedJSONServer::CombinedJSONServer(int port, LaserSharkJSONServer *lasershark, TwoStepJSONServer *twostep) :
+	jsonrpc::AbstractServer<CombinedJSONServer>(new KeepAliveHttpServer(port))
+{
+	this->lasershark = lasershark;
+	this->twostep = twostep;
+
+	bindMethods("laser.", LaserSharkBinRpcMethods, LASERSHARKBINRPC_METHOD_COUNT);
+	bindMethods("stepper.", TwoStepBinRpcMethods, TWOSTEPBINRPC_METHOD_COUNT);
+}
+
+
+/*
+	Binds every method in the spec table methods under prefix.
+*/
+void CombinedJSONServer::bindMethods(const std::string &prefix, const BinRpcMethod *methods, unsigned int count)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		std::string name = prefix + methods[i].name;
+		BinRpcMethod method = methods[i];
+		method.name = name.c_str();
+		this->bindAndAddMethod(binRpcProcedure(method), &CombinedJSONServer::forward);
+	}
+}
+
+
+/*
+	The namespace is stripped and the call passed to the server for it.
+*/
+void CombinedJSONServer::handleMethodCall(jsonrpc::Procedure* proc, const Json::Value& input, Json::Value& output)
+{
+	std::string name = proc->GetProcedureName();
+	std::string method = name.substr(name.find('.') + 1);
+	jsonrpc::Procedure inner(method, jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, NULL);
+
+	if (name.compare(0, 6, "laser.") == 0) {
+		lasershark->handleMethodCall(&inner, input, output);
+	} else if (twostep) {
+		twostep->handleMethodCall(&inner, input, output);
+	} else {
+		output["success"] = false;
+		output["message"] = "TwoStep not available.";
+	}
+}
+
+
+/*
+	Every procedure is bound to this, but handleMethodCall routes them all so it is never called.
+*/
+void CombinedJSONServer::forward(const Json::Value& request, Json::Value& response)
+{
+}
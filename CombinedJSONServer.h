@@ -0,0 +1,54 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _COMBINEDJSONSERVER_H_
+#define _COMBINEDJSONSERVER_H_
+
+#include <jsonrpc/rpc.h>
+#include "BinRpc.h"
+#include "LaserSharkJSONServer.h"
+#include "TwoStepJSONServer.h"
+
+
+/*
+	Serves both APIs on one port, the LaserShark's methods as laser.* and the TwoStep's as stepper.*, so a client
+	needs a single connection, which KeepAliveHttpServer keeps open, and can send a whole layer transition as one
+	JSON-RPC batch request. Calls are handed to the servers themselves, so they are queued and cached exactly as
+	they would be on their own ports.
+	json-rpc-cpp hands a batch request's calls over one at a time, so each is a change of its own and other clients
+	can reach the device between them. laser.executeBatch and stepper.executeBatch run their calls as one change.
+	The procedures are declared from the tables binrpcstub generates from lasershark_spec.json and
+	twostep_spec.json. Notifications are only served on the separate ports.
+*/
+class CombinedJSONServer : public jsonrpc::AbstractServer<CombinedJSONServer>
+{
+	public:
+		CombinedJSONServer(int port, LaserSharkJSONServer *lasershark, TwoStepJSONServer *twostep);
+
+		virtual void handleMethodCall(jsonrpc::Procedure* proc, const Json::Value& input, Json::Value& output);
+
+	private:
+		void bindMethods(const std::string &prefix, const BinRpcMethod *methods, unsigned int count);
+		void forward(const Json::Value& request, Json::Value& response);
+
+		LaserSharkJSONServer *lasershark;
+		TwoStepJSONServer *twostep; // NULL when only the LaserShark is in use.
+};
+
+#endif //_COMBINEDJSONSERVER_H_
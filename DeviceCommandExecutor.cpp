@@ -0,0 +1,314 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "DeviceCommandExecutor.h"
+#include <iostream>
+#include <sstream>
+#include "metrics/Trace.h"
+#include "debug.h"
+
+
+DeviceCommandExecutor::DeviceCommandExecutor(const std::string &device, unsigned int cache_ms)
+{
+	this->device = device;
+	cache_time = std::chrono::milliseconds(cache_ms);
+	worker_should_exit = false;
+	cache_generation = 0;
+
+	MetricsRegistry &metrics = MetricsRegistry::instance();
+	std::string labels = MetricsRegistry::label("device", device);
+	metric_queue_depth = metrics.gauge("device_command_queue_depth",
+		"Changes waiting for or being run by the device's command executor.", labels);
+	metric_cache_hits = metrics.counter("device_status_cache_hits_total",
+		"Status reads answered from the device's cache.", labels);
+
+	worker = new std::thread(&DeviceCommandExecutor::workerThread, this);
+}
+
+
+/*
+	Waits for queued changes to finish. Nothing may call execute once this starts.
+*/
+DeviceCommandExecutor::~DeviceCommandExecutor()
+{
+	queue_mutex.lock();
+	worker_should_exit = true;
+	queue_cv.notify_all();
+	queue_mutex.unlock();
+
+	worker->join();
+	delete worker;
+
+	for (std::map<std::string, jsonrpc::Procedure*>::iterator it = batch_procedures.begin(); it != batch_procedures.end(); it++) {
+		delete it->second;
+	}
+}
+
+
+/*
+	Should be done for every method before the server starts listening, the classes aren't locked.
+*/
+void DeviceCommandExecutor::classify(const std::string &method, CommandClass command_class)
+{
+	classes[method] = command_class;
+}
+
+
+/*
+	Runs call for method, which fills in output, according to how method is classified. Blocks until it has run.
+	Anything call throws is rethrown here.
+*/
+void DeviceCommandExecutor::execute(const std::string &method, const Json::Value &input, Json::Value &output,
+	const Call &call)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::map<std::string, CommandClass>::iterator it = classes.find(method);
+	CommandClass command_class = it == classes.end() ? COMMAND_WRITE : it->second;
+
+	if (command_class == COMMAND_READ) {
+		call(output);
+	} else if (command_class == COMMAND_CACHED_READ) {
+		executeCachedRead(method, input, output, call);
+	} else if (command_class == COMMAND_IMMEDIATE) {
+		executeImmediate(call, output);
+	} else {
+		executeWrite(call, output);
+	}
+
+	requestMetric(method)->observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+
+/*
+	Lets runBatch run every method in the spec table methods except those in excluded. Like classify, this should
+	be done before the server starts listening.
+*/
+void DeviceCommandExecutor::addBatchMethods(const BinRpcMethod *methods, unsigned int count,
+	const std::set<std::string> &excluded)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		if (excluded.count(methods[i].name) || batch_procedures.count(methods[i].name)) {
+			continue;
+		}
+		batch_procedures[methods[i].name] = binRpcProcedure(methods[i]);
+	}
+}
+
+
+/*
+	Runs each of calls, which look like {"method": name, "params": {...}}, through call in order and appends what
+	each returns to results. Nothing is run unless every call is well formed, was added by addBatchMethods and has
+	the params the spec asks for. Stops at the first call that fails, and explains why in message.
+	The batch is a single change as far as the executor is concerned, so nothing else reaches the device part way
+	through it. JSON-RPC batch requests don't get this, json-rpc-cpp executes each of their calls on its own.
+*/
+bool DeviceCommandExecutor::runBatch(const Json::Value &calls, const BatchCall &call, Json::Value &results,
+	std::string &message)
+{
+	results = Json::Value(Json::arrayValue);
+
+	if (!calls.isArray() || calls.size() == 0) {
+		message = "A batch needs at least one call.";
+		return false;
+	}
+
+	for (unsigned int i = 0; i < calls.size(); i++) {
+		const Json::Value &entry = calls[i];
+		std::ostringstream error;
+		if (!entry.isObject() || !entry["method"].isString() ||
+			!(entry["params"].isNull() || entry["params"].isObject())) {
+			error << "Call " << i << " is not a method with named params.";
+			message = error.str();
+			return false;
+		}
+		std::map<std::string, jsonrpc::Procedure*>::iterator it = batch_procedures.find(entry["method"].asString());
+		if (it == batch_procedures.end()) {
+			error << "Call " << i << ": " << entry["method"].asString() << " can't be batched.";
+			message = error.str();
+			return false;
+		}
+		// The calls skip json-rpc-cpp's own checks, a missing param would otherwise be read as 0 or false.
+		Json::Value params = entry["params"].isNull() ? Json::Value(Json::objectValue) : entry["params"];
+		if (!it->second->ValidateNamedParameters(params)) {
+			error << "Call " << i << ": params don't match " << entry["method"].asString() << ".";
+			message = error.str();
+			return false;
+		}
+	}
+
+	for (unsigned int i = 0; i < calls.size(); i++) {
+		std::string method = calls[i]["method"].asString();
+		Json::Value params = calls[i]["params"].isNull() ? Json::Value(Json::objectValue) : calls[i]["params"];
+		Json::Value result;
+		call(batch_procedures[method], params, result);
+		results.append(result);
+
+		if (result.isObject() && !result["success"].asBool()) {
+			std::ostringstream error;
+			error << "Call " << i << " (" << method << ") failed: " << result["message"].asString();
+			message = error.str();
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+void DeviceCommandExecutor::executeWrite(const Call &call, Json::Value &output)
+{
+	TraceScope trace("command_queue", "executor");
+
+	Command command;
+	command.call = &call;
+	command.output = &output;
+	command.done = false;
+
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	queue.push_back(&command);
+	metric_queue_depth->set(queue.size());
+	queue_cv.notify_all();
+	while (!command.done) {
+		done_cv.wait(lock);
+	}
+	lock.unlock();
+
+	if (command.error) {
+		std::rethrow_exception(command.error);
+	}
+}
+
+
+/*
+	Doesn't wait for the queue. The cache is dropped before and after like for a queued change.
+*/
+void DeviceCommandExecutor::executeImmediate(const Call &call, Json::Value &output)
+{
+	invalidateCache();
+	try {
+		call(output);
+	} catch (...) {
+		invalidateCache();
+		throw;
+	}
+	invalidateCache();
+}
+
+
+/*
+	Looks a method's jsonrpc_request_seconds histogram up in the registry the first time it is called and keeps it
+	after that.
+*/
+MetricsHistogram *DeviceCommandExecutor::requestMetric(const std::string &method)
+{
+	std::lock_guard<std::mutex> lock(request_metrics_mutex);
+	MetricsHistogram *&metric = request_metrics[method];
+	if (!metric) {
+		metric = MetricsRegistry::instance().histogram("jsonrpc_request_seconds",
+			"Time taken to handle each JSON-RPC method call.", MetricsRegistry::exponentialBuckets(0.0005, 2, 16),
+			MetricsRegistry::label("server", device) + "," + MetricsRegistry::label("method", method));
+	}
+	return metric;
+}
+
+
+/*
+	Only successful results are cached. Concurrent misses on the same call all go to the device, which is no
+	worse than without the cache.
+*/
+void DeviceCommandExecutor::executeCachedRead(const std::string &method, const Json::Value &input,
+	Json::Value &output, const Call &call)
+{
+	Json::FastWriter writer;
+	std::string key = method + writer.write(input);
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+	cache_mutex.lock();
+	std::map<std::string, CacheEntry>::iterator it = cache.find(key);
+	if (it != cache.end() && it->second.expires > now) {
+		output = it->second.output;
+		cache_mutex.unlock();
+		metric_cache_hits->inc();
+		return;
+	}
+	unsigned long long generation = cache_generation;
+	cache_mutex.unlock();
+
+	call(output);
+
+	if (!output.isObject() || !output["success"].asBool()) {
+		return;
+	}
+
+	cache_mutex.lock();
+	if (generation == cache_generation) {
+		CacheEntry &entry = cache[key];
+		entry.output = output;
+		entry.expires = now + cache_time;
+	}
+	cache_mutex.unlock();
+}
+
+
+void DeviceCommandExecutor::invalidateCache()
+{
+	cache_mutex.lock();
+	cache.clear();
+	cache_generation++;
+	cache_mutex.unlock();
+}
+
+
+/*
+	The cache is dropped both before and after each change, so reads made while it runs aren't kept either.
+*/
+void DeviceCommandExecutor::workerThread()
+{
+	D(std::cout << device << " command executor starting" << std::endl;)
+	Tracer::instance().setThreadName(device + " commands");
+
+	std::unique_lock<std::mutex> lock(queue_mutex);
+	while (true) {
+		while (!worker_should_exit && queue.empty()) {
+			queue_cv.wait(lock);
+		}
+		if (queue.empty()) {
+			break;
+		}
+		Command *command = queue.front();
+		lock.unlock();
+
+		invalidateCache();
+		try {
+			(*command->call)(*command->output);
+		} catch (...) {
+			command->error = std::current_exception();
+		}
+		invalidateCache();
+
+		lock.lock();
+		queue.pop_front();
+		metric_queue_depth->set(queue.size());
+		command->done = true;
+		done_cv.notify_all();
+	}
+	lock.unlock();
+
+	D(std::cout << device << " command executor exiting" << std::endl;)
+}
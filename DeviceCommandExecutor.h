@@ -0,0 +1,116 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _DEVICECOMMANDEXECUTOR_H_
+#define _DEVICECOMMANDEXECUTOR_H_
+
+#include <jsonrpc/rpc.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+
+#include "metrics/Metrics.h"
+#include "BinRpc.h"
+
+
+/*
+	Runs the JSON-RPC calls for one device. Calls that change the device are queued and run one at a time, in the
+	order they arrived, on the executor's own thread. Calls that only read run right away on the caller's thread,
+	so any number of clients can poll without waiting behind each other or behind a layer upload. Status reads
+	that have to ask the device are answered from a cache for cache_ms, and the cache is dropped whenever a change
+	runs so a client always sees the effect of its own changes. Stops are changes that can't wait their turn, they
+	run right away on the caller's thread, alongside whatever change is running.
+	Methods that were never classified are treated as changes. Every call is timed in jsonrpc_request_seconds.
+*/
+class DeviceCommandExecutor
+{
+	public:
+		enum CommandClass {
+			COMMAND_WRITE,
+			COMMAND_READ,
+			COMMAND_CACHED_READ,
+			COMMAND_IMMEDIATE // A change that has to be safe to run alongside the queued ones.
+		};
+
+		typedef std::function<void(Json::Value &output)> Call;
+		typedef std::function<void(jsonrpc::Procedure *procedure, const Json::Value &params, Json::Value &result)> BatchCall;
+
+		DeviceCommandExecutor(const std::string &device, unsigned int cache_ms);
+		~DeviceCommandExecutor();
+
+		void classify(const std::string &method, CommandClass command_class);
+		void execute(const std::string &method, const Json::Value &input, Json::Value &output, const Call &call);
+
+		void addBatchMethods(const BinRpcMethod *methods, unsigned int count, const std::set<std::string> &excluded);
+		bool runBatch(const Json::Value &calls, const BatchCall &call, Json::Value &results, std::string &message);
+
+	private:
+		struct Command
+		{
+			const Call *call;
+			Json::Value *output;
+			std::exception_ptr error;
+			bool done;
+		};
+
+		struct CacheEntry
+		{
+			Json::Value output;
+			std::chrono::steady_clock::time_point expires;
+		};
+
+		void executeWrite(const Call &call, Json::Value &output);
+		void executeImmediate(const Call &call, Json::Value &output);
+		MetricsHistogram *requestMetric(const std::string &method);
+		void executeCachedRead(const std::string &method, const Json::Value &input, Json::Value &output,
+			const Call &call);
+		void invalidateCache();
+		void workerThread();
+
+		std::string device;
+		std::chrono::milliseconds cache_time;
+		std::map<std::string, CommandClass> classes;
+		std::map<std::string, jsonrpc::Procedure*> batch_procedures;
+
+		std::mutex queue_mutex;
+		std::condition_variable queue_cv;
+		std::condition_variable done_cv;
+		std::deque<Command*> queue;
+		bool worker_should_exit;
+		std::thread *worker;
+
+		std::mutex cache_mutex;
+		std::map<std::string, CacheEntry> cache;
+		unsigned long long cache_generation; // Bumped by every change, so a read that raced one isn't cached.
+
+		MetricsGauge *metric_queue_depth;
+		MetricsCounter *metric_cache_hits;
+
+		std::mutex request_metrics_mutex;
+		std::map<std::string, MetricsHistogram*> request_metrics;
+};
+
+#endif //_DEVICECOMMANDEXECUTOR_H_
@@ -0,0 +1,353 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "KeepAliveHttpClient.h"
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "debug.h"
+
+// Idle connections kept beyond this are closed, a client rarely has more calls than this in flight.
+#define KEEPALIVE_MAX_IDLE_CONNECTIONS 4
+
+// Long enough for the longest waitForLayerDone/waitForMotionComplete poll the servers allow.
+#define KEEPALIVE_IO_TIMEOUT_MS 65000
+
+#define KEEPALIVE_MAX_HEADER_SIZE 8192
+
+
+/*
+	url looks like http://host[:port][/path]. A bad url is reported by the first call rather than thrown here, the
+	same as jsonrpc::HttpClient.
+*/
+KeepAliveHttpClient::KeepAliveHttpClient(const std::string &url)
+{
+	std::string rest = url;
+	if (rest.compare(0, 7, "http://") != 0) {
+		url_error = "Only http:// URLs are supported: " + url;
+		return;
+	}
+	rest = rest.substr(7);
+
+	size_t slash = rest.find('/');
+	path = slash == std::string::npos ? "/" : rest.substr(slash);
+	std::string authority = rest.substr(0, slash);
+
+	size_t colon = authority.rfind(':');
+	if (colon == std::string::npos) {
+		host = authority;
+		port = "80";
+	} else {
+		host = authority.substr(0, colon);
+		port = authority.substr(colon + 1);
+	}
+
+	if (host.empty() || port.empty()) {
+		url_error = "Invalid URL: " + url;
+	}
+}
+
+
+KeepAliveHttpClient::~KeepAliveHttpClient()
+{
+	closeIdleConnections();
+}
+
+
+/*
+	A pooled connection the server has closed while it sat idle is dropped before it is used, and one that breaks
+	while the request is being written is given up for a new one, as the server can't have run a request it didn't
+	get all of. Once the request is out the call is never sent again, even if no response arrives, as the server
+	may have run it.
+*/
+void KeepAliveHttpClient::SendMessage(const std::string& message, std::string& result)
+	throw (jsonrpc::JsonRpcException)
+{
+	std::string request = "POST " + path + " HTTP/1.1\r\n"
+		"Host: " + host + ":" + port + "\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: " + std::to_string(message.size()) + "\r\n"
+		"Connection: keep-alive\r\n\r\n" + message;
+
+	std::string error;
+	for (int attempt = 0; attempt < 2; attempt++) {
+		bool reused;
+		int fd = takeConnection(reused);
+
+		errno = 0;
+		if (!sendAll(fd, request)) {
+			// Unless it just took too long, a reused connection failing here had been closed by the server.
+			bool stale = reused && errno != EAGAIN && errno != EWOULDBLOCK;
+			error = errno ? strerror(errno) : "Connection closed";
+			close(fd);
+			if (!stale) {
+				break;
+			}
+			D(std::cout << "Pooled connection to " << host << ":" << port << " was closed, reconnecting" << std::endl;)
+			closeIdleConnections();
+			continue;
+		}
+
+		bool keep_open = false;
+		error.clear();
+		errno = 0;
+		if (receiveResponse(fd, result, keep_open, error)) {
+			if (keep_open) {
+				returnConnection(fd);
+			} else {
+				close(fd);
+			}
+			return;
+		}
+		if (error.empty()) {
+			error = errno ? strerror(errno) : "Connection closed";
+		}
+		close(fd);
+		break;
+	}
+
+	std::ostringstream oss;
+	oss << "Error talking to " << host << ":" << port << ": " << error;
+	throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR, oss.str());
+}
+
+
+int KeepAliveHttpClient::takeConnection(bool &reused) throw (jsonrpc::JsonRpcException)
+{
+	idle_mutex.lock();
+	while (!idle.empty()) {
+		int fd = idle.back();
+		idle.pop_back();
+		if (!connectionClosed(fd)) {
+			idle_mutex.unlock();
+			reused = true;
+			return fd;
+		}
+		close(fd);
+	}
+	idle_mutex.unlock();
+
+	reused = false;
+	return connectToServer();
+}
+
+
+/*
+	True if the server has closed an idle connection, or sent something on it nobody asked for.
+*/
+bool KeepAliveHttpClient::connectionClosed(int fd)
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN | POLLRDHUP;
+	pfd.revents = 0;
+	return poll(&pfd, 1, 0) != 0;
+}
+
+
+void KeepAliveHttpClient::returnConnection(int fd)
+{
+	idle_mutex.lock();
+	if (idle.size() < KEEPALIVE_MAX_IDLE_CONNECTIONS) {
+		idle.push_back(fd);
+		fd = -1;
+	}
+	idle_mutex.unlock();
+
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+
+void KeepAliveHttpClient::closeIdleConnections()
+{
+	idle_mutex.lock();
+	for (unsigned int i = 0; i < idle.size(); i++) {
+		close(idle[i]);
+	}
+	idle.clear();
+	idle_mutex.unlock();
+}
+
+
+int KeepAliveHttpClient::connectToServer() throw (jsonrpc::JsonRpcException)
+{
+	if (!url_error.empty()) {
+		throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR, url_error);
+	}
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	struct addrinfo *addrs;
+	int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs);
+	if (ret != 0) {
+		std::ostringstream oss;
+		oss << "Error resolving " << host << ": " << gai_strerror(ret);
+		throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR, oss.str());
+	}
+
+	int fd = -1;
+	for (struct addrinfo *addr = addrs; addr; addr = addr->ai_next) {
+		fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+		if (fd < 0) {
+			continue;
+		}
+		if (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+			break;
+		}
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(addrs);
+
+	if (fd < 0) {
+		std::ostringstream oss;
+		oss << "Error connecting to " << host << ":" << port << ": " << strerror(errno);
+		throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_CONNECTOR, oss.str());
+	}
+
+	// Requests are small and answered right away, don't let Nagle hold them back.
+	int nodelay = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+	struct timeval tv;
+	tv.tv_sec = KEEPALIVE_IO_TIMEOUT_MS/1000;
+	tv.tv_usec = (KEEPALIVE_IO_TIMEOUT_MS%1000)*1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+	return fd;
+}
+
+
+/*
+	Servers that write the headers and body of a response separately would otherwise have the body held back by
+	Nagle until our delayed ack of the headers, costing ~40ms a call once the connection is kept open. Linux
+	drops quick ack mode on its own, so it is asked for before every read.
+*/
+static ssize_t receiveSome(int fd, char *buf, size_t size)
+{
+#ifdef TCP_QUICKACK
+	int quickack = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &quickack, sizeof(quickack));
+#endif
+	return recv(fd, buf, size, 0);
+}
+
+
+bool KeepAliveHttpClient::sendAll(int fd, const std::string &data)
+{
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t len = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (len <= 0) {
+			return false;
+		}
+		sent += len;
+	}
+	return true;
+}
+
+
+/*
+	Reads one response into body. keep_open is set if the connection can be used for another call. error is only
+	set once some of the response has arrived, otherwise errno says why the connection failed.
+	A response without a Content-Length is read until the server closes the connection.
+*/
+bool KeepAliveHttpClient::receiveResponse(int fd, std::string &body, bool &keep_open, std::string &error)
+{
+	std::string data;
+	char buf[4096];
+	size_t header_end;
+	while ((header_end = data.find("\r\n\r\n")) == std::string::npos) {
+		if (data.size() > KEEPALIVE_MAX_HEADER_SIZE) {
+			error = "Response headers too long";
+			return false;
+		}
+		ssize_t len = receiveSome(fd, buf, sizeof(buf));
+		if (len <= 0) {
+			if (!data.empty()) {
+				error = "Connection closed mid response";
+			}
+			return false;
+		}
+		data.append(buf, len);
+	}
+
+	std::string headers = data.substr(0, header_end);
+	for (unsigned int i = 0; i < headers.size(); i++) {
+		headers[i] = tolower(headers[i]);
+	}
+	body = data.substr(header_end + 4);
+
+	// Only kept if the server says so. json-rpc-cpp's HttpServer answers HTTP/1.1 without a Connection header and
+	// then closes, and a call sent before its close arrives would be lost.
+	keep_open = headers.find("\r\nconnection: keep-alive") != std::string::npos;
+
+	std::string status = headers.substr(0, headers.find("\r\n"));
+	if (status.find(" 200") == std::string::npos) {
+		error = "Unexpected response: " + data.substr(0, data.find("\r\n"));
+		return false;
+	}
+
+	size_t length_pos = headers.find("\r\ncontent-length:");
+	if (length_pos == std::string::npos) {
+		keep_open = false;
+		while (true) {
+			ssize_t len = receiveSome(fd, buf, sizeof(buf));
+			if (len < 0) {
+				error = "Error reading response";
+				return false;
+			}
+			if (len == 0) {
+				return true;
+			}
+			body.append(buf, len);
+		}
+	}
+
+	size_t length = strtoul(headers.c_str() + length_pos + 17, NULL, 10);
+	while (body.size() < length) {
+		ssize_t len = receiveSome(fd, buf, sizeof(buf));
+		if (len <= 0) {
+			error = "Connection closed mid response";
+			return false;
+		}
+		body.append(buf, len);
+	}
+	if (body.size() > length) {
+		// Nothing was pipelined, so anything past the body means the connection is out of step.
+		body.resize(length);
+		keep_open = false;
+	}
+
+	return true;
+}
@@ -0,0 +1,62 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _KEEPALIVEHTTPCLIENT_H_
+#define _KEEPALIVEHTTPCLIENT_H_
+
+#include <jsonrpc/rpc.h>
+#include <mutex>
+#include <vector>
+#include <string>
+
+
+/*
+	A drop in replacement for jsonrpc::HttpClient that keeps its connections open between calls instead of
+	connecting for every one, saving the TCP handshake and slow start on each call. Calls can be made from several
+	threads at once, each takes a connection from a small pool or opens a new one if none are idle.
+	A connection is only kept if the server answers with Connection: keep-alive, as KeepAliveHttpServer does.
+	Against json-rpc-cpp's own HttpServer every call still connects. Only plain http URLs are supported.
+*/
+class KeepAliveHttpClient : public jsonrpc::AbstractClientConnector
+{
+	public:
+		KeepAliveHttpClient(const std::string &url);
+		virtual ~KeepAliveHttpClient();
+
+		virtual void SendMessage(const std::string& message, std::string& result) throw (jsonrpc::JsonRpcException);
+
+	private:
+		int takeConnection(bool &reused) throw (jsonrpc::JsonRpcException);
+		static bool connectionClosed(int fd);
+		void returnConnection(int fd);
+		void closeIdleConnections();
+		int connectToServer() throw (jsonrpc::JsonRpcException);
+		bool sendAll(int fd, const std::string &data);
+		bool receiveResponse(int fd, std::string &body, bool &keep_open, std::string &error);
+
+		std::string host;
+		std::string port;
+		std::string path;
+		std::string url_error;
+
+		std::mutex idle_mutex;
+		std::vector<int> idle;
+};
+
+#endif //_KEEPALIVEHTTPCLIENT_H_
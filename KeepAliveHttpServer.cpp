@@ -0,0 +1,341 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "KeepAliveHttpServer.h"
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <cctype>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "debug.h"
+
+// How long the accept thread blocks waiting for a connection, this bounds how long stopping it takes.
+#define KEEPALIVE_SERVER_POLL_MS 100
+
+// Beyond this new connections are turned away, each one holds a thread. json-rpc-cpp's HttpServer used 50 threads.
+#define KEEPALIVE_SERVER_MAX_CONNECTIONS 50
+
+// A connection nothing arrives on for this long is closed, so clients that never close theirs don't hold threads.
+#define KEEPALIVE_SERVER_IDLE_TIMEOUT_MS 30000
+
+#define KEEPALIVE_SERVER_MAX_HEADER_SIZE 8192
+
+// Layers are sent as base64 PNGs in a single request.
+#define KEEPALIVE_SERVER_MAX_BODY_SIZE (64*1024*1024)
+
+
+KeepAliveHttpServer::KeepAliveHttpServer(int port)
+{
+	this->port = port;
+	listen_fd = -1;
+	thread = NULL;
+	thread_should_exit = false;
+}
+
+
+KeepAliveHttpServer::~KeepAliveHttpServer()
+{
+	StopListening();
+}
+
+
+/*
+	Returns false if the port could not be listened on or the server thread started.
+*/
+bool KeepAliveHttpServer::StartListening()
+{
+	if (thread) {
+		return true;
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		std::cerr << "Error creating HTTP socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 16) != 0) {
+		std::cerr << "Error listening for HTTP on port " << port << ": " << strerror(errno) << std::endl;
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+	}
+
+	thread_should_exit = false;
+	try {
+		thread = new std::thread(&KeepAliveHttpServer::serve, this);
+	} catch (std::system_error e) {
+		std::cerr << "Error allocating thread: " << e.what() << std::endl;
+		StopListening();
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+	Closes every open connection, requests already being handled are answered first.
+*/
+bool KeepAliveHttpServer::StopListening()
+{
+	bool was_listening = thread != NULL;
+
+	thread_should_exit = true;
+	if (thread) {
+		thread->join();
+		delete thread;
+		thread = NULL;
+	}
+	reapConnections(true);
+
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		listen_fd = -1;
+	}
+
+	return was_listening;
+}
+
+
+/*
+	Called by json-rpc-cpp from within OnRequest, addInfo is the Connection the request arrived on. The headers and
+	body are written together so Nagle can't hold the body back until the client acks the headers.
+*/
+bool KeepAliveHttpServer::SendResponse(const std::string& response, void* addInfo)
+{
+	Connection *connection = (Connection*)addInfo;
+
+	std::ostringstream headers;
+	headers << "HTTP/1.1 200 OK\r\n"
+		"Content-Type: application/json\r\n"
+		"Content-Length: " << response.size() << "\r\n";
+	// KeepAliveHttpClient only reuses connections the server says it keeps.
+	headers << (connection->keep_open ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
+	headers << "\r\n";
+
+	if (!sendAll(connection->fd, headers.str() + response)) {
+		connection->keep_open = false;
+		return false;
+	}
+	return true;
+}
+
+
+void KeepAliveHttpServer::serve()
+{
+	D(std::cout << "HTTP server thread for port " << port << " starting" << std::endl;)
+
+	while (!thread_should_exit) {
+		struct pollfd pfd;
+		pfd.fd = listen_fd;
+		pfd.events = POLLIN;
+		int ready = poll(&pfd, 1, KEEPALIVE_SERVER_POLL_MS);
+		reapConnections(false);
+		if (ready <= 0) {
+			continue;
+		}
+
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+
+		// Responses are small and go out in one write, don't let Nagle hold them back.
+		int nodelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+		struct timeval tv;
+		tv.tv_sec = KEEPALIVE_SERVER_IDLE_TIMEOUT_MS/1000;
+		tv.tv_usec = (KEEPALIVE_SERVER_IDLE_TIMEOUT_MS%1000)*1000;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		connections_mutex.lock();
+		if (connections.size() >= KEEPALIVE_SERVER_MAX_CONNECTIONS) {
+			connections_mutex.unlock();
+			std::cerr << "Too many HTTP connections on port " << port << ", turning the newest away." << std::endl;
+			sendError(fd, "503 Service Unavailable");
+			close(fd);
+			continue;
+		}
+		Connection *connection = new Connection;
+		connection->fd = fd;
+		connection->done = false;
+		connection->keep_open = false;
+		try {
+			connection->thread = new std::thread(&KeepAliveHttpServer::serveConnection, this, connection);
+			connections.push_back(connection);
+		} catch (std::system_error e) {
+			std::cerr << "Error allocating thread: " << e.what() << std::endl;
+			close(fd);
+			delete connection;
+		}
+		connections_mutex.unlock();
+	}
+
+	D(std::cout << "HTTP server thread for port " << port << " exiting" << std::endl;)
+}
+
+
+/*
+	Joins the threads of connections that have closed, or of all of them after waking them up.
+*/
+void KeepAliveHttpServer::reapConnections(bool all)
+{
+	connections_mutex.lock();
+	std::list<Connection*>::iterator it = connections.begin();
+	while (it != connections.end()) {
+		Connection *connection = *it;
+		if (!all && !connection->done) {
+			it++;
+			continue;
+		}
+		// Wakes a thread waiting on its next request, the fd is only closed once it has let go of it.
+		shutdown(connection->fd, SHUT_RDWR);
+		connection->thread->join();
+		delete connection->thread;
+		close(connection->fd);
+		delete connection;
+		it = connections.erase(it);
+	}
+	connections_mutex.unlock();
+}
+
+
+void KeepAliveHttpServer::serveConnection(Connection *connection)
+{
+	// Holds whatever of the next request arrived along with the last one.
+	std::string data;
+	std::string body;
+	while (!thread_should_exit && receiveRequest(connection, data, body)) {
+		if (!OnRequest(body, connection) || !connection->keep_open) {
+			break;
+		}
+	}
+	// The client sees the close right away, the fd itself is closed once the thread is reaped.
+	shutdown(connection->fd, SHUT_RDWR);
+	connection->done = true;
+}
+
+
+/*
+	Reads the next request on connection into body. Returns false if the connection should be closed, after
+	answering with an error if the request can't be served.
+*/
+bool KeepAliveHttpServer::receiveRequest(Connection *connection, std::string &data, std::string &body)
+{
+	char buf[4096];
+	size_t header_end;
+	while ((header_end = data.find("\r\n\r\n")) == std::string::npos) {
+		if (data.size() > KEEPALIVE_SERVER_MAX_HEADER_SIZE) {
+			sendError(connection->fd, "431 Request Header Fields Too Large");
+			return false;
+		}
+		ssize_t len = recv(connection->fd, buf, sizeof(buf), 0);
+		if (len <= 0) {
+			return false;
+		}
+		data.append(buf, len);
+	}
+
+	std::string headers = data.substr(0, header_end);
+	data.erase(0, header_end + 4);
+	for (unsigned int i = 0; i < headers.size(); i++) {
+		headers[i] = tolower(headers[i]);
+	}
+
+	std::string request_line = headers.substr(0, headers.find("\r\n"));
+	if (request_line.compare(0, 5, "post ") != 0) {
+		sendError(connection->fd, "405 Method Not Allowed");
+		return false;
+	}
+
+	// HTTP/1.1 connections stay open unless the client says otherwise, HTTP/1.0 ones only if it asks.
+	if (request_line.size() >= 8 && request_line.compare(request_line.size() - 8, 8, "http/1.1") == 0) {
+		connection->keep_open = headers.find("\r\nconnection: close") == std::string::npos;
+	} else {
+		connection->keep_open = headers.find("\r\nconnection: keep-alive") != std::string::npos;
+	}
+
+	size_t length_pos = headers.find("\r\ncontent-length:");
+	if (length_pos == std::string::npos) {
+		sendError(connection->fd, "411 Length Required");
+		return false;
+	}
+	size_t length = strtoul(headers.c_str() + length_pos + 17, NULL, 10);
+	if (length > KEEPALIVE_SERVER_MAX_BODY_SIZE) {
+		sendError(connection->fd, "413 Payload Too Large");
+		return false;
+	}
+
+	// curl asks before sending a body over 1kB, such as a layer, and otherwise waits a second before sending it.
+	if (data.size() < length && headers.find("\r\nexpect: 100-continue") != std::string::npos) {
+		if (!sendAll(connection->fd, "HTTP/1.1 100 Continue\r\n\r\n")) {
+			return false;
+		}
+	}
+
+	while (data.size() < length) {
+		ssize_t len = recv(connection->fd, buf, sizeof(buf), 0);
+		if (len <= 0) {
+			return false;
+		}
+		data.append(buf, len);
+	}
+	body = data.substr(0, length);
+	data.erase(0, length);
+
+	return true;
+}
+
+
+void KeepAliveHttpServer::sendError(int fd, const std::string &status)
+{
+	sendAll(fd, "HTTP/1.1 " + status + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+}
+
+
+bool KeepAliveHttpServer::sendAll(int fd, const std::string &data)
+{
+	size_t sent = 0;
+	while (sent < data.size()) {
+		ssize_t len = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if (len <= 0) {
+			return false;
+		}
+		sent += len;
+	}
+	return true;
+}
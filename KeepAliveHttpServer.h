@@ -0,0 +1,74 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _KEEPALIVEHTTPSERVER_H_
+#define _KEEPALIVEHTTPSERVER_H_
+
+#include <jsonrpc/rpc.h>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <list>
+#include <string>
+
+
+/*
+	A drop in replacement for jsonrpc::HttpServer that keeps HTTP/1.1 connections open between requests.
+	json-rpc-cpp's HttpServer leaves mongoose's keep-alive off, so it closes the connection after every response and
+	a client such as KeepAliveHttpClient has to connect again for each call anyway. Each connection gets a thread of
+	its own, which serves its requests one after the other until the client closes it or leaves it idle too long.
+	Only POST requests with a Content-Length are served.
+*/
+class KeepAliveHttpServer : public jsonrpc::AbstractServerConnector
+{
+	public:
+		KeepAliveHttpServer(int port);
+		virtual ~KeepAliveHttpServer();
+
+		virtual bool StartListening();
+		virtual bool StopListening();
+
+		virtual bool SendResponse(const std::string& response, void* addInfo = NULL);
+
+	private:
+		struct Connection
+		{
+			int fd;
+			std::thread *thread;
+			std::atomic<bool> done;
+			bool keep_open; // Whether the client wants the connection kept open after the response being sent.
+		};
+
+		void serve();
+		void serveConnection(Connection *connection);
+		bool receiveRequest(Connection *connection, std::string &data, std::string &body);
+		void sendError(int fd, const std::string &status);
+		static bool sendAll(int fd, const std::string &data);
+		void reapConnections(bool all);
+
+		int port;
+		int listen_fd;
+		std::thread *thread;
+		std::atomic<bool> thread_should_exit;
+
+		std::mutex connections_mutex;
+		std::list<Connection*> connections;
+};
+
+#endif //_KEEPALIVEHTTPSERVER_H_
@@ -19,21 +19,113 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "LaserSharkJSONServer.h"
 #include <jsonrpc/rpc.h>
-#include <jsonrpc/connectors/httpserver.h>
+#include "KeepAliveHttpServer.h"
 #include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <algorithm>
+#include <chrono>
+#include <thread>
 
 #include "base64/base64_cpp.h"
 #include "AbstractLaserSharkLayer.h"
 #include "LaserSharkZigZagLayer.h"
+#include "LaserSharkVectorLayer.h"
+#include "LaserSharkTiledLayer.h"
+#include "lasersharkbinrpcmethods.h"
+#include "lasershark_hostapp/twostep_common_lib.h"
+#include "metrics/Trace.h"
 #include "debug.h"
 
 const std::string LaserSharkJSONServer::LASERSHARK_JSON_SERVER_VERSION = "1";
 
+// Keeps a long poll from tying up a server thread indefinitely.
+#define WAIT_FOR_LAYER_DONE_MAX_TIMEOUT_MS 60000
+
+#define START_AFTER_MOTION_MAX_SETTLE_MS 10000
+// How long the start gate blocks per call, this bounds how long a stop can be held up.
+#define START_AFTER_MOTION_POLL_MS 20
+
+// Long enough to absorb dashboards polling, short enough that nobody notices.
+#define STATUS_CACHE_MS 100
+
+#define VECTOR_DEFAULT_BLANK_SETTLE_SAMPLES 4
+#define VECTOR_DEFAULT_CORNER_DWELL_SAMPLES 2
+#define VECTOR_DEFAULT_CORNER_MIN_ANGLE 45
+
 
 LaserSharkJSONServer::LaserSharkJSONServer() :
-	AbstractLaserSharkJSONServer(new jsonrpc::HttpServer(8080))
+	AbstractLaserSharkJSONServer(new KeepAliveHttpServer(8080)),
+	executor("lasershark", STATUS_CACHE_MS)
 {
 	lasershark = NULL;
+	twostep = NULL;
+	layer_type = LAYER_TYPE_ZIGZAG;
+	scan_forward_offset = 0;
+	scan_reverse_offset = 0;
+	scan_ramp_samples = 0;
+	dwell_max_repeats = 1;
+	dwell_map_width = 0;
+	dwell_map_height = 0;
+	dwell_map_serial = 0;
+	vector_blank_settle_samples = VECTOR_DEFAULT_BLANK_SETTLE_SAMPLES;
+	vector_corner_dwell_samples = VECTOR_DEFAULT_CORNER_DWELL_SAMPLES;
+	vector_corner_min_angle = VECTOR_DEFAULT_CORNER_MIN_ANGLE;
+	layer_log_should_exit = false;
+	layer_log_thread = NULL;
+
+	MetricsRegistry &metrics = MetricsRegistry::instance();
+	metric_layer_decode_seconds = metrics.histogram("lasershark_layer_decode_seconds",
+		"Time taken to base64 decode a layer's images.", MetricsRegistry::exponentialBuckets(0.0001, 2, 16));
+	metric_layer_populate_seconds = metrics.histogram("lasershark_layer_populate_seconds",
+		"Time taken to decode a layer's PNGs and build its samples.", MetricsRegistry::exponentialBuckets(0.001, 2, 16));
+
+	// These only look at host side state, waitForLayerDone must not hold up the queue.
+	executor.classify("getLaserSharkJSONVersion", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getLayerDone", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getLayerErrorMessage", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getLayerRunning", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getLayerSamplesLeft", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getLayerTimings", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getLayerTotalSamples", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("getPushThreadStats", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("waitForLayerDone", DeviceCommandExecutor::COMMAND_READ);
+	executor.classify("dumpTrace", DeviceCommandExecutor::COMMAND_READ);
+	// These ask the device.
+	executor.classify("getMaxSampleRate", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getResolution", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	// Takes its own locks, and must not wait behind a layer being decoded.
+	executor.classify("stopAndClearLayer", DeviceCommandExecutor::COMMAND_IMMEDIATE);
+
+	// Everything but waiting, which would hold the rest of the queue up for the whole batch.
+	executor.addBatchMethods(LaserSharkBinRpcMethods, LASERSHARKBINRPC_METHOD_COUNT, {"executeBatch", "waitForLayerDone"});
+}
+
+
+LaserSharkJSONServer::~LaserSharkJSONServer()
+{
+	if (lasershark) {
+		lasershark->setLayerTimingsListener(LaserSharkLayerTimingsListener());
+	}
+
+	// Layers already queued are still written.
+	if (layer_log_thread) {
+		layer_log_mutex.lock();
+		layer_log_should_exit = true;
+		layer_log_cv.notify_all();
+		layer_log_mutex.unlock();
+		layer_log_thread->join();
+		delete layer_log_thread;
+	}
+}
+
+
+/*
+	Where dumpTrace writes the trace. Call before StartListening.
+*/
+void LaserSharkJSONServer::setTraceFile(const std::string &path)
+{
+	trace_file = path;
 }
 
 
@@ -48,12 +140,104 @@ bool LaserSharkJSONServer::setLaserShark(LaserShark *lasershark)
 }
 
 
+bool LaserSharkJSONServer::setTwoStep(TwoStep *twostep)
+{
+	if (this->twostep) {
+		return false;
+	}
+	this->twostep = twostep;
+
+	return true;
+}
+
+
+/*
+	Appends the timings of every layer that finishes to the file at path as a line of JSON, see getLayerTimings.
+	The lines are written by a thread of their own so the push thread never waits on the file. Must be called
+	once, after setLaserShark. Returns false if the file could not be opened.
+*/
+bool LaserSharkJSONServer::setLayerLog(const std::string &path)
+{
+	if (!lasershark || layer_log_thread) {
+		return false;
+	}
+
+	layer_log.open(path.c_str(), std::ios::out | std::ios::app);
+	if (!layer_log.is_open()) {
+		return false;
+	}
+
+	try {
+		layer_log_thread = new std::thread(&LaserSharkJSONServer::layerLogThread, this);
+	} catch (std::system_error e) {
+		std::cerr << "Error allocating thread: " << e.what() << std::endl;
+		layer_log.close();
+		return false;
+	}
+	lasershark->setLayerTimingsListener(std::bind(&LaserSharkJSONServer::logLayerTimings, this, std::placeholders::_1));
+
+	return true;
+}
+
+
 std::string LaserSharkJSONServer::getLaserSharkJSONVersion()
 {
 	return LASERSHARK_JSON_SERVER_VERSION;
 }
 
 
+/*
+	Writes the events recorded so far to the trace file set with setTraceFile, in the Chrome trace event format.
+	Clients can't pick the path, the server usually runs as root. The value is the number of events written. Fails
+	if lasershark_3dp wasn't started with tracing on.
+*/
+Json::Value LaserSharkJSONServer::dumpTrace()
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!Tracer::instance().enabled()) {
+		prepForFailure(ret, "Tracing is not enabled.");
+		return ret;
+	}
+	if (trace_file.empty()) {
+		prepForFailure(ret, "No trace file is set.");
+		return ret;
+	}
+
+	unsigned int count = 0;
+	if (!Tracer::instance().dump(trace_file, &count)) {
+		prepForFailure(ret, "Could not write trace.");
+		return ret;
+	}
+	ret["value"] = count;
+
+	return ret;
+}
+
+
+/*
+	Runs calls in order as one change, see DeviceCommandExecutor::runBatch. value holds the result of each call
+	that was run.
+*/
+Json::Value LaserSharkJSONServer::executeBatch(const Json::Value& calls)
+{
+	Json::Value res;
+	std::string message;
+
+	bool ok = executor.runBatch(calls, [this](jsonrpc::Procedure *procedure, const Json::Value &params, Json::Value &result) {
+		AbstractLaserSharkJSONServer::handleMethodCall(procedure, params, result);
+	}, res["value"], message);
+	if (!ok) {
+		prepForFailure(res, message);
+		return res;
+	}
+
+	prepForSuccess(res);
+	return res;
+}
+
+
 Json::Value LaserSharkJSONServer::getLayerDone()
 {
 	Json::Value ret;
@@ -78,7 +262,7 @@ Json::Value LaserSharkJSONServer::getLayerErrorMessage()
 		return ret;
 	}
 
-	ret["value"] = getLayerErrorMessage();
+	ret["value"] = lasershark->getLayerErrorMessage();
 
 	return ret;
 }
@@ -148,6 +332,52 @@ Json::Value LaserSharkJSONServer::getMaxSampleRate()
 }
 
 
+/*
+	Returns where the time of the last layer to finish went, in microseconds. The fields are described with
+	LaserSharkLayerTimings.
+*/
+Json::Value LaserSharkJSONServer::getLayerTimings()
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkLaserSharkInitialization(ret)) {
+		return ret;
+	}
+
+	LaserSharkLayerTimings timings = lasershark->getLayerTimings();
+	if (!timings.layer) {
+		prepForFailure(ret, "No layer has finished yet.");
+		return ret;
+	}
+	ret["value"] = layerTimingsToJson(timings);
+
+	return ret;
+}
+
+
+/*
+	Gaps are the time between one transfer finishing and the next being submitted, in microseconds.
+*/
+Json::Value LaserSharkJSONServer::getPushThreadStats()
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkLaserSharkInitialization(ret)) {
+		return ret;
+	}
+
+	LaserSharkPushStats stats = lasershark->getPushStats();
+	ret["value"]["realtime"] = stats.realtime;
+	ret["value"]["transfers"] = stats.transfers;
+	ret["value"]["maxGapUs"] = stats.max_gap_us;
+	ret["value"]["avgGapUs"] = stats.avg_gap_us;
+
+	return ret;
+}
+
+
 Json::Value LaserSharkJSONServer::getResolution()
 {
 	Json::Value ret;
@@ -191,29 +421,258 @@ Json::Value LaserSharkJSONServer::sendLayer(const std::string& base64PNGData, co
 		return ret;
 	} 
 
+    std::chrono::steady_clock::time_point decode_start = std::chrono::steady_clock::now();
     unsigned char *decoded_image = (unsigned char*)base64::base64_decode(base64PNGData.c_str());
     D(std::cout << "Layer decode size " <<  decoded_size << std::endl;)
     if (!decoded_image) {
 		prepForFailure(ret, "Base64 decoding failed.");
 		return ret;
     }
+	std::chrono::steady_clock::duration decode = std::chrono::steady_clock::now() - decode_start;
+	metric_layer_decode_seconds->observe(std::chrono::duration<double>(decode).count());
 	
-	AbstractLaserSharkLayer *layer = new LaserSharkZigZagLayer();
+	unsigned int dwell_map_used;
+	AbstractLaserSharkLayer *layer = createLayer(dwell_map_used);
 	if (!layer) {
+		free(decoded_image);
 		prepForFailure(ret, "Could not allocate layer.");
 		return ret;
 	}
 
-	if (!layer->populate(xUpperLeftPos, yUpperLeftPos, decoded_image, decoded_size)) {
+	std::chrono::steady_clock::time_point populate_start = std::chrono::steady_clock::now();
+	bool populated = layer->populate(xUpperLeftPos, yUpperLeftPos, decoded_image, decoded_size);
+	free(decoded_image);
+	if (!populated) {
+		delete layer;
 		prepForFailure(ret, "LaserShark layer did not populate.");
 		return ret;	
 	}
+	consumeDwellMap(dwell_map_used);
+	std::chrono::steady_clock::duration populate = std::chrono::steady_clock::now() - populate_start;
+	metric_layer_populate_seconds->observe(std::chrono::duration<double>(populate).count());
+
+	LaserSharkLayerTimings timings;
+	timings.upload_bytes = base64PNGData.length();
+	timings.decode_us = std::chrono::duration_cast<std::chrono::microseconds>(decode).count();
+	timings.inflate_us = layer->getInflateUs();
+	timings.populate_us = std::chrono::duration_cast<std::chrono::microseconds>(populate).count() - timings.inflate_us;
+
+	if (!lasershark->setLayer(layer, timings)) {
+		delete layer;
+		prepForFailure(ret, "LaserShark rejected layer. Is another already waiting to run?");
+		return ret;
+	}
+
+	return ret;
+}
+
+
+/*
+	The dwell map applies to the next zig zag layer sent after this call, an empty map clears it. The map is
+	decoded here so a bad one fails this call, and it is kept until a layer using it populates.
+*/
+Json::Value LaserSharkJSONServer::sendDwellMap(const std::string& base64PNGData)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (base64PNGData.empty()) {
+		layer_options_mutex.lock();
+		dwell_map.clear();
+		dwell_map_serial++;
+		layer_options_mutex.unlock();
+		return ret;
+	}
+
+    int decoded_size = base64::base64_decoded_size(base64PNGData.length());
+	if (!decoded_size) {
+		prepForFailure(ret, "Base64 decode size was zero.");
+		return ret;
+	}
 
-	if (!lasershark->setLayer(layer)) {
-		prepForFailure(ret, "LaserShark rejected layer. Is a layer running?");
+    unsigned char *decoded_map = (unsigned char*)base64::base64_decode(base64PNGData.c_str());
+    if (!decoded_map) {
+		prepForFailure(ret, "Base64 decoding failed.");
+		return ret;
+    }
+
+	std::vector<unsigned char> map;
+	unsigned int width, height;
+	bool decoded = LaserSharkZigZagLayer::decodeDwellMap(decoded_map, decoded_size, map, width, height);
+	free(decoded_map);
+	if (!decoded) {
+		prepForFailure(ret, "Dwell map did not decode.");
 		return ret;
 	}
 
+	layer_options_mutex.lock();
+	dwell_map.swap(map);
+	dwell_map_width = width;
+	dwell_map_height = height;
+	dwell_map_serial++;
+	layer_options_mutex.unlock();
+
+	return ret;
+}
+
+
+/*
+	Each tile is an object with base64PNGData, xUpperLeftPos and yUpperLeftPos members. The tiles are drawn as
+	zig zag layers with the current scan compensation and dwell settings.
+*/
+Json::Value LaserSharkJSONServer::sendTiledLayer(const Json::Value& tiles)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkLaserSharkInitialization(ret)) {
+		return ret;
+	}
+
+	if (!tiles.isArray() || tiles.size() == 0) {
+		prepForFailure(ret, "Tiles must be a non-empty array.");
+		return ret;
+	}
+
+	std::vector<LaserSharkTile> layer_tiles;
+	LaserSharkLayerTimings timings;
+	std::string message;
+	std::chrono::steady_clock::time_point decode_start = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < tiles.size() && message.empty(); i++) {
+		const Json::Value &tile = tiles[i];
+		if (!tile.isObject() || !tile["base64PNGData"].isString() || !tile["xUpperLeftPos"].isInt() ||
+			!tile["yUpperLeftPos"].isInt() || tile["xUpperLeftPos"].asInt() < 0 || tile["yUpperLeftPos"].asInt() < 0) {
+			message = "Tile was malformed.";
+			break;
+		}
+
+		std::string data = tile["base64PNGData"].asString();
+		timings.upload_bytes += data.length();
+		int decoded_size = base64::base64_decoded_size(data.length());
+		if (!decoded_size) {
+			message = "Base64 decode size was zero.";
+			break;
+		}
+
+		unsigned char *decoded_image = (unsigned char*)base64::base64_decode(data.c_str());
+		if (!decoded_image) {
+			message = "Base64 decoding failed.";
+			break;
+		}
+
+		LaserSharkTile layer_tile;
+		layer_tile.x_origin = tile["xUpperLeftPos"].asInt();
+		layer_tile.y_origin = tile["yUpperLeftPos"].asInt();
+		layer_tile.png_image_data = decoded_image;
+		layer_tile.png_image_data_len = decoded_size;
+		layer_tiles.push_back(layer_tile);
+	}
+
+	LaserSharkTiledLayer *layer = NULL;
+	if (message.empty()) {
+		std::chrono::steady_clock::duration decode = std::chrono::steady_clock::now() - decode_start;
+		metric_layer_decode_seconds->observe(std::chrono::duration<double>(decode).count());
+		timings.decode_us = std::chrono::duration_cast<std::chrono::microseconds>(decode).count();
+
+		layer = new LaserSharkTiledLayer();
+		layer_options_mutex.lock();
+		layer->setScanCompensation(scan_forward_offset, scan_reverse_offset, scan_ramp_samples);
+		layer->setDwell(dwell_max_repeats);
+		layer_options_mutex.unlock();
+
+		std::chrono::steady_clock::time_point populate_start = std::chrono::steady_clock::now();
+		if (!layer->populate(layer_tiles)) {
+			message = "LaserShark layer did not populate.";
+		} else {
+			std::chrono::steady_clock::duration populate = std::chrono::steady_clock::now() - populate_start;
+			metric_layer_populate_seconds->observe(std::chrono::duration<double>(populate).count());
+			timings.inflate_us = layer->getInflateUs();
+			timings.populate_us = std::chrono::duration_cast<std::chrono::microseconds>(populate).count() - timings.inflate_us;
+		}
+	}
+
+	// The tiles keep decoded copies of their images.
+	for (unsigned int i = 0; i < layer_tiles.size(); i++) {
+		free((void*)layer_tiles[i].png_image_data);
+	}
+
+	if (message.empty() && !lasershark->setLayer(layer, timings)) {
+		message = "LaserShark rejected layer. Is another already waiting to run?";
+	}
+
+	if (!message.empty()) {
+		delete layer;
+		prepForFailure(ret, message);
+		return ret;
+	}
+
+	return ret;
+}
+
+
+/*
+	Lit pixels of zig zag layers get up to maxRepeats samples each, set by the dwell map if one was sent or
+	by the pixel's value otherwise. A maxRepeats of 1 disables dwell, at most LASERSHARK_MAX_DWELL_REPEATS is
+	allowed.
+*/
+Json::Value LaserSharkJSONServer::setDwellMode(const int& maxRepeats)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (maxRepeats < 1 || maxRepeats > LASERSHARK_MAX_DWELL_REPEATS) {
+		std::ostringstream oss;
+		oss << "Max repeats must be from 1 to " << LASERSHARK_MAX_DWELL_REPEATS << ".";
+		prepForFailure(ret, oss.str());
+		return ret;
+	}
+
+	layer_options_mutex.lock();
+	dwell_max_repeats = maxRepeats;
+	layer_options_mutex.unlock();
+
+	return ret;
+}
+
+
+/*
+	Hatching is used by vector layers, a spacing of 0 leaves only the outlines.
+*/
+Json::Value LaserSharkJSONServer::setHatchOptions(const int& angle, const int& spacing)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (spacing < 0) {
+		prepForFailure(ret, "Hatch spacing can't be negative.");
+		return ret;
+	}
+
+	preprocessor.setHatch(angle, spacing);
+
+	return ret;
+}
+
+
+Json::Value LaserSharkJSONServer::setLayerType(const std::string& type)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	LayerType new_type;
+	if (type == "zigzag") {
+		new_type = LAYER_TYPE_ZIGZAG;
+	} else if (type == "vector") {
+		new_type = LAYER_TYPE_VECTOR;
+	} else {
+		prepForFailure(ret, "Unknown layer type.");
+		return ret;
+	}
+
+	layer_options_mutex.lock();
+	layer_type = new_type;
+	layer_options_mutex.unlock();
+
 	return ret;
 }
 
@@ -241,6 +700,51 @@ Json::Value LaserSharkJSONServer::setSampleRate(const int& rate)
 }
 
 
+/*
+	Applies to zig zag layers sent after this call.
+*/
+Json::Value LaserSharkJSONServer::setScanCompensation(const int& forwardOffset, 
+	const int& reverseOffset, const int& rampSamples)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (rampSamples < 0) {
+		prepForFailure(ret, "Ramp samples can't be negative.");
+		return ret;
+	}
+
+	layer_options_mutex.lock();
+	scan_forward_offset = forwardOffset;
+	scan_reverse_offset = reverseOffset;
+	scan_ramp_samples = rampSamples;
+	layer_options_mutex.unlock();
+
+	return ret;
+}
+
+
+Json::Value LaserSharkJSONServer::setVectorLayerOptions(const int& blankSettleSamples, 
+	const int& cornerDwellSamples, const int& cornerMinAngle)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (blankSettleSamples < 0 || cornerDwellSamples < 0 || cornerMinAngle < 0 || cornerMinAngle > 180) {
+		prepForFailure(ret, "Vector layer option out of range.");
+		return ret;
+	}
+
+	layer_options_mutex.lock();
+	vector_blank_settle_samples = blankSettleSamples;
+	vector_corner_dwell_samples = cornerDwellSamples;
+	vector_corner_min_angle = cornerMinAngle;
+	layer_options_mutex.unlock();
+
+	return ret;
+}
+
+
 Json::Value LaserSharkJSONServer::startLayer()
 {
 	Json::Value ret;
@@ -265,6 +769,104 @@ Json::Value LaserSharkJSONServer::startLayer()
 }
 
 
+/*
+	Starts the layer, but only draws it once the steppers in stepperMask have stopped and settleMs more has passed.
+	This returns right away so the inter-layer moves, the upload of the next layer and its start can all be
+	overlapped, the layer counts as running while it waits.
+*/
+Json::Value LaserSharkJSONServer::startLayerAfterMotion(const int& settleMs, const int& stepperMask)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkLaserSharkInitialization(ret)) {
+		return ret;
+	}
+
+	if (!twostep) {
+		prepForFailure(ret, "TwoStep not available.");
+		return ret;
+	}
+
+	if (settleMs < 0 || settleMs > START_AFTER_MOTION_MAX_SETTLE_MS) {
+		prepForFailure(ret, "Settle time out of range.");
+		return ret;
+	}
+
+	// Caught here rather than as a layer error, the gate's poll is what checks the steppers.
+	if (stepperMask & ~(TWOSTEP_STEPPER_BITFIELD_STEPPER_1 | TWOSTEP_STEPPER_BITFIELD_STEPPER_2)) {
+		std::ostringstream oss;
+		oss << "Invalid stepper mask: " << stepperMask;
+		prepForFailure(ret, oss.str());
+		return ret;
+	}
+
+	TwoStep *twostep = this->twostep;
+	bool motion_done = false;
+	std::chrono::steady_clock::time_point settled;
+	LaserSharkStartGate start_gate = [twostep, stepperMask, settleMs, motion_done, settled]() mutable -> bool {
+		if (!motion_done) {
+			if (!twostep->waitForMotionComplete(stepperMask, START_AFTER_MOTION_POLL_MS)) {
+				return false;
+			}
+			motion_done = true;
+			settled = std::chrono::steady_clock::now() + std::chrono::milliseconds(settleMs);
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now >= settled) {
+			return true;
+		}
+		std::this_thread::sleep_for(std::min(std::chrono::steady_clock::duration(settled - now),
+			std::chrono::steady_clock::duration(std::chrono::milliseconds(START_AFTER_MOTION_POLL_MS))));
+		return std::chrono::steady_clock::now() >= settled;
+	};
+
+	try {
+		if (!lasershark->startLayer(start_gate)) {
+			prepForFailure(ret, "LaserShark could not start layer.");
+			return ret;
+		}
+	} catch (std::runtime_error e) {
+        prepForFailure(ret, e.what());
+        return ret;
+    }
+
+	return ret;
+}
+
+
+/*
+	Carries on with a layer that failed part way, value is set to the output sample it was resumed from. That counts
+	blank pixels and scan ramps too, which getLayerTotalSamples and getLayerSamplesLeft leave out for zig zag and
+	tiled layers. Up to 512 samples before it may be drawn twice if the LaserShark couldn't say how far it got, as
+	when it was unplugged.
+*/
+Json::Value LaserSharkJSONServer::resumeLayer()
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkLaserSharkInitialization(ret)) {
+		return ret;
+	}
+
+	try {
+		unsigned int checkpoint = lasershark->getLayerCheckpoint();
+		if (!lasershark->resumeLayer()) {
+			prepForFailure(ret, "LaserShark could not resume layer.");
+			return ret;
+		}
+		ret["value"] = checkpoint;
+	} catch (std::runtime_error e) {
+        prepForFailure(ret, e.what());
+        return ret;
+    }
+
+	return ret;
+}
+
+
 Json::Value LaserSharkJSONServer::stopAndClearLayer()
 {
 	Json::Value ret;
@@ -280,6 +882,89 @@ Json::Value LaserSharkJSONServer::stopAndClearLayer()
 }
 
 
+/*
+	Returns once the layer is done or timeoutMs passes, with value set to whether the layer is done.
+	Lets clients learn about layer completion without polling getLayerDone.
+*/
+Json::Value LaserSharkJSONServer::waitForLayerDone(const int& timeoutMs)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkLaserSharkInitialization(ret)) {
+		return ret;
+	}
+
+	if (timeoutMs < 0 || timeoutMs > WAIT_FOR_LAYER_DONE_MAX_TIMEOUT_MS) {
+		prepForFailure(ret, "Timeout out of range.");
+		return ret;
+	}
+
+	ret["value"] = lasershark->waitForLayerDone(timeoutMs);
+
+	return ret;
+}
+
+
+/*
+	Called on the LaserShark push thread, after the layer is done. Only queues the timings for layerLogThread.
+*/
+void LaserSharkJSONServer::logLayerTimings(const LaserSharkLayerTimings &timings)
+{
+	layer_log_mutex.lock();
+	layer_log_queue.push_back(timings);
+	layer_log_cv.notify_all();
+	layer_log_mutex.unlock();
+}
+
+
+/*
+	Writes the queued timings to the layer log until told to exit, and then writes whatever is left.
+*/
+void LaserSharkJSONServer::layerLogThread()
+{
+	Json::FastWriter writer;
+
+	std::unique_lock<std::mutex> lock(layer_log_mutex);
+	while (true) {
+		while (!layer_log_should_exit && layer_log_queue.empty()) {
+			layer_log_cv.wait(lock);
+		}
+		if (layer_log_queue.empty()) {
+			break;
+		}
+		LaserSharkLayerTimings timings = layer_log_queue.front();
+		layer_log_queue.pop_front();
+		lock.unlock();
+
+		layer_log << writer.write(layerTimingsToJson(timings)) << std::flush;
+
+		lock.lock();
+	}
+	lock.unlock();
+}
+
+
+Json::Value LaserSharkJSONServer::layerTimingsToJson(const LaserSharkLayerTimings &timings)
+{
+	Json::Value ret;
+	ret["layer"] = timings.layer;
+	ret["resumed"] = timings.resumed;
+	ret["uploadBytes"] = timings.upload_bytes;
+	ret["decodeUs"] = timings.decode_us;
+	ret["inflateUs"] = timings.inflate_us;
+	ret["populateUs"] = timings.populate_us;
+	ret["firstTransferUs"] = timings.first_transfer_us;
+	ret["gateUs"] = timings.gate_us;
+	ret["streamUs"] = timings.stream_us;
+	ret["drainUs"] = timings.drain_us;
+	ret["totalUs"] = timings.total_us;
+	ret["samples"] = timings.samples;
+	ret["error"] = timings.error;
+	return ret;
+}
+
+
 void LaserSharkJSONServer::prepForSuccess(Json::Value &obj)
 {
 	obj["success"] = true;
@@ -291,7 +976,64 @@ void LaserSharkJSONServer::prepForFailure(Json::Value &obj, std::string message)
 {
 		obj["success"] = false;
 		obj["message"] = message;
-        std::cerr << obj["message"] << std::endl;
+        D(std::cerr << obj["message"] << std::endl;)
+}
+
+
+/*
+	Times every method call for the jsonrpc_request_seconds metric.
+*/
+void LaserSharkJSONServer::handleMethodCall(jsonrpc::Procedure* proc, const Json::Value& input, Json::Value& output)
+{
+	executor.execute(proc->GetProcedureName(), input, output, [this, proc, &input](Json::Value &result) {
+		AbstractLaserSharkJSONServer::handleMethodCall(proc, input, result);
+	});
+}
+
+
+/*
+	Returns a new, unpopulated layer of the currently selected type, or NULL if one could not be allocated.
+	dwell_map_used is set to the dwell map the layer was given, or 0 for none. Pass it to consumeDwellMap once the
+	layer populates.
+*/
+AbstractLaserSharkLayer *LaserSharkJSONServer::createLayer(unsigned int &dwell_map_used)
+{
+	AbstractLaserSharkLayer *layer = NULL;
+	dwell_map_used = 0;
+
+	layer_options_mutex.lock();
+	if (layer_type == LAYER_TYPE_VECTOR) {
+		LaserSharkVectorLayer *vector_layer = new LaserSharkVectorLayer();
+		vector_layer->setBlankSettle(vector_blank_settle_samples);
+		vector_layer->setCornerDwell(vector_corner_dwell_samples, vector_corner_min_angle);
+		vector_layer->setPreprocessor(&preprocessor);
+		layer = vector_layer;
+	} else {
+		LaserSharkZigZagLayer *zigzag_layer = new LaserSharkZigZagLayer();
+		zigzag_layer->setScanCompensation(scan_forward_offset, scan_reverse_offset, scan_ramp_samples);
+		zigzag_layer->setDwell(dwell_max_repeats);
+		if (!dwell_map.empty()) {
+			zigzag_layer->setDwellMap(dwell_map, dwell_map_width, dwell_map_height);
+			dwell_map_used = dwell_map_serial;
+		}
+		layer = zigzag_layer;
+	}
+	layer_options_mutex.unlock();
+
+	return layer;
+}
+
+
+/*
+	Drops the dwell map a layer was built with, unless another has been sent since.
+*/
+void LaserSharkJSONServer::consumeDwellMap(unsigned int dwell_map_used)
+{
+	layer_options_mutex.lock();
+	if (dwell_map_used && dwell_map_serial == dwell_map_used) {
+		dwell_map.clear();
+	}
+	layer_options_mutex.unlock();
 }
 
 
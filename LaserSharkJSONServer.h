@@ -22,34 +22,108 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "abstractlasersharkjsonserver.h"
 #include "LaserShark.h"
+#include "LaserSharkLayerPreprocessor.h"
+#include "TwoStep.h"
+#include "metrics/Metrics.h"
+#include "DeviceCommandExecutor.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <fstream>
 
 
 class LaserSharkJSONServer : public AbstractLaserSharkJSONServer
 {
 	public:
 		LaserSharkJSONServer();
+		~LaserSharkJSONServer();
 
 		static const std::string LASERSHARK_JSON_SERVER_VERSION;
 
 		bool setLaserShark(LaserShark *laserShark);
+		bool setTwoStep(TwoStep *twoStep);
+		bool setLayerLog(const std::string &path);
+		void setTraceFile(const std::string &path);
 		
 		virtual std::string getLaserSharkJSONVersion();
+        virtual Json::Value dumpTrace();
+        virtual Json::Value executeBatch(const Json::Value& calls);
         virtual Json::Value getLayerDone();
         virtual Json::Value getLayerErrorMessage();
         virtual Json::Value getLayerRunning();
+        virtual Json::Value getLayerTimings();
         virtual Json::Value getLayerSamplesLeft();
         virtual Json::Value getLayerTotalSamples();
         virtual Json::Value getMaxSampleRate();
+        virtual Json::Value getPushThreadStats();
         virtual Json::Value getResolution();
         virtual void printText(const std::string& text);
+        virtual Json::Value resumeLayer();
+        virtual Json::Value sendDwellMap(const std::string& base64PNGData);
         virtual Json::Value sendLayer(const std::string& base64PNGData, 
 			const int& xUpperLeftPos, const int& yUpperLeftPos);
+        virtual Json::Value sendTiledLayer(const Json::Value& tiles);
+        virtual Json::Value setDwellMode(const int& maxRepeats);
+        virtual Json::Value setHatchOptions(const int& angle, const int& spacing);
+        virtual Json::Value setLayerType(const std::string& type);
         virtual Json::Value setSampleRate(const int& rate);
+        virtual Json::Value setScanCompensation(const int& forwardOffset, 
+			const int& reverseOffset, const int& rampSamples);
+        virtual Json::Value setVectorLayerOptions(const int& blankSettleSamples, 
+			const int& cornerDwellSamples, const int& cornerMinAngle);
         virtual Json::Value startLayer();
+        virtual Json::Value startLayerAfterMotion(const int& settleMs, 
+			const int& stepperMask);
         virtual Json::Value stopAndClearLayer();
+        virtual Json::Value waitForLayerDone(const int& timeoutMs);
+
+        virtual void handleMethodCall(jsonrpc::Procedure* proc, const Json::Value& input, Json::Value& output);
 
 	private: 
 		LaserShark *lasershark;
+		TwoStep *twostep; // Optional, only needed to gate layer starts on motion.
+
+		enum LayerType {
+			LAYER_TYPE_ZIGZAG,
+			LAYER_TYPE_VECTOR
+		};
+
+		std::mutex layer_options_mutex;
+		LayerType layer_type;
+		int scan_forward_offset;
+		int scan_reverse_offset;
+		int scan_ramp_samples;
+		int dwell_max_repeats;
+		std::vector<unsigned char> dwell_map; // Decoded, waiting for the next zig zag layer.
+		unsigned int dwell_map_width, dwell_map_height;
+		unsigned int dwell_map_serial; // Counts maps sent from 1, so a layer only uses up the map it was built with.
+		int vector_blank_settle_samples;
+		int vector_corner_dwell_samples;
+		int vector_corner_min_angle;
+
+		LaserSharkLayerPreprocessor preprocessor;
+
+		DeviceCommandExecutor executor;
+
+		MetricsHistogram *metric_layer_decode_seconds;
+		MetricsHistogram *metric_layer_populate_seconds;
+
+		std::mutex layer_log_mutex;
+		std::condition_variable layer_log_cv;
+		std::deque<LaserSharkLayerTimings> layer_log_queue; // Finished layers the log thread hasn't written yet.
+		bool layer_log_should_exit;
+		std::thread *layer_log_thread;
+		std::ofstream layer_log;
+
+		std::string trace_file;
+
+		AbstractLaserSharkLayer *createLayer(unsigned int &dwell_map_used);
+		void consumeDwellMap(unsigned int dwell_map_used);
+		void logLayerTimings(const LaserSharkLayerTimings &timings);
+		void layerLogThread();
+		static Json::Value layerTimingsToJson(const LaserSharkLayerTimings &timings);
 
 		void prepForSuccess(Json::Value &obj);
 		void prepForFailure(Json::Value &obj, std::string message);
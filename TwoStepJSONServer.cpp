@@ -19,15 +19,42 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "TwoStepJSONServer.h"
 #include <jsonrpc/rpc.h>
-#include <jsonrpc/connectors/httpserver.h>
+#include "KeepAliveHttpServer.h"
+#include "twostepbinrpcmethods.h"
+#include "debug.h"
 
 const std::string TwoStepJSONServer::TWOSTEP_JSON_SERVER_VERSION = "1";
 
+// Keeps a long poll from tying up a server thread indefinitely.
+#define WAIT_FOR_MOTION_COMPLETE_MAX_TIMEOUT_MS 60000
+
+// Long enough to absorb dashboards polling, short enough that a stopped stepper is seen right away.
+#define STATUS_CACHE_MS 50
+
 
 TwoStepJSONServer::TwoStepJSONServer() :
-	AbstractTwoStepJSONServer(new jsonrpc::HttpServer(8081))
+	AbstractTwoStepJSONServer(new KeepAliveHttpServer(8081)),
+	executor("twostep", STATUS_CACHE_MS)
 {
 	twoStep = NULL;
+
+	executor.classify("getTwoStepJSONVersion", DeviceCommandExecutor::COMMAND_READ);
+	// Polls with the bus lock only held per poll, so it must not hold up the queue.
+	executor.classify("waitForMotionComplete", DeviceCommandExecutor::COMMAND_READ);
+	// These ask the device over the uart bridge, which shares the bus with the LaserShark.
+	executor.classify("get100uSDelay", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getCurrent", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getDir", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getEnable", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getIsMoving", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getMicrosteps", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getSwitchStatus", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	executor.classify("getVersion", DeviceCommandExecutor::COMMAND_CACHED_READ);
+	// Takes the bus lock itself, and must not wait behind a batch.
+	executor.classify("stop", DeviceCommandExecutor::COMMAND_IMMEDIATE);
+
+	// Everything but waitForMotionComplete, which would hold the rest of the queue up for the whole batch.
+	executor.addBatchMethods(TwoStepBinRpcMethods, TWOSTEPBINRPC_METHOD_COUNT, {"executeBatch", "waitForMotionComplete"});
 }
 
 
@@ -42,6 +69,28 @@ bool TwoStepJSONServer::setTwoStep(TwoStep *twoStep)
 }
 
 
+/*
+	Runs calls in order as one change, see DeviceCommandExecutor::runBatch. value holds the result of each call
+	that was run.
+*/
+Json::Value TwoStepJSONServer::executeBatch(const Json::Value& calls)
+{
+	Json::Value res;
+	std::string message;
+
+	bool ok = executor.runBatch(calls, [this](jsonrpc::Procedure *procedure, const Json::Value &params, Json::Value &result) {
+		AbstractTwoStepJSONServer::handleMethodCall(procedure, params, result);
+	}, res["value"], message);
+	if (!ok) {
+		prepForFailure(res, message);
+		return res;
+	}
+
+	prepForSuccess(res);
+	return res;
+}
+
+
 Json::Value TwoStepJSONServer::get100uSDelay(const int& stepperNum)
 {
 	Json::Value ret;
@@ -213,6 +262,55 @@ Json::Value TwoStepJSONServer::getVersion()
 }
 
 
+/*
+	Configures and starts a stepper in one call, see TwoStep::move.
+*/
+Json::Value TwoStepJSONServer::move(const int& stepperNum, const bool& high, const int& steps, 
+	const int& delay, const int& current, const int& microsteps)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkTwoStepInitialization(ret)) {
+		return ret;
+	}
+
+	try {
+		twoStep->move(stepperNum, high, steps, delay, current, microsteps);
+	} catch (std::runtime_error e) {
+        prepForFailure(ret, e.what());
+        return ret;
+    }
+
+	return ret;
+}
+
+
+/*
+	Like move, but accelerates and decelerates using the stepper's motion profile. Returns once the move has
+	started, use waitForMotionComplete to wait for it.
+*/
+Json::Value TwoStepJSONServer::moveProfiled(const int& stepperNum, const bool& high, const int& steps, 
+	const int& current, const int& microsteps)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkTwoStepInitialization(ret)) {
+		return ret;
+	}
+
+	try {
+		twoStep->moveProfiled(stepperNum, high, steps, current, microsteps);
+	} catch (std::runtime_error e) {
+        prepForFailure(ret, e.what());
+        return ret;
+    }
+
+	return ret;
+}
+
+
 void TwoStepJSONServer::printText(const std::string& text)
 {
 	std::cout << "TwoStepJSONServer: " << text <<std::endl;
@@ -299,6 +397,35 @@ Json::Value TwoStepJSONServer::setEnable(const int& stepperNum, const bool& enab
 }
 
 
+/*
+	Delays are in 100uS units like set100uSDelay and acceleration is in steps/s^2.
+*/
+Json::Value TwoStepJSONServer::setMotionProfile(const int& stepperNum, const int& startDelay, 
+	const int& cruiseDelay, const int& acceleration)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkTwoStepInitialization(ret)) {
+		return ret;
+	}
+
+	if (startDelay <= 0 || cruiseDelay <= 0 || acceleration < 0) {
+		prepForFailure(ret, "Motion profile value out of range.");
+		return ret;
+	}
+
+	try {
+		twoStep->setMotionProfile(stepperNum, startDelay, cruiseDelay, acceleration);
+	} catch (std::runtime_error e) {
+        prepForFailure(ret, e.what());
+        return ret;
+    }
+
+	return ret;
+}
+
+
 Json::Value TwoStepJSONServer::setMicrosteps(const int& stepperNum, const int& value)
 {
 	Json::Value ret;
@@ -419,6 +546,45 @@ Json::Value TwoStepJSONServer::stop(const bool& stepperOne, const bool& stepperT
 }
 
 
+/*
+	Returns once the steppers in stepperMask stop or timeoutMs passes, with value set to whether they stopped.
+*/
+Json::Value TwoStepJSONServer::waitForMotionComplete(const int& stepperMask, const int& timeoutMs)
+{
+	Json::Value ret;
+	prepForSuccess(ret);
+
+	if (!checkTwoStepInitialization(ret)) {
+		return ret;
+	}
+
+	if (timeoutMs < 0 || timeoutMs > WAIT_FOR_MOTION_COMPLETE_MAX_TIMEOUT_MS) {
+		prepForFailure(ret, "Timeout out of range.");
+		return ret;
+	}
+
+	try {
+		ret["value"] = twoStep->waitForMotionComplete(stepperMask, timeoutMs);
+	} catch (std::runtime_error e) {
+        prepForFailure(ret, e.what());
+        return ret;
+    }
+
+	return ret;
+}
+
+
+/*
+	Times every method call for the jsonrpc_request_seconds metric.
+*/
+void TwoStepJSONServer::handleMethodCall(jsonrpc::Procedure* proc, const Json::Value& input, Json::Value& output)
+{
+	executor.execute(proc->GetProcedureName(), input, output, [this, proc, &input](Json::Value &result) {
+		AbstractTwoStepJSONServer::handleMethodCall(proc, input, result);
+	});
+}
+
+
 void TwoStepJSONServer::prepForSuccess(Json::Value &obj)
 {
 	obj["success"] = true;
@@ -430,7 +596,7 @@ void TwoStepJSONServer::prepForFailure(Json::Value &obj, std::string message)
 {
 		obj["success"] = false;
 		obj["message"] = message;
-        std::cerr << obj["message"] << std::endl;
+        D(std::cerr << obj["message"] << std::endl;)
 }
 
 
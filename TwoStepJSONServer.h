@@ -22,6 +22,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include "abstracttwostepjsonserver.h"
 #include "TwoStep.h"
+#include "DeviceCommandExecutor.h"
 
 class TwoStepJSONServer : public AbstractTwoStepJSONServer
 {
@@ -32,6 +33,7 @@ class TwoStepJSONServer : public AbstractTwoStepJSONServer
 
 		bool setTwoStep(TwoStep *twoStep);
 
+        virtual Json::Value executeBatch(const Json::Value& calls);
         virtual Json::Value get100uSDelay(const int& stepperNum);
         virtual Json::Value getCurrent(const int& stepperNum);
         virtual Json::Value getDir(const int& stepperNum);
@@ -41,21 +43,32 @@ class TwoStepJSONServer : public AbstractTwoStepJSONServer
         virtual Json::Value getSwitchStatus();
         virtual std::string getTwoStepJSONVersion();
         virtual Json::Value getVersion();
+        virtual Json::Value move(const int& stepperNum, const bool& high, const int& steps, 
+			const int& delay, const int& current, const int& microsteps);
+        virtual Json::Value moveProfiled(const int& stepperNum, const bool& high, const int& steps, 
+			const int& current, const int& microsteps);
         virtual void printText(const std::string& text);
         virtual Json::Value set100uSDelay(const int& stepperNum, const int& value);
         virtual Json::Value setCurrent(const int& stepperNum, const int& value);
         virtual Json::Value setDir(const int& stepperNum, const bool& high);
         virtual Json::Value setEnable(const int& stepperNum, const bool& enable);
+        virtual Json::Value setMotionProfile(const int& stepperNum, const int& startDelay, 
+			const int& cruiseDelay, const int& acceleration);
         virtual Json::Value setMicrosteps(const int& stepperNum, const int& value);
         virtual Json::Value setSafeSteps(const int& stepperNum, const int& steps);
         virtual Json::Value setStepUntilSwitch(const int& stepperNum);
         virtual Json::Value setSteps(const int& stepperNum, const int& steps);
         virtual Json::Value start(const bool& stepperOne, const bool& stepperTwo);
         virtual Json::Value stop(const bool& stepperOne, const bool& stepperTwo);
+        virtual Json::Value waitForMotionComplete(const int& stepperMask, const int& timeoutMs);
+
+        virtual void handleMethodCall(jsonrpc::Procedure* proc, const Json::Value& input, Json::Value& output);
 
 	private: 
 		TwoStep *twoStep;
 
+		DeviceCommandExecutor executor;
+
 		void prepForSuccess(Json::Value &obj);
 		void prepForFailure(Json::Value &obj, std::string message);
 		bool checkTwoStepInitialization(Json::Value &obj);
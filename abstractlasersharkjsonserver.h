@@ -13,22 +13,46 @@ class AbstractLaserSharkJSONServer : public jsonrpc::AbstractServer<AbstractLase
         AbstractLaserSharkJSONServer(jsonrpc::AbstractServerConnector* conn) :
             jsonrpc::AbstractServer<AbstractLaserSharkJSONServer>(conn) 
         {
+            this->bindAndAddMethod(new jsonrpc::Procedure("dumpTrace", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::dumpTraceI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("executeBatch", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "calls",jsonrpc::JSON_ARRAY, NULL), &AbstractLaserSharkJSONServer::executeBatchI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getLaserSharkJSONVersion", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_STRING,  NULL), &AbstractLaserSharkJSONServer::getLaserSharkJSONVersionI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getLayerDone", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getLayerDoneI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getLayerErrorMessage", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getLayerErrorMessageI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getLayerRunning", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getLayerRunningI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getLayerSamplesLeft", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getLayerSamplesLeftI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("getLayerTimings", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getLayerTimingsI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getLayerTotalSamples", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getLayerTotalSamplesI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getMaxSampleRate", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getMaxSampleRateI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("getPushThreadStats", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getPushThreadStatsI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getResolution", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::getResolutionI);
             this->bindAndAddNotification(new jsonrpc::Procedure("printText", jsonrpc::PARAMS_BY_NAME, "text",jsonrpc::JSON_STRING, NULL), &AbstractLaserSharkJSONServer::printTextI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("resumeLayer", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::resumeLayerI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("sendDwellMap", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "base64PNGData",jsonrpc::JSON_STRING, NULL), &AbstractLaserSharkJSONServer::sendDwellMapI);
             this->bindAndAddMethod(new jsonrpc::Procedure("sendLayer", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "base64PNGData",jsonrpc::JSON_STRING,"xUpperLeftPos",jsonrpc::JSON_INTEGER,"yUpperLeftPos",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::sendLayerI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("sendTiledLayer", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "tiles",jsonrpc::JSON_ARRAY, NULL), &AbstractLaserSharkJSONServer::sendTiledLayerI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("setDwellMode", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "maxRepeats",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::setDwellModeI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("setHatchOptions", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "angle",jsonrpc::JSON_INTEGER,"spacing",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::setHatchOptionsI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("setLayerType", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "type",jsonrpc::JSON_STRING, NULL), &AbstractLaserSharkJSONServer::setLayerTypeI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setSampleRate", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "rate",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::setSampleRateI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("setScanCompensation", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "forwardOffset",jsonrpc::JSON_INTEGER,"reverseOffset",jsonrpc::JSON_INTEGER,"rampSamples",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::setScanCompensationI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("setVectorLayerOptions", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "blankSettleSamples",jsonrpc::JSON_INTEGER,"cornerDwellSamples",jsonrpc::JSON_INTEGER,"cornerMinAngle",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::setVectorLayerOptionsI);
             this->bindAndAddMethod(new jsonrpc::Procedure("startLayer", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::startLayerI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("startLayerAfterMotion", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "settleMs",jsonrpc::JSON_INTEGER,"stepperMask",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::startLayerAfterMotionI);
             this->bindAndAddMethod(new jsonrpc::Procedure("stopAndClearLayer", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractLaserSharkJSONServer::stopAndClearLayerI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("waitForLayerDone", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "timeoutMs",jsonrpc::JSON_INTEGER, NULL), &AbstractLaserSharkJSONServer::waitForLayerDoneI);
 
         }
         
+        inline virtual void dumpTraceI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->dumpTrace();
+        }
+
+        inline virtual void executeBatchI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->executeBatch(request["calls"]);
+        }
+
         inline virtual void getLaserSharkJSONVersionI(const Json::Value& request, Json::Value& response) 
         {
             response = this->getLaserSharkJSONVersion();
@@ -54,6 +78,11 @@ class AbstractLaserSharkJSONServer : public jsonrpc::AbstractServer<AbstractLase
             response = this->getLayerSamplesLeft();
         }
 
+        inline virtual void getLayerTimingsI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->getLayerTimings();
+        }
+
         inline virtual void getLayerTotalSamplesI(const Json::Value& request, Json::Value& response) 
         {
             response = this->getLayerTotalSamples();
@@ -64,6 +93,11 @@ class AbstractLaserSharkJSONServer : public jsonrpc::AbstractServer<AbstractLase
             response = this->getMaxSampleRate();
         }
 
+        inline virtual void getPushThreadStatsI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->getPushThreadStats();
+        }
+
         inline virtual void getResolutionI(const Json::Value& request, Json::Value& response) 
         {
             response = this->getResolution();
@@ -74,40 +108,104 @@ class AbstractLaserSharkJSONServer : public jsonrpc::AbstractServer<AbstractLase
             this->printText(request["text"].asString());
         }
 
+        inline virtual void resumeLayerI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->resumeLayer();
+        }
+
+        inline virtual void sendDwellMapI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->sendDwellMap(request["base64PNGData"].asString());
+        }
+
         inline virtual void sendLayerI(const Json::Value& request, Json::Value& response) 
         {
             response = this->sendLayer(request["base64PNGData"].asString(), request["xUpperLeftPos"].asInt(), request["yUpperLeftPos"].asInt());
         }
 
+        inline virtual void sendTiledLayerI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->sendTiledLayer(request["tiles"]);
+        }
+
+        inline virtual void setDwellModeI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->setDwellMode(request["maxRepeats"].asInt());
+        }
+
+        inline virtual void setHatchOptionsI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->setHatchOptions(request["angle"].asInt(), request["spacing"].asInt());
+        }
+
+        inline virtual void setLayerTypeI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->setLayerType(request["type"].asString());
+        }
+
         inline virtual void setSampleRateI(const Json::Value& request, Json::Value& response) 
         {
             response = this->setSampleRate(request["rate"].asInt());
         }
 
+        inline virtual void setScanCompensationI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->setScanCompensation(request["forwardOffset"].asInt(), request["reverseOffset"].asInt(), request["rampSamples"].asInt());
+        }
+
+        inline virtual void setVectorLayerOptionsI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->setVectorLayerOptions(request["blankSettleSamples"].asInt(), request["cornerDwellSamples"].asInt(), request["cornerMinAngle"].asInt());
+        }
+
         inline virtual void startLayerI(const Json::Value& request, Json::Value& response) 
         {
             response = this->startLayer();
         }
 
+        inline virtual void startLayerAfterMotionI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->startLayerAfterMotion(request["settleMs"].asInt(), request["stepperMask"].asInt());
+        }
+
         inline virtual void stopAndClearLayerI(const Json::Value& request, Json::Value& response) 
         {
             response = this->stopAndClearLayer();
         }
 
+        inline virtual void waitForLayerDoneI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->waitForLayerDone(request["timeoutMs"].asInt());
+        }
+
 
+        virtual Json::Value dumpTrace() = 0;
+        virtual Json::Value executeBatch(const Json::Value& calls) = 0;
         virtual std::string getLaserSharkJSONVersion() = 0;
         virtual Json::Value getLayerDone() = 0;
         virtual Json::Value getLayerErrorMessage() = 0;
         virtual Json::Value getLayerRunning() = 0;
         virtual Json::Value getLayerSamplesLeft() = 0;
+        virtual Json::Value getLayerTimings() = 0;
         virtual Json::Value getLayerTotalSamples() = 0;
         virtual Json::Value getMaxSampleRate() = 0;
+        virtual Json::Value getPushThreadStats() = 0;
         virtual Json::Value getResolution() = 0;
         virtual void printText(const std::string& text) = 0;
+        virtual Json::Value resumeLayer() = 0;
+        virtual Json::Value sendDwellMap(const std::string& base64PNGData) = 0;
         virtual Json::Value sendLayer(const std::string& base64PNGData, const int& xUpperLeftPos, const int& yUpperLeftPos) = 0;
+        virtual Json::Value sendTiledLayer(const Json::Value& tiles) = 0;
+        virtual Json::Value setDwellMode(const int& maxRepeats) = 0;
+        virtual Json::Value setHatchOptions(const int& angle, const int& spacing) = 0;
+        virtual Json::Value setLayerType(const std::string& type) = 0;
         virtual Json::Value setSampleRate(const int& rate) = 0;
+        virtual Json::Value setScanCompensation(const int& forwardOffset, const int& reverseOffset, const int& rampSamples) = 0;
+        virtual Json::Value setVectorLayerOptions(const int& blankSettleSamples, const int& cornerDwellSamples, const int& cornerMinAngle) = 0;
         virtual Json::Value startLayer() = 0;
+        virtual Json::Value startLayerAfterMotion(const int& settleMs, const int& stepperMask) = 0;
         virtual Json::Value stopAndClearLayer() = 0;
+        virtual Json::Value waitForLayerDone(const int& timeoutMs) = 0;
 
 };
 #endif //_ABSTRACTLASERSHARKJSONSERVER_H_
@@ -13,6 +13,7 @@ class AbstractTwoStepJSONServer : public jsonrpc::AbstractServer<AbstractTwoStep
         AbstractTwoStepJSONServer(jsonrpc::AbstractServerConnector* conn) :
             jsonrpc::AbstractServer<AbstractTwoStepJSONServer>(conn) 
         {
+            this->bindAndAddMethod(new jsonrpc::Procedure("executeBatch", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "calls",jsonrpc::JSON_ARRAY, NULL), &AbstractTwoStepJSONServer::executeBatchI);
             this->bindAndAddMethod(new jsonrpc::Procedure("get100uSDelay", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::get100uSDelayI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getCurrent", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::getCurrentI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getDir", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::getDirI);
@@ -22,20 +23,29 @@ class AbstractTwoStepJSONServer : public jsonrpc::AbstractServer<AbstractTwoStep
             this->bindAndAddMethod(new jsonrpc::Procedure("getSwitchStatus", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractTwoStepJSONServer::getSwitchStatusI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getTwoStepJSONVersion", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_STRING,  NULL), &AbstractTwoStepJSONServer::getTwoStepJSONVersionI);
             this->bindAndAddMethod(new jsonrpc::Procedure("getVersion", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT,  NULL), &AbstractTwoStepJSONServer::getVersionI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("move", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"high",jsonrpc::JSON_BOOLEAN,"steps",jsonrpc::JSON_INTEGER,"delay",jsonrpc::JSON_INTEGER,"current",jsonrpc::JSON_INTEGER,"microsteps",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::moveI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("moveProfiled", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"high",jsonrpc::JSON_BOOLEAN,"steps",jsonrpc::JSON_INTEGER,"current",jsonrpc::JSON_INTEGER,"microsteps",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::moveProfiledI);
             this->bindAndAddNotification(new jsonrpc::Procedure("printText", jsonrpc::PARAMS_BY_NAME, "text",jsonrpc::JSON_STRING, NULL), &AbstractTwoStepJSONServer::printTextI);
             this->bindAndAddMethod(new jsonrpc::Procedure("set100uSDelay", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"value",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::set100uSDelayI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setCurrent", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"value",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::setCurrentI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setDir", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"high",jsonrpc::JSON_BOOLEAN, NULL), &AbstractTwoStepJSONServer::setDirI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setEnable", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"enable", jsonrpc::JSON_BOOLEAN, NULL), &AbstractTwoStepJSONServer::setEnableI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setMicrosteps", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"value",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::setMicrostepsI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("setMotionProfile", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"startDelay",jsonrpc::JSON_INTEGER,"cruiseDelay",jsonrpc::JSON_INTEGER,"acceleration",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::setMotionProfileI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setSafeSteps", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"steps",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::setSafeStepsI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setStepUntilSwitch", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::setStepUntilSwitchI);
             this->bindAndAddMethod(new jsonrpc::Procedure("setSteps", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperNum",jsonrpc::JSON_INTEGER,"steps",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::setStepsI);
             this->bindAndAddMethod(new jsonrpc::Procedure("start", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperOne",jsonrpc::JSON_BOOLEAN,"stepperTwo",jsonrpc::JSON_BOOLEAN, NULL), &AbstractTwoStepJSONServer::startI);
             this->bindAndAddMethod(new jsonrpc::Procedure("stop", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperOne",jsonrpc::JSON_BOOLEAN,"stepperTwo",jsonrpc::JSON_BOOLEAN, NULL), &AbstractTwoStepJSONServer::stopI);
+            this->bindAndAddMethod(new jsonrpc::Procedure("waitForMotionComplete", jsonrpc::PARAMS_BY_NAME, jsonrpc::JSON_OBJECT, "stepperMask",jsonrpc::JSON_INTEGER,"timeoutMs",jsonrpc::JSON_INTEGER, NULL), &AbstractTwoStepJSONServer::waitForMotionCompleteI);
 
         }
         
+        inline virtual void executeBatchI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->executeBatch(request["calls"]);
+        }
+
         inline virtual void get100uSDelayI(const Json::Value& request, Json::Value& response) 
         {
             response = this->get100uSDelay(request["stepperNum"].asInt());
@@ -81,6 +91,16 @@ class AbstractTwoStepJSONServer : public jsonrpc::AbstractServer<AbstractTwoStep
             response = this->getVersion();
         }
 
+        inline virtual void moveI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->move(request["stepperNum"].asInt(), request["high"].asBool(), request["steps"].asInt(), request["delay"].asInt(), request["current"].asInt(), request["microsteps"].asInt());
+        }
+
+        inline virtual void moveProfiledI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->moveProfiled(request["stepperNum"].asInt(), request["high"].asBool(), request["steps"].asInt(), request["current"].asInt(), request["microsteps"].asInt());
+        }
+
         inline virtual void printTextI(const Json::Value& request) 
         {
             this->printText(request["text"].asString());
@@ -111,6 +131,11 @@ class AbstractTwoStepJSONServer : public jsonrpc::AbstractServer<AbstractTwoStep
             response = this->setMicrosteps(request["stepperNum"].asInt(), request["value"].asInt());
         }
 
+        inline virtual void setMotionProfileI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->setMotionProfile(request["stepperNum"].asInt(), request["startDelay"].asInt(), request["cruiseDelay"].asInt(), request["acceleration"].asInt());
+        }
+
         inline virtual void setSafeStepsI(const Json::Value& request, Json::Value& response) 
         {
             response = this->setSafeSteps(request["stepperNum"].asInt(), request["steps"].asInt());
@@ -136,7 +161,13 @@ class AbstractTwoStepJSONServer : public jsonrpc::AbstractServer<AbstractTwoStep
             response = this->stop(request["stepperOne"].asBool(), request["stepperTwo"].asBool());
         }
 
+        inline virtual void waitForMotionCompleteI(const Json::Value& request, Json::Value& response) 
+        {
+            response = this->waitForMotionComplete(request["stepperMask"].asInt(), request["timeoutMs"].asInt());
+        }
+
 
+        virtual Json::Value executeBatch(const Json::Value& calls) = 0;
         virtual Json::Value get100uSDelay(const int& stepperNum) = 0;
         virtual Json::Value getCurrent(const int& stepperNum) = 0;
         virtual Json::Value getDir(const int& stepperNum) = 0;
@@ -146,17 +177,21 @@ class AbstractTwoStepJSONServer : public jsonrpc::AbstractServer<AbstractTwoStep
         virtual Json::Value getSwitchStatus() = 0;
         virtual std::string getTwoStepJSONVersion() = 0;
         virtual Json::Value getVersion() = 0;
+        virtual Json::Value move(const int& stepperNum, const bool& high, const int& steps, const int& delay, const int& current, const int& microsteps) = 0;
+        virtual Json::Value moveProfiled(const int& stepperNum, const bool& high, const int& steps, const int& current, const int& microsteps) = 0;
         virtual void printText(const std::string& text) = 0;
         virtual Json::Value set100uSDelay(const int& stepperNum, const int& value) = 0;
         virtual Json::Value setCurrent(const int& stepperNum, const int& value) = 0;
         virtual Json::Value setDir(const int& stepperNum, const bool& high) = 0;
         virtual Json::Value setEnable(const int& stepperNum, const bool& enable) = 0;
         virtual Json::Value setMicrosteps(const int& stepperNum, const int& value) = 0;
+        virtual Json::Value setMotionProfile(const int& stepperNum, const int& startDelay, const int& cruiseDelay, const int& acceleration) = 0;
         virtual Json::Value setSafeSteps(const int& stepperNum, const int& steps) = 0;
         virtual Json::Value setStepUntilSwitch(const int& stepperNum) = 0;
         virtual Json::Value setSteps(const int& stepperNum, const int& steps) = 0;
         virtual Json::Value start(const bool& stepperOne, const bool& stepperTwo) = 0;
         virtual Json::Value stop(const bool& stepperOne, const bool& stepperTwo) = 0;
+        virtual Json::Value waitForMotionComplete(const int& stepperMask, const int& timeoutMs) = 0;
 
 };
 #endif //_ABSTRACTTWOSTEPJSONSERVER_H_
@@ -0,0 +1,287 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BinRpc.h"
+#include <sys/socket.h>
+
+
+void BinRpcWriter::putUint8(uint8_t val)
+{
+	buf += (char)val;
+}
+
+
+void BinRpcWriter::putUint16(uint16_t val)
+{
+	buf += (char)(val >> 8);
+	buf += (char)val;
+}
+
+
+void BinRpcWriter::putUint32(uint32_t val)
+{
+	buf += (char)(val >> 24);
+	buf += (char)(val >> 16);
+	buf += (char)(val >> 8);
+	buf += (char)val;
+}
+
+
+void BinRpcWriter::putInt(int val)
+{
+	putUint32((uint32_t)val);
+}
+
+
+void BinRpcWriter::putBool(bool val)
+{
+	putUint8(val ? 1 : 0);
+}
+
+
+void BinRpcWriter::putString(const std::string &val)
+{
+	putUint32(val.size());
+	buf += val;
+}
+
+
+void BinRpcWriter::putJson(const Json::Value &val)
+{
+	Json::FastWriter writer;
+	putString(writer.write(val));
+}
+
+
+/*
+	Writes val as type, a val of another type is converted the way Json::Value converts it.
+*/
+void BinRpcWriter::putValue(BinRpcType type, const Json::Value &val)
+{
+	switch (type) {
+	case BINRPC_INT:
+		putInt(val.asInt());
+		break;
+	case BINRPC_BOOL:
+		putBool(val.asBool());
+		break;
+	case BINRPC_STRING:
+		putString(val.asString());
+		break;
+	case BINRPC_ARRAY:
+	case BINRPC_OBJECT:
+		putJson(val);
+		break;
+	}
+}
+
+
+const std::string &BinRpcWriter::data() const
+{
+	return buf;
+}
+
+
+BinRpcReader::BinRpcReader()
+{
+	pos = 0;
+}
+
+
+BinRpcReader::BinRpcReader(const std::string &data)
+{
+	buf = data;
+	pos = 0;
+}
+
+
+void BinRpcReader::need(size_t len) throw (std::runtime_error)
+{
+	if (buf.size() - pos < len) {
+		throw std::runtime_error("Message ended early.");
+	}
+}
+
+
+uint8_t BinRpcReader::getUint8() throw (std::runtime_error)
+{
+	need(1);
+	return (uint8_t)buf[pos++];
+}
+
+
+uint16_t BinRpcReader::getUint16() throw (std::runtime_error)
+{
+	need(2);
+	uint16_t val = ((uint8_t)buf[pos] << 8) | (uint8_t)buf[pos + 1];
+	pos += 2;
+	return val;
+}
+
+
+uint32_t BinRpcReader::getUint32() throw (std::runtime_error)
+{
+	need(4);
+	uint32_t val = ((uint32_t)(uint8_t)buf[pos] << 24) | ((uint32_t)(uint8_t)buf[pos + 1] << 16) |
+		((uint32_t)(uint8_t)buf[pos + 2] << 8) | (uint8_t)buf[pos + 3];
+	pos += 4;
+	return val;
+}
+
+
+int BinRpcReader::getInt() throw (std::runtime_error)
+{
+	return (int)getUint32();
+}
+
+
+bool BinRpcReader::getBool() throw (std::runtime_error)
+{
+	return getUint8() != 0;
+}
+
+
+std::string BinRpcReader::getString() throw (std::runtime_error)
+{
+	uint32_t len = getUint32();
+	need(len);
+	std::string val = buf.substr(pos, len);
+	pos += len;
+	return val;
+}
+
+
+Json::Value BinRpcReader::getJson() throw (std::runtime_error)
+{
+	Json::Reader reader;
+	Json::Value val;
+	if (!reader.parse(getString(), val)) {
+		throw std::runtime_error("Invalid JSON in message.");
+	}
+	return val;
+}
+
+
+Json::Value BinRpcReader::getValue(BinRpcType type) throw (std::runtime_error)
+{
+	switch (type) {
+	case BINRPC_INT:
+		return Json::Value(getInt());
+	case BINRPC_BOOL:
+		return Json::Value(getBool());
+	case BINRPC_STRING:
+		return Json::Value(getString());
+	case BINRPC_ARRAY:
+	case BINRPC_OBJECT:
+		return getJson();
+	}
+	return Json::Value();
+}
+
+
+static bool sendAll(int fd, const char *data, size_t len)
+{
+	size_t sent = 0;
+	while (sent < len) {
+		ssize_t ret = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+		if (ret <= 0) {
+			return false;
+		}
+		sent += ret;
+	}
+	return true;
+}
+
+
+static bool receiveAll(int fd, char *data, size_t len)
+{
+	size_t received = 0;
+	while (received < len) {
+		ssize_t ret = recv(fd, data + received, len - received, 0);
+		if (ret <= 0) {
+			return false;
+		}
+		received += ret;
+	}
+	return true;
+}
+
+
+/*
+	Returns false if the connection failed.
+*/
+bool binRpcSendFrame(int fd, const std::string &payload)
+{
+	BinRpcWriter frame;
+	frame.putUint32(payload.size());
+	// Small frames go out in one segment, large ones aren't worth copying.
+	if (payload.size() < 4096) {
+		std::string data = frame.data() + payload;
+		return sendAll(fd, data.data(), data.size());
+	}
+	return sendAll(fd, frame.data().data(), 4) && sendAll(fd, payload.data(), payload.size());
+}
+
+
+/*
+	Returns false if the connection failed or closed, or the frame is larger than BINRPC_MAX_FRAME_SIZE.
+*/
+bool binRpcReceiveFrame(int fd, std::string &payload)
+{
+	char len_buf[4];
+	if (!receiveAll(fd, len_buf, sizeof(len_buf))) {
+		return false;
+	}
+	uint32_t len = BinRpcReader(std::string(len_buf, sizeof(len_buf))).getUint32();
+	if (len > BINRPC_MAX_FRAME_SIZE) {
+		return false;
+	}
+
+	payload.resize(len);
+	return len == 0 || receiveAll(fd, &payload[0], len);
+}
+
+
+jsonrpc::Procedure *binRpcProcedure(const BinRpcMethod &method)
+{
+	jsonrpc::Procedure *procedure = new jsonrpc::Procedure(method.name, jsonrpc::PARAMS_BY_NAME,
+		method.bare ? jsonrpc::JSON_STRING : jsonrpc::JSON_OBJECT, NULL);
+	for (unsigned int i = 0; i < method.param_count; i++) {
+		jsonrpc::jsontype_t type = jsonrpc::JSON_OBJECT;
+		switch (method.params[i].type) {
+		case BINRPC_INT:
+			type = jsonrpc::JSON_INTEGER;
+			break;
+		case BINRPC_BOOL:
+			type = jsonrpc::JSON_BOOLEAN;
+			break;
+		case BINRPC_STRING:
+			type = jsonrpc::JSON_STRING;
+			break;
+		case BINRPC_ARRAY:
+			type = jsonrpc::JSON_ARRAY;
+			break;
+		case BINRPC_OBJECT:
+			type = jsonrpc::JSON_OBJECT;
+			break;
+		}
+		procedure->AddParameter(method.params[i].name, type);
+	}
+	return procedure;
+}
@@ -0,0 +1,131 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BINRPC_H_
+#define _BINRPC_H_
+
+#include <jsonrpc/rpc.h>
+#include <stdexcept>
+#include <string>
+#include <stdint.h>
+
+
+/*
+	A compact alternative to JSON-RPC over HTTP for clients that poll often. Messages are frames of a 4 byte big
+	endian length followed by that many bytes, sent over TCP or a Unix socket. A connection starts with the client
+	sending BINRPC_MAGIC and the hash of the spec its stubs were generated from, which picks the API it talks to.
+	After that each request is a method id and the params, and each response a status and either the returned
+	fields or a failure message. Params and fields are in the order binrpcstub generates them, with no names.
+
+	Method ids are positions in the spec file, so methods should only be added at the end of a spec. A client
+	generated from an older spec is turned away by the hash rather than calling the wrong method.
+*/
+
+#define BINRPC_MAGIC 0x4C534252 // "LSBR"
+
+// Large enough for a tiled layer's worth of base64 PNGs.
+#define BINRPC_MAX_FRAME_SIZE (64*1024*1024)
+
+enum BinRpcType {
+	BINRPC_INT, // 4 bytes, signed.
+	BINRPC_BOOL, // 1 byte.
+	BINRPC_STRING, // 4 byte length then the bytes.
+	BINRPC_ARRAY, // Sent as a string of JSON text.
+	BINRPC_OBJECT // Sent as a string of JSON text.
+};
+
+enum BinRpcStatus {
+	BINRPC_OK, // The returned fields follow.
+	BINRPC_FAILED, // The call returned success false, the message follows.
+	BINRPC_ERROR // The request could not be handled, the message follows.
+};
+
+struct BinRpcField
+{
+	const char *name;
+	BinRpcType type;
+};
+
+struct BinRpcMethod
+{
+	const char *name;
+	const BinRpcField *params;
+	unsigned int param_count;
+	const BinRpcField *returns; // Fields of the result besides success and message.
+	unsigned int return_count;
+	bool bare; // Returns a plain string rather than an object with success and message.
+};
+
+
+/*
+	Declares method the way jsonrpcstub declares it for a JSON-RPC server, with its params by name. The caller owns
+	the procedure.
+*/
+jsonrpc::Procedure *binRpcProcedure(const BinRpcMethod &method);
+
+
+class BinRpcWriter
+{
+	public:
+		void putUint8(uint8_t val);
+		void putUint16(uint16_t val);
+		void putUint32(uint32_t val);
+		void putInt(int val);
+		void putBool(bool val);
+		void putString(const std::string &val);
+		void putJson(const Json::Value &val);
+		void putValue(BinRpcType type, const Json::Value &val);
+
+		const std::string &data() const;
+
+	private:
+		std::string buf;
+};
+
+
+/*
+	Reads back what a BinRpcWriter wrote. Reading past the end or a malformed value throws std::runtime_error.
+*/
+class BinRpcReader
+{
+	public:
+		BinRpcReader();
+		BinRpcReader(const std::string &data);
+
+		uint8_t getUint8() throw (std::runtime_error);
+		uint16_t getUint16() throw (std::runtime_error);
+		uint32_t getUint32() throw (std::runtime_error);
+		int getInt() throw (std::runtime_error);
+		bool getBool() throw (std::runtime_error);
+		std::string getString() throw (std::runtime_error);
+		Json::Value getJson() throw (std::runtime_error);
+		Json::Value getValue(BinRpcType type) throw (std::runtime_error);
+
+	private:
+		void need(size_t len) throw (std::runtime_error);
+
+		std::string buf;
+		size_t pos;
+};
+
+
+bool binRpcSendFrame(int fd, const std::string &payload);
+bool binRpcReceiveFrame(int fd, std::string &payload);
+
+#endif //_BINRPC_H_
@@ -0,0 +1,207 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "BinRpcClient.h"
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+
+BinRpcClient::BinRpcClient(const std::string &address, uint32_t spec_hash)
+{
+	this->address = address;
+	this->spec_hash = spec_hash;
+	fd = -1;
+}
+
+
+BinRpcClient::~BinRpcClient()
+{
+	disconnect();
+}
+
+
+void BinRpcClient::disconnect()
+{
+	call_mutex.lock();
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	call_mutex.unlock();
+}
+
+
+/*
+	Returns the returned fields of a successful call. A call that returns success false throws its message, the
+	same as the JSON clients' callers do with it.
+*/
+BinRpcReader BinRpcClient::call(uint16_t method, const BinRpcWriter &params) throw (std::runtime_error)
+{
+	std::lock_guard<std::mutex> lock(call_mutex);
+
+	BinRpcWriter request;
+	request.putUint16(method);
+	std::string payload = request.data() + params.data();
+	std::string response;
+
+	// A connection left open between calls may have been closed by the server since. That is checked before it
+	// is used, and one that breaks while the request is being written gets one more try on a new connection, as
+	// the server can't have run a call it didn't get all of. Once the request is out it is never sent again.
+	if (fd >= 0 && connectionClosed()) {
+		close(fd);
+		fd = -1;
+	}
+	for (int attempt = 0; ; attempt++) {
+		bool reused = fd >= 0;
+		if (!reused) {
+			connectToServer();
+		}
+		errno = 0;
+		if (!binRpcSendFrame(fd, payload)) {
+			bool stale = reused && attempt == 0 && (errno == EPIPE || errno == ECONNRESET);
+			std::string message = "Error talking to " + address + ": " + (errno ? strerror(errno) : "connection closed");
+			if (!stale) {
+				fail(message);
+			}
+			close(fd);
+			fd = -1;
+			continue;
+		}
+		errno = 0;
+		if (!binRpcReceiveFrame(fd, response)) {
+			fail("Error talking to " + address + ": " + (errno ? strerror(errno) : "connection closed"));
+		}
+		break;
+	}
+
+	BinRpcReader reader(response);
+	uint8_t status = reader.getUint8();
+	if (status != BINRPC_OK) {
+		throw std::runtime_error(reader.getString());
+	}
+	return reader;
+}
+
+
+void BinRpcClient::connectToServer() throw (std::runtime_error)
+{
+	if (!address.empty() && address[0] == '/') {
+		struct sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (address.size() >= sizeof(addr.sun_path)) {
+			throw std::runtime_error("Socket path too long: " + address);
+		}
+		strcpy(addr.sun_path, address.c_str());
+
+		fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+			fail("Error connecting to " + address + ": " + strerror(errno));
+		}
+	} else {
+		size_t colon = address.rfind(':');
+		if (colon == std::string::npos) {
+			throw std::runtime_error("Address must be host:port or a socket path: " + address);
+		}
+		std::string host = address.substr(0, colon);
+		std::string port = address.substr(colon + 1);
+
+		struct addrinfo hints;
+		memset(&hints, 0, sizeof(hints));
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		struct addrinfo *addrs;
+		int ret = getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs);
+		if (ret != 0) {
+			throw std::runtime_error("Error resolving " + host + ": " + gai_strerror(ret));
+		}
+		for (struct addrinfo *addr = addrs; addr; addr = addr->ai_next) {
+			fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+			if (fd >= 0 && connect(fd, addr->ai_addr, addr->ai_addrlen) == 0) {
+				break;
+			}
+			if (fd >= 0) {
+				close(fd);
+				fd = -1;
+			}
+		}
+		freeaddrinfo(addrs);
+		if (fd < 0) {
+			fail("Error connecting to " + address + ": " + strerror(errno));
+		}
+
+		int nodelay = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+	}
+
+	BinRpcWriter hello;
+	hello.putUint32(BINRPC_MAGIC);
+	hello.putUint32(spec_hash);
+	std::string response;
+	errno = 0;
+	if (!binRpcSendFrame(fd, hello.data()) || !binRpcReceiveFrame(fd, response)) {
+		fail("Error talking to " + address + ": " + (errno ? strerror(errno) : "connection closed"));
+	}
+
+	std::string message;
+	try {
+		BinRpcReader reader(response);
+		if (reader.getUint8() == BINRPC_OK) {
+			return;
+		}
+		message = reader.getString();
+	} catch (std::runtime_error e) {
+		message = e.what();
+	}
+	fail(address + " refused the connection: " + message);
+}
+
+
+/*
+	True if the server has closed the idle connection, or sent something on it nobody asked for.
+*/
+bool BinRpcClient::connectionClosed()
+{
+	struct pollfd pfd;
+	pfd.fd = fd;
+	pfd.events = POLLIN | POLLRDHUP;
+	pfd.revents = 0;
+	return poll(&pfd, 1, 0) != 0;
+}
+
+
+/*
+	Drops the connection, the next call makes a new one.
+*/
+void BinRpcClient::fail(const std::string &message) throw (std::runtime_error)
+{
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+	throw std::runtime_error(message);
+}
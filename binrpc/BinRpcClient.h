@@ -0,0 +1,59 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _BINRPCCLIENT_H_
+#define _BINRPCCLIENT_H_
+
+#include <mutex>
+#include <string>
+#include <stdexcept>
+#include <stdint.h>
+
+#include "BinRpc.h"
+
+
+/*
+	The connection the generated binary RPC clients are built on. address is host:port for TCP or a path for a Unix
+	socket. The connection is made on the first call and made again if it fails, so a client outlives restarts of
+	the server. Calls are made one at a time, a client can be shared between threads but they will wait on each other.
+*/
+class BinRpcClient
+{
+	public:
+		BinRpcClient(const std::string &address, uint32_t spec_hash);
+		virtual ~BinRpcClient();
+
+		void disconnect();
+
+	protected:
+		BinRpcReader call(uint16_t method, const BinRpcWriter &params) throw (std::runtime_error);
+
+	private:
+		void connectToServer() throw (std::runtime_error);
+		bool connectionClosed();
+		void fail(const std::string &message) throw (std::runtime_error);
+
+		std::string address;
+		uint32_t spec_hash;
+
+		std::mutex call_mutex;
+		int fd;
+};
+
+#endif //_BINRPCCLIENT_H_
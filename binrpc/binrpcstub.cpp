@@ -0,0 +1,501 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+	Generates the binary RPC method table and client for a JSON-RPC spec, the counterpart of jsonrpcstub.
+	binrpcstub SPEC NAME OUTDIR writes OUTDIR/<name>methods.h and OUTDIR/<name>client.h, name being NAME in lower
+	case. Notifications are left out, they are only served over JSON-RPC.
+	binrpcstub --batch SPEC NAME OUTDIR instead writes OUTDIR/<name>batch.h, a typed builder for executeBatch calls.
+*/
+
+#include <jsonrpc/rpc.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cctype>
+#include <cstdio>
+#include <stdint.h>
+
+using namespace std;
+
+
+struct Field
+{
+	string name;
+	string type; // A BinRpcType.
+};
+
+struct Method
+{
+	string name;
+	vector<Field> params;
+	vector<Field> returns;
+	bool bare;
+	vector<string> declared; // Param names in the order the spec declares them.
+};
+
+
+bool fieldType(const Json::Value &example, string &type)
+{
+	if (example.isBool()) {
+		type = "BINRPC_BOOL";
+	} else if (example.isIntegral()) {
+		type = "BINRPC_INT";
+	} else if (example.isString()) {
+		type = "BINRPC_STRING";
+	} else if (example.isArray()) {
+		type = "BINRPC_ARRAY";
+	} else if (example.isObject()) {
+		type = "BINRPC_OBJECT";
+	} else {
+		return false;
+	}
+	return true;
+}
+
+
+bool readFields(const Json::Value &obj, bool skip_status, vector<Field> &fields, const string &method)
+{
+	// Json::Value sorts members by name, the same order jsonrpcstub puts params in.
+	vector<string> names = obj.getMemberNames();
+	for (unsigned int i = 0; i < names.size(); i++) {
+		if (skip_status && (names[i] == "success" || names[i] == "message")) {
+			continue;
+		}
+		Field field;
+		field.name = names[i];
+		if (!fieldType(obj[names[i]], field.type)) {
+			cerr << method << ": unsupported type for " << names[i] << endl;
+			return false;
+		}
+		fields.push_back(field);
+	}
+	return true;
+}
+
+
+/*
+	Json::Value keeps members sorted by name, so the order each method's params are declared in is read from the
+	spec's text. declared gets an entry for each object in the spec.
+*/
+void readDeclaredParams(const string &text, vector<vector<string> > &declared)
+{
+	int depth = 0;
+	bool in_params = false;
+	string key;
+
+	for (size_t i = 0; i < text.size(); i++) {
+		char c = text[i];
+		if (c == '/' && i + 1 < text.size() && text[i + 1] == '/') {
+			i = text.find('\n', i);
+			if (i == string::npos) {
+				break;
+			}
+		} else if (c == '/' && i + 1 < text.size() && text[i + 1] == '*') {
+			i = text.find("*/", i + 2);
+			if (i == string::npos) {
+				break;
+			}
+			i++;
+		} else if (c == '"') {
+			string str;
+			for (i++; i < text.size() && text[i] != '"'; i++) {
+				if (text[i] == '\\') {
+					i++;
+				}
+				str += text[i];
+			}
+			size_t next = text.find_first_not_of(" \t\r\n", i + 1);
+			if (next == string::npos || text[next] != ':') {
+				continue;
+			}
+			if (depth == 2) {
+				key = str;
+			} else if (depth == 3 && in_params) {
+				declared.back().push_back(str);
+			}
+		} else if (c == '{' || c == '[') {
+			depth++;
+			if (depth == 2) {
+				declared.push_back(vector<string>());
+			} else if (depth == 3 && c == '{' && key == "params") {
+				in_params = true;
+			}
+		} else if (c == '}' || c == ']') {
+			if (depth == 3) {
+				in_params = false;
+			}
+			depth--;
+		}
+	}
+}
+
+
+bool readSpec(const char *path, vector<Method> &methods)
+{
+	ifstream file(path);
+	ostringstream text;
+	text << file.rdbuf();
+	Json::Reader reader;
+	Json::Value spec;
+	if (!file || !reader.parse(text.str(), spec) || !spec.isArray()) {
+		cerr << "Could not read spec " << path << endl;
+		return false;
+	}
+
+	vector<vector<string> > declared;
+	readDeclaredParams(text.str(), declared);
+
+	for (unsigned int i = 0; i < spec.size(); i++) {
+		if (!spec[i]["method"].isString()) {
+			continue;
+		}
+		Method method;
+		method.name = spec[i]["method"].asString();
+		method.bare = spec[i]["returns"].isString();
+		if (!readFields(spec[i]["params"], false, method.params, method.name)) {
+			return false;
+		}
+		if (i < declared.size() && declared[i].size() == method.params.size()) {
+			method.declared = declared[i];
+		} else {
+			for (unsigned int j = 0; j < method.params.size(); j++) {
+				method.declared.push_back(method.params[j].name);
+			}
+		}
+		if (method.bare) {
+			Field field;
+			field.name = "value";
+			field.type = "BINRPC_STRING";
+			method.returns.push_back(field);
+		} else if (!readFields(spec[i]["returns"], true, method.returns, method.name)) {
+			return false;
+		}
+		methods.push_back(method);
+	}
+
+	return true;
+}
+
+
+/*
+	FNV-1a over every method's name, params and returns, so clients and servers built from different specs don't
+	talk.
+*/
+uint32_t specHash(const vector<Method> &methods)
+{
+	ostringstream oss;
+	for (unsigned int i = 0; i < methods.size(); i++) {
+		oss << methods[i].name << (methods[i].bare ? "!" : "") << "(";
+		for (unsigned int j = 0; j < methods[i].params.size(); j++) {
+			oss << methods[i].params[j].name << ":" << methods[i].params[j].type << ",";
+		}
+		oss << ")";
+		for (unsigned int j = 0; j < methods[i].returns.size(); j++) {
+			oss << methods[i].returns[j].name << ":" << methods[i].returns[j].type << ",";
+		}
+		oss << ";";
+	}
+
+	string text = oss.str();
+	uint32_t hash = 2166136261u;
+	for (unsigned int i = 0; i < text.size(); i++) {
+		hash ^= (uint8_t)text[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+
+string cppType(const string &type)
+{
+	if (type == "BINRPC_INT") {
+		return "int";
+	} else if (type == "BINRPC_BOOL") {
+		return "bool";
+	} else if (type == "BINRPC_STRING") {
+		return "std::string";
+	}
+	return "Json::Value";
+}
+
+
+string getter(const string &type)
+{
+	if (type == "BINRPC_INT") {
+		return "getInt()";
+	} else if (type == "BINRPC_BOOL") {
+		return "getBool()";
+	} else if (type == "BINRPC_STRING") {
+		return "getString()";
+	}
+	return "getJson()";
+}
+
+
+string upper(const string &text)
+{
+	string res = text;
+	for (unsigned int i = 0; i < res.size(); i++) {
+		res[i] = toupper(res[i]);
+	}
+	return res;
+}
+
+
+string lower(const string &text)
+{
+	string res = text;
+	for (unsigned int i = 0; i < res.size(); i++) {
+		res[i] = tolower(res[i]);
+	}
+	return res;
+}
+
+
+void writeFields(ostream &out, const string &array, const vector<Field> &fields)
+{
+	if (fields.empty()) {
+		return;
+	}
+	out << "static const BinRpcField " << array << "[] = {";
+	for (unsigned int i = 0; i < fields.size(); i++) {
+		out << (i ? ", " : "") << "{\"" << fields[i].name << "\", " << fields[i].type << "}";
+	}
+	out << "};" << endl;
+}
+
+
+void writeMethods(ostream &out, const string &spec, const string &name, const vector<Method> &methods)
+{
+	string guard = "_" + upper(name) + "METHODS_H_";
+	char hash[16];
+	snprintf(hash, sizeof(hash), "0x%08x", specHash(methods));
+
+	out << "/**" << endl;
+	out << " * THIS FILE IS GENERATED BY binrpcstub FROM " << spec << ", DO NOT CHANGE IT!!!!!" << endl;
+	out << " */" << endl << endl;
+	out << "#ifndef " << guard << endl;
+	out << "#define " << guard << endl << endl;
+	out << "#include \"BinRpc.h\"" << endl << endl;
+	out << "#define " << upper(name) << "_SPEC_HASH " << hash << "u" << endl << endl;
+
+	for (unsigned int i = 0; i < methods.size(); i++) {
+		writeFields(out, name + "_" + methods[i].name + "_params", methods[i].params);
+		writeFields(out, name + "_" + methods[i].name + "_returns", methods[i].returns);
+	}
+	out << endl;
+
+	out << "// Indexed by method id." << endl;
+	out << "static const BinRpcMethod " << name << "Methods[] = {" << endl;
+	for (unsigned int i = 0; i < methods.size(); i++) {
+		const Method &method = methods[i];
+		out << "    {\"" << method.name << "\", ";
+		out << (method.params.empty() ? "NULL" : name + "_" + method.name + "_params") << ", " << method.params.size() << ", ";
+		out << (method.returns.empty() ? "NULL" : name + "_" + method.name + "_returns") << ", " << method.returns.size() << ", ";
+		out << (method.bare ? "true" : "false") << "}" << (i + 1 < methods.size() ? "," : "") << endl;
+	}
+	out << "};" << endl << endl;
+	out << "#define " << upper(name) << "_METHOD_COUNT " << methods.size() << endl << endl;
+	out << "#endif //" << guard << endl;
+}
+
+
+void writeClient(ostream &out, const string &spec, const string &name, const vector<Method> &methods)
+{
+	string guard = "_" + upper(name) + "CLIENT_H_";
+
+	out << "/**" << endl;
+	out << " * THIS FILE IS GENERATED BY binrpcstub FROM " << spec << ", DO NOT CHANGE IT!!!!!" << endl;
+	out << " */" << endl << endl;
+	out << "#ifndef " << guard << endl;
+	out << "#define " << guard << endl << endl;
+	out << "#include \"BinRpcClient.h\"" << endl;
+	out << "#include \"" << lower(name) << "methods.h\"" << endl << endl;
+	out << "class " << name << "Client : public BinRpcClient" << endl;
+	out << "{" << endl;
+	out << "    public:" << endl;
+	out << "        " << name << "Client(const std::string &address) :" << endl;
+	out << "            BinRpcClient(address, " << upper(name) << "_SPEC_HASH)" << endl;
+	out << "        {" << endl;
+	out << "        }" << endl;
+
+	for (unsigned int i = 0; i < methods.size(); i++) {
+		const Method &method = methods[i];
+		string ret;
+		if (method.returns.empty()) {
+			ret = "void";
+		} else if (method.returns.size() == 1 && method.returns[0].name == "value") {
+			ret = cppType(method.returns[0].type);
+		} else {
+			ret = "Json::Value";
+		}
+
+		out << endl << "        " << ret << " " << method.name << "(";
+		for (unsigned int j = 0; j < method.params.size(); j++) {
+			out << (j ? ", " : "") << "const " << cppType(method.params[j].type) << "& " << method.params[j].name;
+		}
+		out << ") throw (std::runtime_error)" << endl;
+		out << "        {" << endl;
+		out << "            BinRpcWriter p;" << endl;
+		for (unsigned int j = 0; j < method.params.size(); j++) {
+			string type = method.params[j].type;
+			string put = type == "BINRPC_INT" ? "putInt" : type == "BINRPC_BOOL" ? "putBool" :
+				type == "BINRPC_STRING" ? "putString" : "putJson";
+			out << "            p." << put << "(" << method.params[j].name << ");" << endl;
+		}
+		if (ret == "void") {
+			out << "            this->call(" << i << ", p);" << endl;
+		} else if (ret != "Json::Value" || method.returns[0].name == "value") {
+			out << "            return this->call(" << i << ", p)." << getter(method.returns[0].type) << ";" << endl;
+		} else {
+			out << "            BinRpcReader r = this->call(" << i << ", p);" << endl;
+			out << "            Json::Value result;" << endl;
+			for (unsigned int j = 0; j < method.returns.size(); j++) {
+				out << "            result[\"" << method.returns[j].name << "\"] = r." << getter(method.returns[j].type) << ";" << endl;
+			}
+			out << "            return result;" << endl;
+		}
+		out << "        }" << endl;
+	}
+
+	out << "};" << endl << endl;
+	out << "#endif //" << guard << endl;
+}
+
+
+/*
+	Every method but executeBatch itself, with its params in the order the spec declares them. The server still
+	decides which methods it batches, it turns the waits away.
+*/
+void writeBatch(ostream &out, const string &spec, const string &name, const vector<Method> &methods)
+{
+	string guard = "_" + upper(name) + "BATCH_H_";
+
+	out << "/**" << endl;
+	out << " * THIS FILE IS GENERATED BY binrpcstub FROM " << spec << ", DO NOT CHANGE IT!!!!!" << endl;
+	out << " */" << endl << endl;
+	out << "#ifndef " << guard << endl;
+	out << "#define " << guard << endl << endl;
+	out << "#include <jsonrpc/rpc.h>" << endl << endl;
+	out << "class " << name << "Batch" << endl;
+	out << "{" << endl;
+	out << "    public:" << endl;
+	out << "        " << name << "Batch() :" << endl;
+	out << "            list(Json::arrayValue)" << endl;
+	out << "        {" << endl;
+	out << "        }" << endl << endl;
+	out << "        // What to pass to executeBatch." << endl;
+	out << "        const Json::Value& calls() const" << endl;
+	out << "        {" << endl;
+	out << "            return this->list;" << endl;
+	out << "        }" << endl << endl;
+	out << "        void clear()" << endl;
+	out << "        {" << endl;
+	out << "            this->list = Json::Value(Json::arrayValue);" << endl;
+	out << "        }" << endl;
+
+	for (unsigned int i = 0; i < methods.size(); i++) {
+		const Method &method = methods[i];
+		if (method.name == "executeBatch") {
+			continue;
+		}
+
+		out << endl << "        void " << method.name << "(";
+		for (unsigned int j = 0; j < method.declared.size(); j++) {
+			string type;
+			for (unsigned int k = 0; k < method.params.size(); k++) {
+				if (method.params[k].name == method.declared[j]) {
+					type = method.params[k].type;
+				}
+			}
+			out << (j ? ", " : "") << "const " << cppType(type) << "& " << method.declared[j];
+		}
+		out << ")" << endl;
+		out << "        {" << endl;
+		out << "            Json::Value p(Json::objectValue);" << endl;
+		for (unsigned int j = 0; j < method.params.size(); j++) {
+			out << "            p[\"" << method.params[j].name << "\"] = " << method.params[j].name << ";" << endl;
+		}
+		out << "            this->add(\"" << method.name << "\", p);" << endl;
+		out << "        }" << endl;
+	}
+
+	out << endl << "    private:" << endl;
+	out << "        Json::Value list;" << endl << endl;
+	out << "        void add(const char *method, const Json::Value& params)" << endl;
+	out << "        {" << endl;
+	out << "            Json::Value call;" << endl;
+	out << "            call[\"method\"] = method;" << endl;
+	out << "            call[\"params\"] = params;" << endl;
+	out << "            this->list.append(call);" << endl;
+	out << "        }" << endl;
+	out << "};" << endl << endl;
+	out << "#endif //" << guard << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+	bool batch = argc == 5 && string(argv[1]) == "--batch";
+	if (argc != 4 && !batch) {
+		cout << "Usage: " << argv[0] << " [--batch] SPEC NAME OUTDIR" << endl;
+		return 1;
+	}
+
+	string spec = argv[argc - 3];
+	string name = argv[argc - 2];
+	string dir = argv[argc - 1];
+	vector<Method> methods;
+	if (!readSpec(spec.c_str(), methods)) {
+		return 1;
+	}
+
+	string base = spec.substr(spec.rfind('/') == string::npos ? 0 : spec.rfind('/') + 1);
+
+	if (batch) {
+		string batch_path = dir + "/" + lower(name) + "batch.h";
+		ofstream batch_file(batch_path.c_str());
+		writeBatch(batch_file, base, name, methods);
+		batch_file.close();
+		if (batch_file.fail()) {
+			cerr << "Error writing " << batch_path << endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	string methods_path = dir + "/" + lower(name) + "methods.h";
+	string client_path = dir + "/" + lower(name) + "client.h";
+
+	ofstream methods_file(methods_path.c_str());
+	writeMethods(methods_file, base, name, methods);
+	ofstream client_file(client_path.c_str());
+	writeClient(client_file, base, name, methods);
+	methods_file.close();
+	client_file.close();
+	if (methods_file.fail() || client_file.fail()) {
+		cerr << "Error writing " << methods_path << " or " << client_path << endl;
+		return 1;
+	}
+
+	return 0;
+}
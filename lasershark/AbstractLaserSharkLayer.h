@@ -32,6 +32,8 @@ class AbstractLaserSharkLayer
 			const unsigned char* png_image_data, unsigned int png_image_data_len) = 0;
 		virtual void clear() = 0;
 		virtual bool populated() = 0;
+		// Goes back to the first sample, so the layer can be streamed again or resumed part way through.
+		virtual void rewind() = 0;
 
 		virtual unsigned int fillLaserSharkTransferBuffer(unsigned int sample_count, 
 			unsigned char *buf) = 0;
@@ -39,6 +41,8 @@ class AbstractLaserSharkLayer
 		virtual unsigned int getTotalSamples() = 0;
 		virtual unsigned int getWidth() = 0;
 		virtual unsigned int getHeight() = 0;
+		// Time the last populate spent decompressing png data.
+		virtual unsigned int getInflateUs() = 0;
 };
 
 inline AbstractLaserSharkLayer::~AbstractLaserSharkLayer() { }
@@ -22,13 +22,17 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <sstream>
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <algorithm>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <errno.h>
 #include <libusb-1.0/libusb.h>
+#include "metrics/Trace.h"
 #include "debug.h"
 
-#define LASERSHARK_VIN 0x1fc9
-#define LASERSHARK_PID 0x04d8
-
 #define LASERSHARK_CMD_SUCCESS 0x00
 #define LASERSHARK_CMD_FAIL 0x01
 #define LASERSHARK_CMD_UNKNOWN 0xFF
@@ -68,24 +72,81 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 // Clears ringbuffer
 #define LASERSHARK_CMD_CLEAR_RINGBUFFER 0x8D
 
+// Set on push threads, so the commands they send to keep a layer streaming are given the bus first.
+static thread_local bool on_push_thread = false;
+
+// The push thread's libusb transfer, reused for everything it sends so streaming doesn't allocate.
+static thread_local struct libusb_transfer *push_transfer = NULL;
+
+// How often the push thread asks how much of the ringbuffer is still queued, to checkpoint how far the layer
+// has been drawn. If the device can't be asked once a layer fails, this many transfers' worth of samples, 512,
+// may be drawn again by resumeLayer. Each checkpoint costs two control transfers.
+#define LASERSHARK_CHECKPOINT_INTERVAL_TRANSFERS 8
+
+// How many transfers the lasershark_stream_bytes_per_second gauge is averaged over.
+#define LASERSHARK_RATE_WINDOW_TRANSFERS 64
+
+// Control exchanges are answered right away by the firmware, so this only trips on a stalled device.
+#define LASERSHARK_CMD_TIMEOUT_MS 500
+
+// Added to how long the device takes to make room for a transfer or draw the ringbuffer at the sample rate.
+#define LASERSHARK_TRANSFER_TIMEOUT_SLACK_MS 100
+
+// Stack touched by the push thread up front so it doesn't page fault mid layer.
+#define LASERSHARK_PUSH_THREAD_PREFAULT_STACK_SIZE (64*1024)
+
 
-LaserShark::LaserShark()
+LaserShark::LaserShark(LaserSharkUsbSession *usb)
 {
-	devh_ctl = NULL;
-	devh_data = NULL;
-	devh_ctl_claimed = false;
-	devh_data_claimed = false;
+	this->usb = usb;
+	usb_open = false;
 	thread_should_run = false;
 	thread_running = false;
 	push_thread = NULL;
+	push_thread_should_exit = false;
+	layer_start_pending = false;
 	layer = NULL;
+	next_layer = NULL;
+	layer_resumable = false;
+	layer_resume_from = 0;
+	layer_checkpoint = 0;
+	push_rt_priority = 0;
+	push_cpu = -1;
+	// Read before the push thread can pin itself, since threads inherit the affinity of the one that made them.
+	if (sched_getaffinity(0, sizeof(process_cpus), &process_cpus) != 0) {
+		CPU_ZERO(&process_cpus);
+		for (int i = 0; i < CPU_SETSIZE; i++) {
+			CPU_SET(i, &process_cpus);
+		}
+	}
+	push_scheduling_changed = true;
+	push_realtime = false;
+	resetPushStats();
+	layer_count = 0;
+	sample_rate = LASERSHARK_DEFAULT_SAMPLE_RATE;
+	hotplug_listener_id = usb->addHotplugListener(std::bind(&LaserShark::usbHotplug, this, std::placeholders::_1));
+
+	MetricsRegistry &metrics = MetricsRegistry::instance();
+	metric_samples_streamed = metrics.counter("lasershark_samples_streamed_total", "Samples sent to the LaserShark.");
+	metric_bytes_streamed = metrics.counter("lasershark_bytes_streamed_total", "Sample bytes sent to the LaserShark.");
+	metric_stream_bytes_per_second = metrics.gauge("lasershark_stream_bytes_per_second",
+		"Sample throughput over the last checkpoint interval of the running layer.");
+	metric_transfer_seconds = metrics.histogram("lasershark_transfer_seconds", "Time taken by each sample transfer.",
+		MetricsRegistry::exponentialBuckets(0.0001, 2, 14));
+	metric_ringbuffer_fill = metrics.histogram("lasershark_ringbuffer_fill_ratio",
+		"How full the device ringbuffer was each time the push thread polled it.", MetricsRegistry::linearBuckets(0.1, 0.1, 10));
+	metric_drain_seconds = metrics.histogram("lasershark_drain_seconds",
+		"Time from the last sample being sent to the ringbuffer being drawn empty.", MetricsRegistry::exponentialBuckets(0.001, 2, 14));
 }
 
 LaserShark::~LaserShark()
 {
+	usb->removeHotplugListener(hotplug_listener_id);
 	if (connected()) {
 		disconnect();
 	}
+	cleanupPushThread();
+	cleanupLayer();
 }
 
 /*
@@ -95,7 +156,6 @@ LaserShark::~LaserShark()
 */
 bool LaserShark::connect() throw (std::runtime_error)
 {
-	int rc;
 	int major_version;
 	int minor_version;
 
@@ -107,59 +167,17 @@ bool LaserShark::connect() throw (std::runtime_error)
 	}
 
 
-    devh_ctl = libusb_open_device_with_vid_pid(NULL, LASERSHARK_VIN, LASERSHARK_PID);
-    devh_data = libusb_open_device_with_vid_pid(NULL, LASERSHARK_VIN, LASERSHARK_PID);
-    if (!devh_ctl || !devh_data)
-    {
-		// No device
-		shutdown();
-		cmd_mutex.unlock();
-
-		return false;
-    }
-
-
-    libusb_set_debug(NULL, 3);
-
-    rc = libusb_claim_interface(devh_ctl, 0);
-    if (rc < 0)
-    {
-		shutdown();
-		cmd_mutex.unlock();
-
-		std::ostringstream oss;
-		oss << "Error claiming control interface: " << libusb_error_name(rc);
-    	throw std::runtime_error(oss.str()); 
-    }
-	devh_ctl_claimed = true;
-
-
-    rc = libusb_claim_interface(devh_data, 1);
-    if (rc < 0)
-    {
-		release();
-		shutdown();
-		cmd_mutex.unlock();
-
-		std::ostringstream oss;
-		oss << "Error claiming data interface: " << libusb_error_name(rc);
-    	throw std::runtime_error(oss.str());
-    }
-	devh_data_claimed = true;
-
-
-    // Use the following if you want to use BULK transfers instead of ISO transfers in your hostapp code.
-    rc = libusb_set_interface_alt_setting(devh_data, 1, 1);
-    if (rc < 0)
-    {
-		release();
-		shutdown();
+	try {
+		if (!usb->open()) {
+			// No device
+			cmd_mutex.unlock();
+			return false;
+		}
+	} catch (std::runtime_error e) {
 		cmd_mutex.unlock();
-
-		std::ostringstream oss;
-		oss << "Error setting alternative (BULK) data interface: " << libusb_error_name(rc);
-    	throw std::runtime_error(oss.str()); 
-    }
+		throw;
+	}
+	usb_open = true;
 
     cmd_mutex.unlock();
 
@@ -197,7 +215,7 @@ bool LaserShark::connect() throw (std::runtime_error)
 
 bool LaserShark::connected()
 {
-	return devh_ctl_claimed;
+	return usb_open;
 }
 
 
@@ -205,8 +223,10 @@ void LaserShark::disconnect()
 {
 	stopAndClearLayer();
 	cmd_mutex.lock();
-	release();
-	shutdown();
+	if (usb_open) {
+		usb_open = false;
+		usb->close();
+	}
 	cmd_mutex.unlock();
 
 }
@@ -218,7 +238,12 @@ void LaserShark::disconnect()
 
 bool LaserShark::setSampleRate(unsigned int rate) throw (std::runtime_error)
 {
-	return setUint32(LASERSHARK_CMD_SET_ILDA_RATE, rate);
+	bool res = setUint32(LASERSHARK_CMD_SET_ILDA_RATE, rate);
+	if (res) {
+		// Restored if the device is reattached.
+		sample_rate = rate;
+	}
+	return res;
 }
 
 
@@ -266,9 +291,14 @@ int LaserShark::getFWMinorVersion() throw (std::runtime_error)
 
 /*
 	Returns true if layer was set. Returns false if layer could not be set because passed in layer
-	was null or because layer is currently running.
+	was null or because another layer is already waiting to run. timings carries how long the layer took to
+	prepare, see getLayerTimings.
+	A layer set while one is running waits and takes its place once that one is done, so it can be prepared while
+	the other is drawn. It still has to be started. If the running layer fails it is kept for resumeLayer and the
+	waiting layer only takes over once it is resumed and done. Setting a layer while none is running replaces both.
+	The layer is owned by the LaserShark once set.
 */
-bool LaserShark::setLayer(AbstractLaserSharkLayer *layer)
+bool LaserShark::setLayer(AbstractLaserSharkLayer *layer, const LaserSharkLayerTimings &timings)
 {
 	bool res = false;
 
@@ -278,7 +308,18 @@ bool LaserShark::setLayer(AbstractLaserSharkLayer *layer)
 		if (this->layer) {
 			delete this->layer;
 		}
+		delete next_layer;
+		next_layer = NULL;
 		this->layer = layer;
+		layer_resumable = false;
+		layer_timings = timings;
+		layer_timings.layer = ++layer_count;
+		layer_set_time = std::chrono::steady_clock::now();
+		res = true;
+	} else if (layer && !next_layer) {
+		next_layer = layer;
+		next_layer_timings = timings;
+		next_layer_timings.layer = ++layer_count;
 		res = true;
 	}
 	layer_mutex.unlock();
@@ -289,30 +330,81 @@ bool LaserShark::setLayer(AbstractLaserSharkLayer *layer)
 
 
 /*
-	If a layer thread is not running and a layer is defined, a new thread is started and true is returned.
-	false is returned otherwise.
+	If a layer is not running, a layer is defined and the device is attached, the push thread is told to start it
+	and true is returned. false is returned otherwise. The push thread is started with the first layer and then
+	kept for later ones. A layer that failed part way is started over, use resumeLayer to carry on from where it
+	failed instead.
+	If start_gate is given the layer is prepared right away but only drawn once the gate opens, see
+	LaserSharkStartGate. The layer counts as running while it waits.
+*/
+
+bool LaserShark::startLayer(const LaserSharkStartGate &start_gate) throw (std::runtime_error)
+{
+	return beginLayer(start_gate, false);
+}
+
+
+/*
+	Carries on with a layer that failed part way, from the last sample known to have been drawn (see
+	getLayerCheckpoint) and with the layer's original origin. If the checkpoint couldn't be made exact, up to 512
+	samples drawn before the failure are drawn again. The device handle is reopened first in case the failure left
+	it in a bad state. Returns false if there is no failed layer or the device couldn't be reopened.
 */
+bool LaserShark::resumeLayer() throw (std::runtime_error)
+{
+	push_thread_mutex.lock();
+	bool resumable = layer_resumable && !layerRunning();
+	push_thread_mutex.unlock();
+
+	if (!resumable || !usb->reopen()) {
+		return false;
+	}
+
+	return beginLayer(LaserSharkStartGate(), true);
+}
+
 
-bool LaserShark::startLayer() throw (std::runtime_error)
+/*
+	Returns how many samples of the current or last layer are known to have been drawn. Every sample sent counts,
+	where a zig zag or tiled layer's getTotalSamples and getSamplesLeft leave out blank pixels and scan ramps.
+	It is updated every LASERSHARK_CHECKPOINT_INTERVAL_TRANSFERS transfers as the layer streams, and made exact
+	once the output is stopped if the layer fails. If the device can't be asked then, as when it was unplugged, it
+	can be up to 512 samples short of what was drawn.
+*/
+unsigned int LaserShark::getLayerCheckpoint()
+{
+	return layer_checkpoint;
+}
+
+
+bool LaserShark::beginLayer(const LaserSharkStartGate &start_gate, bool resume) throw (std::runtime_error)
 {
 	bool res = false;
 
 	push_thread_mutex.lock();
-	if (!layerRunning()) {
-		cleanupPushThread();
-		if (layer) {
-			thread_should_run = true;
-			thread_running = true;	
-			push_thread = new std::thread(&LaserShark::pushLayerThread, this); 	
-			if (!push_thread) { // This should throw something
+	if (!layerRunning() && layer && usb->isAttached() && (!resume || layer_resumable)) {
+		if (!push_thread) {
+			push_thread_should_exit = false;
+			try {
+				push_thread = new std::thread(&LaserShark::pushLayerThread, this);
+			} catch (std::system_error e) {
 				push_thread_mutex.unlock();
 				std::ostringstream oss;
-				oss << "Error allocating thread.";
+				oss << "Error allocating thread: " << e.what();
     			throw std::runtime_error(oss.str()); 
-			}				
-			res = true;
-		}	
-	}		
+			}
+		}
+		layer_error_message.clear();
+		thread_should_run = true;
+		thread_running = true;
+		layer_start_pending = true;
+		layer_start_gate = start_gate;
+		layer_resume_from = resume ? (unsigned int)layer_checkpoint : 0;
+		layer_resumable = false;
+		layer_timings.resumed = resume;
+		push_thread_cv.notify_all();
+		res = true;
+	}
 	push_thread_mutex.unlock();
 
 	return res;
@@ -320,14 +412,20 @@ bool LaserShark::startLayer() throw (std::runtime_error)
 
 
 /*
-	Stops the thread if running, then deletes it and the layer.
+	Stops the layer if running and waits for the push thread to finish with it, then deletes the layer and any
+	layer waiting to run after it.
 */
 void LaserShark::stopAndClearLayer()
 {
-	push_thread_mutex.lock();
-	cleanupPushThread();
+	std::unique_lock<std::mutex> lock(push_thread_mutex);
+	thread_should_run = false;
+	while (thread_running) {
+		push_thread_done_cv.wait(lock);
+	}
+	layer_error_message.clear();
+	layer_resumable = false;
 	layer_mutex.lock();
-	push_thread_mutex.unlock();
+	lock.unlock();
 	cleanupLayer();
 	layer_mutex.unlock();
 }
@@ -367,6 +465,21 @@ bool LaserShark::layerDone()
 	return !layerRunning();
 }
 
+/*
+	Blocks until no layer is running or timeout_ms passes. Returns true if no layer is running.
+*/
+bool LaserShark::waitForLayerDone(unsigned int timeout_ms)
+{
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+	std::unique_lock<std::mutex> lock(push_thread_mutex);
+	while (thread_running) {
+		if (push_thread_done_cv.wait_until(lock, deadline) == std::cv_status::timeout) {
+			break;
+		}
+	}
+	return !thread_running;
+}
+
 std::string LaserShark::getLayerErrorMessage()
 {
 	push_thread_mutex.lock();
@@ -376,44 +489,84 @@ std::string LaserShark::getLayerErrorMessage()
 }
 
 
-void LaserShark::release()
+/*
+	Sets how the push thread is scheduled, starting with the next layer. An rt_priority above 0 runs it
+	with SCHED_FIFO at that priority, a cpu of 0 or more pins it to that cpu. lock_memory locks all current and
+	future process memory with mlockall so the thread doesn't stall on page faults.
+	Returns false if memory could not be locked. Failing to apply the priority or the affinity is reported when
+	the thread starts, see getPushStats.
+*/
+bool LaserShark::setPushThreadScheduling(int rt_priority, int cpu, bool lock_memory)
 {
-	if (devh_ctl_claimed) {
-		devh_ctl_claimed = false;
-    	libusb_release_interface(devh_ctl, 0);
-	}
-	if (devh_ctl_claimed) {
-		devh_data_claimed = false; 
- 		libusb_release_interface(devh_data, 0);
+	push_thread_mutex.lock();
+	push_rt_priority = rt_priority;
+	push_cpu = cpu;
+	push_scheduling_changed = true;
+	push_thread_mutex.unlock();
+
+	if (lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		std::cerr << "Could not lock memory: " << strerror(errno) << std::endl;
+		return false;
 	}
+
+	return true;
 }
 
 
-void LaserShark::shutdown()
+/*
+	Returns the push thread statistics for the current or last layer.
+*/
+LaserSharkPushStats LaserShark::getPushStats()
 {
-    if (devh_ctl)
-    {
-        libusb_close(devh_ctl);
-		devh_ctl = NULL;
-    }
-    if (devh_data)
-    {
-        libusb_close(devh_data);
-		devh_data = NULL;
-    }
+	LaserSharkPushStats stats;
+	stats.realtime = push_realtime;
+	stats.transfers = push_transfers;
+	stats.max_gap_us = push_max_gap_us;
+	stats.avg_gap_us = stats.transfers > 1 ? push_total_gap_us/(stats.transfers - 1) : 0;
+	return stats;
 }
 
 
+/*
+	Returns the timings of the last layer to finish, its layer field is 0 if none has.
+*/
+LaserSharkLayerTimings LaserShark::getLayerTimings()
+{
+	push_thread_mutex.lock();
+	LaserSharkLayerTimings timings = last_layer_timings;
+	push_thread_mutex.unlock();
+	return timings;
+}
+
+
+/*
+	Replaces the listener told about each finished layer, see LaserSharkLayerTimingsListener. An empty one stops
+	the calls. Waits for a call to the old listener to return, so it won't be called again once this has.
+*/
+void LaserShark::setLayerTimingsListener(const LaserSharkLayerTimingsListener &listener)
+{
+	layer_timings_listener_mutex.lock();
+	layer_timings_listener = listener;
+	layer_timings_listener_mutex.unlock();
+}
+
 
+/*
+	Stops any running layer and the push thread itself.
+*/
 void LaserShark::cleanupPushThread()
 {
-	if (push_thread) {
-		thread_should_run = false;
-		push_thread->join();
-		delete push_thread;
-		push_thread = NULL;
-		thread_running = false;
-		layer_error_message.clear();
+	push_thread_mutex.lock();
+	std::thread *thread = push_thread;
+	push_thread = NULL;
+	thread_should_run = false;
+	push_thread_should_exit = true;
+	push_thread_cv.notify_all();
+	push_thread_mutex.unlock();
+
+	if (thread) {
+		thread->join();
+		delete thread;
 	}
 }
 
@@ -424,24 +577,190 @@ void LaserShark::cleanupLayer()
 		delete layer;
 		layer = NULL;
 	}
+	delete next_layer;
+	next_layer = NULL;
 }
 
 #include <unistd.h>
 
+static void prefaultStack()
+{
+	volatile unsigned char stack[LASERSHARK_PUSH_THREAD_PREFAULT_STACK_SIZE];
+	for (unsigned int i = 0; i < sizeof(stack); i += 512) {
+		stack[i] = 0;
+	}
+}
+
+
+/*
+	Applies the scheduling set by setPushThreadScheduling to the calling thread. Returns true if it is now running
+	with SCHED_FIFO.
+*/
+bool LaserShark::applyPushThreadScheduling()
+{
+	push_thread_mutex.lock();
+	int rt_priority = push_rt_priority;
+	int cpu = push_cpu;
+	push_thread_mutex.unlock();
+
+	// The thread outlives a single layer, so settings that were turned off are undone too.
+	cpu_set_t cpus = process_cpus;
+	if (cpu >= 0) {
+		CPU_ZERO(&cpus);
+		CPU_SET(cpu, &cpus);
+	}
+	int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+	if (rc != 0 && cpu >= 0) {
+		std::cerr << "Could not pin LaserShark push thread to cpu " << cpu << ": " << strerror(rc) << std::endl;
+	}
+
+	bool realtime = false;
+	struct sched_param param;
+	memset(&param, 0, sizeof(param));
+	param.sched_priority = rt_priority > 0 ? rt_priority : 0;
+	rc = pthread_setschedparam(pthread_self(), rt_priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+	if (rc != 0) {
+		std::cerr << "Could not set LaserShark push thread priority " << rt_priority << ": " << strerror(rc) << std::endl;
+	} else {
+		realtime = rt_priority > 0;
+	}
+
+	prefaultStack();
+
+	return realtime;
+}
+
+
+void LaserShark::resetPushStats()
+{
+	push_transfers = 0;
+	push_max_gap_us = 0;
+	push_total_gap_us = 0;
+}
+
+
+/*
+	Only called from the push thread.
+*/
+void LaserShark::recordTransferGap(unsigned int gap_us)
+{
+	push_total_gap_us += gap_us;
+	if (gap_us > push_max_gap_us) {
+		push_max_gap_us = gap_us;
+	}
+}
+
+
+/*
+	Waits for layers to be started and pushes them. The transfer buffer and the libusb transfer are allocated
+	once, and the scheduling settings are reapplied only when they change, so starting a layer doesn't allocate
+	anything.
+*/
 void LaserShark::pushLayerThread()
 {
 	D(std::cout << "^LS thread starting" << std::endl;)
+	on_push_thread = true;
+	Tracer::instance().setThreadName("LaserShark push");
 
-	unsigned int samples_to_send = LASERSHARK_SAMPLE_COUNT_PER_BULK_TRANSFER;
 	char *buf = new char[LASERSHARK_SAMPLE_COUNT_PER_BULK_TRANSFER*LASERSHARK_SAMPLE_SIZE];
-	if (!buf) {
-		layer_error_message = "Could not allocate transfer buffer";
-		D(std::cout << layer_error_message << std::endl;)
+	memset(buf, 0, LASERSHARK_SAMPLE_COUNT_PER_BULK_TRANSFER*LASERSHARK_SAMPLE_SIZE);
+	push_transfer = libusb_alloc_transfer(0); // If this fails each transfer allocates its own.
+
+	std::unique_lock<std::mutex> lock(push_thread_mutex);
+	while (true) {
+		while (!push_thread_should_exit && !layer_start_pending) {
+			push_thread_cv.wait(lock);
+		}
+		if (push_thread_should_exit) {
+			break;
+		}
+		layer_start_pending = false;
+		LaserSharkStartGate start_gate;
+		start_gate.swap(layer_start_gate);
+		unsigned int resume_from = layer_resume_from;
+		LaserSharkLayerTimings timings = layer_timings;
+		std::chrono::steady_clock::time_point set_time = layer_set_time;
+
+		bool apply_scheduling = push_scheduling_changed;
+		push_scheduling_changed = false;
+		lock.unlock();
+
+		if (apply_scheduling) {
+			push_realtime = applyPushThreadScheduling();
+		}
+		resetPushStats();
+		pushLayer(buf, start_gate, resume_from, timings);
+		timings.total_us = timings.decode_us + timings.inflate_us + timings.populate_us +
+			std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - set_time).count();
+
+		lock.lock();
+		timings.error = layer_error_message;
+		last_layer_timings = timings;
+		// Done in the same step as the layer stops running, so setLayer can't see a done layer with a waiting one.
+		layer_mutex.lock();
+		if (!layer && next_layer) {
+			layer = next_layer;
+			next_layer = NULL;
+			layer_timings = next_layer_timings;
+			layer_set_time = std::chrono::steady_clock::now();
+		}
+		layer_mutex.unlock();
 		thread_should_run = false;
 		thread_running = false;
-		return;
+		push_thread_done_cv.notify_all();
+
+		// Only once the layer is done, so nothing waiting on it is held up by the listener.
+		lock.unlock();
+		layer_timings_listener_mutex.lock();
+		if (layer_timings_listener) {
+			layer_timings_listener(timings);
+		}
+		layer_timings_listener_mutex.unlock();
+		lock.lock();
 	}
-	memset(buf, 0, LASERSHARK_SAMPLE_COUNT_PER_BULK_TRANSFER*LASERSHARK_SAMPLE_SIZE);
+	lock.unlock();
+
+	delete[] buf;
+	if (push_transfer) {
+		libusb_free_transfer(push_transfer);
+		push_transfer = NULL;
+	}
+	D(std::cout << "^LS thread exiting" << std::endl;)
+}
+
+
+/*
+	Pushes the layer from sample resume_from on. A layer that fails is kept so it can be resumed, anything else
+	is deleted once it is done. The phases are timed into timings.
+*/
+void LaserShark::pushLayer(char *buf, const LaserSharkStartGate &start_gate, unsigned int resume_from,
+	LaserSharkLayerTimings &timings)
+{
+	TraceScope trace("layer", "lasershark", timings.layer);
+	std::chrono::steady_clock::time_point push_start = std::chrono::steady_clock::now();
+	timings.first_transfer_us = 0;
+	timings.gate_us = 0;
+	timings.stream_us = 0;
+	timings.drain_us = 0;
+	timings.samples = 0;
+
+	unsigned int samples_to_send = LASERSHARK_SAMPLE_COUNT_PER_BULK_TRANSFER;
+
+	// Filling is deterministic, so regenerating the samples already drawn and throwing them away lands exactly
+	// on resume_from.
+	layer->rewind();
+	unsigned int samples_sent = 0;
+	while (samples_sent < resume_from) {
+		unsigned int skip = std::min(std::min(resume_from - samples_sent, samples_to_send), layer->getSamplesLeft());
+		if (skip == 0) {
+			break;
+		}
+		layer->fillLaserSharkTransferBuffer(skip, (unsigned char*)buf);
+		samples_sent += skip;
+	}
+	layer_checkpoint = samples_sent;
+	unsigned int first_sample = samples_sent;
+	unsigned int transfers_since_checkpoint = 0;
 
 	unsigned int ringbuffer_samples = 0;
 	try {
@@ -494,6 +813,24 @@ void LaserShark::pushLayerThread()
 		push_thread_mutex.unlock();
 	}
 
+	// Everything up to here overlaps whatever the gate is waiting on, only the drawing is held back.
+	if (start_gate) {
+		std::chrono::steady_clock::time_point gate_start = std::chrono::steady_clock::now();
+		try {
+			while (thread_should_run) {
+				if (start_gate()) {
+					break;
+				}
+			}
+		} catch (std::runtime_error e) {
+			push_thread_mutex.lock();
+			layer_error_message = e.what();
+			thread_should_run = false;
+			push_thread_mutex.unlock();
+		}
+		timings.gate_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - gate_start).count();
+	}
+
 	// Enable the output
 	try {
 		if (!setOutput(true)) {
@@ -510,6 +847,11 @@ void LaserShark::pushLayerThread()
 
 
 	if (thread_should_run) {
+		std::chrono::steady_clock::time_point stream_start;
+		std::chrono::steady_clock::time_point last_transfer_done;
+		std::chrono::steady_clock::time_point rate_window_start = std::chrono::steady_clock::now();
+		unsigned int rate_window_samples = 0;
+		unsigned int rate_window_transfers = 0;
 		while (thread_should_run) {
 			if (layer->getSamplesLeft() < samples_to_send) {
 				samples_to_send = layer->getSamplesLeft();
@@ -519,7 +861,37 @@ void LaserShark::pushLayerThread()
 				break;
 			} else {
 				try {
+					std::chrono::steady_clock::time_point submit = std::chrono::steady_clock::now();
+					if (push_transfers) {
+						recordTransferGap(std::chrono::duration_cast<std::chrono::microseconds>(submit - last_transfer_done).count());
+					}
 					packAndSendSamples(samples_to_send, buf);
+					last_transfer_done = std::chrono::steady_clock::now();
+					if (!push_transfers) {
+						stream_start = submit;
+						timings.first_transfer_us =
+							std::chrono::duration_cast<std::chrono::microseconds>(last_transfer_done - push_start).count();
+					}
+					push_transfers++;
+					samples_sent += samples_to_send;
+					rate_window_samples += samples_to_send;
+					metric_transfer_seconds->observe(std::chrono::duration<double>(last_transfer_done - submit).count());
+					metric_samples_streamed->inc(samples_to_send);
+					metric_bytes_streamed->inc(samples_to_send*LASERSHARK_SAMPLE_SIZE);
+
+					if (++transfers_since_checkpoint == LASERSHARK_CHECKPOINT_INTERVAL_TRANSFERS) {
+						transfers_since_checkpoint = 0;
+						updateLayerCheckpoint(samples_sent, ringbuffer_samples);
+					}
+					if (++rate_window_transfers == LASERSHARK_RATE_WINDOW_TRANSFERS) {
+						rate_window_transfers = 0;
+						double elapsed = std::chrono::duration<double>(last_transfer_done - rate_window_start).count();
+						if (elapsed > 0) {
+							metric_stream_bytes_per_second->set(rate_window_samples*LASERSHARK_SAMPLE_SIZE/elapsed);
+						}
+						rate_window_start = last_transfer_done;
+						rate_window_samples = 0;
+					}
 				} catch (std::runtime_error e) {
 					push_thread_mutex.lock();
 					layer_error_message = e.what();
@@ -528,15 +900,31 @@ void LaserShark::pushLayerThread()
 				}
  			}
 		}
+		timings.samples = samples_sent - first_sample;
+		if (push_transfers) {
+			timings.stream_us = std::chrono::duration_cast<std::chrono::microseconds>(last_transfer_done - stream_start).count();
+		}
 	}
 
 
 	// Wait for all samples to complete before stopping (assuming nobody instructed us to quit).
 	// If we don't do this not all samples may be printed!
 	try {
-		
+		TraceScope trace("drain", "lasershark");
+		std::chrono::steady_clock::time_point drain_start = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point deadline = drain_start +
+			std::chrono::milliseconds(transferTimeoutMs(ringbuffer_samples));
 		while (thread_should_run && getRingbufferEmptySampleCount() != ringbuffer_samples) {
-			asm("nop");
+			if (std::chrono::steady_clock::now() > deadline) {
+				std::ostringstream oss;
+				oss << "Timed out waiting for samples to be drawn.";
+				throw std::runtime_error(oss.str());
+			}
+		}
+		if (thread_should_run) {
+			std::chrono::steady_clock::duration drain = std::chrono::steady_clock::now() - drain_start;
+			metric_drain_seconds->observe(std::chrono::duration<double>(drain).count());
+			timings.drain_us = std::chrono::duration_cast<std::chrono::microseconds>(drain).count();
 		}
 	} catch (std::runtime_error e) {
 		push_thread_mutex.lock();
@@ -566,6 +954,18 @@ void LaserShark::pushLayerThread()
 		push_thread_mutex.unlock();
 	}
 
+	// With the output stopped whatever is still queued was never drawn, so the checkpoint can be made exact.
+	// If the device can't be asked the last one taken while streaming is used.
+	push_thread_mutex.lock();
+	bool failed = !layer_error_message.empty();
+	push_thread_mutex.unlock();
+	if (ringbuffer_samples) {
+		try {
+			updateLayerCheckpoint(samples_sent, ringbuffer_samples);
+		} catch (std::runtime_error e) {
+		}
+	}
+
 	// Clear out samples that may still be in the buffer (could occur if someone instructed us to quit).
 	try {
 		if (!clearSamples()) {
@@ -584,18 +984,90 @@ void LaserShark::pushLayerThread()
 	}
 
 
-	delete[] buf;
-
+	push_thread_mutex.lock();
 	layer_mutex.lock();
-	delete layer;
-	layer = NULL;
+	layer_resumable = failed;
+	if (!layer_resumable) {
+		delete layer;
+		layer = NULL;
+	}
 	layer_mutex.unlock();
+	push_thread_mutex.unlock();
+}
 
-	thread_should_run = false;
-	thread_running = false;
-	D(std::cout << "^LS thread exiting" << std::endl;)
+
+/*
+	Samples sent less those still queued in the ringbuffer have been drawn.
+*/
+void LaserShark::updateLayerCheckpoint(unsigned int samples_sent, unsigned int ringbuffer_samples) throw (std::runtime_error)
+{
+	unsigned int queued = ringbuffer_samples - getRingbufferEmptySampleCount();
+	metric_ringbuffer_fill->observe((double)queued/ringbuffer_samples);
+	layer_checkpoint = samples_sent > queued ? samples_sent - queued : 0;
 }
 
+/*
+	A running layer is stopped when the device is detached, since its samples can't be sent. Once it is back
+	the output is made safe again and the sample rate restored.
+*/
+void LaserShark::usbHotplug(LaserSharkUsbSession::HotplugEvent event)
+{
+	if (!connected()) {
+		return;
+	}
+
+	if (event == LaserSharkUsbSession::HOTPLUG_DETACHED) {
+		std::unique_lock<std::mutex> lock(push_thread_mutex);
+		if (thread_running) {
+			layer_error_message = "LaserShark was detached.";
+			thread_should_run = false;
+		}
+		while (thread_running) {
+			push_thread_done_cv.wait(lock);
+		}
+		return;
+	}
+
+	try {
+		setOutput(false);
+		clearSamples();
+		setSampleRate(sample_rate);
+	} catch (std::runtime_error e) {
+		std::cerr << "Error restoring LaserShark settings: " << e.what() << std::endl;
+	}
+}
+
+
+LaserSharkUsbSession::Priority LaserShark::commandPriority(LaserSharkUsbSession::Priority priority)
+{
+	return on_push_thread ? LaserSharkUsbSession::PRIORITY_STREAM : priority;
+}
+
+
+/*
+	A transfer on the session that reuses the push thread's libusb transfer when called from it.
+*/
+int LaserShark::transfer(unsigned char endpoint, unsigned char *data, int length, int *actual,
+	unsigned int timeout_ms, const std::atomic<bool> *keep_running)
+{
+	return usb->transfer(endpoint, data, length, actual, timeout_ms, keep_running, push_transfer);
+}
+
+
+/*
+	With the ringbuffer full the device only takes samples as fast as it draws them, so a transfer of this many
+	samples may legitimately take that long.
+*/
+unsigned int LaserShark::transferTimeoutMs(unsigned int samples)
+{
+	unsigned int rate = sample_rate;
+	if (!rate) {
+		rate = 1;
+	}
+	return (unsigned long long)samples*1000/rate + 1 + LASERSHARK_TRANSFER_TIMEOUT_SLACK_MS;
+}
+
+
 void LaserShark::packAndSendSamples(unsigned int to_send_samples, char *buf)  throw (std::runtime_error)
 {
 	int r = 0, actual;
@@ -603,12 +1075,20 @@ void LaserShark::packAndSendSamples(unsigned int to_send_samples, char *buf)  th
 
 	//D(std::cout << "+sending " << to_send_samples << " left: " << layer->getSamplesLeft() << std::endl;)
 
-	layer->fillLaserSharkTransferBuffer(to_send_samples, (unsigned char*)buf);
+	{
+		TraceScope trace("fill", "lasershark", to_send_samples);
+		layer->fillLaserSharkTransferBuffer(to_send_samples, (unsigned char*)buf);
+	}
 
-    r = libusb_bulk_transfer(devh_data, (3 | LIBUSB_ENDPOINT_OUT), (unsigned char*)buf, len, &actual, 0); // The timeout should be changed.
+	// Stopping the layer cancels the transfer rather than waiting out the timeout.
+	{
+		TraceScope trace("sample_transfer", "lasershark", to_send_samples);
+		r = transfer((3 | LIBUSB_ENDPOINT_OUT), (unsigned char*)buf, len, &actual, transferTimeoutMs(to_send_samples),
+			&thread_should_run);
+	}
 	if (r < 0) {
 		std::ostringstream oss;
-		oss << "Error disabling output: " << libusb_error_name(r);
+		oss << "Error sending samples: " << libusb_error_name(r);
 	    throw std::runtime_error(oss.str());
 	}
 }
@@ -649,21 +1129,22 @@ bool LaserShark::getUint32(uint8_t command, unsigned int *val) throw (std::runti
 	if (!connected()) {
 		return false;
 	}
+	TraceScope trace("command", "lasershark", command);
 
     data[0] = command;
 
-	cmd_mutex.lock();	
-    r = libusb_bulk_transfer(devh_ctl, (1 | LIBUSB_ENDPOINT_OUT), data, len, &actual, 0);
+	usb->lock(commandPriority(LaserSharkUsbSession::PRIORITY_STATUS));
+    r = transfer((1 | LIBUSB_ENDPOINT_OUT), data, len, &actual, LASERSHARK_CMD_TIMEOUT_MS);
     if(r != 0 || actual != len) {
-		cmd_mutex.unlock();
+		usb->unlock();
 		std::ostringstream oss;
 		oss << "Error transmitting: " << libusb_error_name(r);
     	throw std::runtime_error(oss.str()); 
 	}
 
-    r = libusb_bulk_transfer(devh_ctl, (1 | LIBUSB_ENDPOINT_IN), data, 64, &actual, 0);
+    r = transfer((1 | LIBUSB_ENDPOINT_IN), data, 64, &actual, LASERSHARK_CMD_TIMEOUT_MS);
 
-	cmd_mutex.unlock();
+	usb->unlock();
 
     if(r != 0 || actual != 64) {
 		std::ostringstream oss;
@@ -690,25 +1171,26 @@ bool LaserShark::setUint8(unsigned char command, unsigned char val) throw (std::
 	if (!connected()) {
 		return false;
 	}
+	TraceScope trace("command", "lasershark", command);
 
 
     data[0] = command;
     data[1] = val;
 
 
-	cmd_mutex.lock();
+	usb->lock(commandPriority(LaserSharkUsbSession::PRIORITY_COMMAND));
 
-    r = libusb_bulk_transfer(devh_ctl, (1 | LIBUSB_ENDPOINT_OUT), data, len, &actual, 0);
+    r = transfer((1 | LIBUSB_ENDPOINT_OUT), data, len, &actual, LASERSHARK_CMD_TIMEOUT_MS);
     if(r != 0 || actual != len) {
-		cmd_mutex.unlock();
+		usb->unlock();
 		std::ostringstream oss;
 		oss << "Error transmitting: " << libusb_error_name(r);
     	throw std::runtime_error(oss.str()); 
 	}
 
-    r = libusb_bulk_transfer(devh_ctl, (1 | LIBUSB_ENDPOINT_IN), data, 64, &actual, 0);
+    r = transfer((1 | LIBUSB_ENDPOINT_IN), data, 64, &actual, LASERSHARK_CMD_TIMEOUT_MS);
 
-	cmd_mutex.unlock();
+	usb->unlock();
 
     if(r != 0 || actual != 64) {
 		std::ostringstream oss;
@@ -735,22 +1217,23 @@ bool LaserShark::setUint32(unsigned char command, unsigned int val) throw (std::
 	if (!connected()) {
 		return false;
 	}
+	TraceScope trace("command", "lasershark", command);
 
     data[0] = command;
     memcpy(data + 1, &val, sizeof(uint32_t));
 
-	cmd_mutex.lock();
-    r = libusb_bulk_transfer(devh_ctl, (1 | LIBUSB_ENDPOINT_OUT), data, len, &actual, 0);
+	usb->lock(commandPriority(LaserSharkUsbSession::PRIORITY_COMMAND));
+    r = transfer((1 | LIBUSB_ENDPOINT_OUT), data, len, &actual, LASERSHARK_CMD_TIMEOUT_MS);
     if(r != 0 || actual != len) {
-		cmd_mutex.unlock();
+		usb->unlock();
 		std::ostringstream oss;
 		oss << "Error transmitting: " << libusb_error_name(r);
     	throw std::runtime_error(oss.str()); 
 	}
 
-    r = libusb_bulk_transfer(devh_ctl, (1 | LIBUSB_ENDPOINT_IN), data, 64, &actual, 0);
+    r = transfer((1 | LIBUSB_ENDPOINT_IN), data, 64, &actual, LASERSHARK_CMD_TIMEOUT_MS);
 
-	cmd_mutex.unlock();
+	usb->unlock();
 
     if(r != 0 || actual != 64) {
 		std::ostringstream oss;
@@ -25,8 +25,62 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <thread>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <chrono>
+#include <string>
+#include <sched.h>
 
 #include "AbstractLaserSharkLayer.h"
+#include "LaserSharkUsbSession.h"
+#include "metrics/Metrics.h"
+
+
+struct LaserSharkPushStats
+{
+	bool realtime; // The push thread is running with SCHED_FIFO.
+	unsigned int transfers;
+	unsigned int max_gap_us; // Time between one transfer finishing and the next being submitted.
+	unsigned int avg_gap_us;
+};
+
+/*
+	Where the time of one layer went, in microseconds. The preparation fields are filled in by whoever builds the
+	layer and handed over with setLayer, the rest by the push thread.
+*/
+struct LaserSharkLayerTimings
+{
+	LaserSharkLayerTimings() : layer(0), resumed(false), upload_bytes(0), decode_us(0), inflate_us(0), populate_us(0),
+		first_transfer_us(0), gate_us(0), stream_us(0), drain_us(0), total_us(0), samples(0) {}
+
+	unsigned int layer; // Counts the layers set since startup, 0 if there is no record.
+	bool resumed;
+	unsigned int upload_bytes; // Size of the layer's data as received.
+	unsigned int decode_us;
+	unsigned int inflate_us; // PNG decompression.
+	unsigned int populate_us; // Building the samples, not counting inflate_us.
+	unsigned int first_transfer_us; // From the push thread picking the layer up to its first transfer finishing.
+	unsigned int gate_us; // Waiting on the start gate, part of first_transfer_us.
+	unsigned int stream_us; // From the first transfer being submitted to the last one finishing.
+	unsigned int drain_us; // Waiting for the ringbuffer to be drawn empty.
+	unsigned int total_us; // Preparation plus everything from the layer being set, or taking over, until it was done.
+	unsigned int samples; // Samples streamed, a resumed layer only counts the ones after the checkpoint.
+	std::string error;
+};
+
+/*
+	Called on the push thread with the timings of each layer once it is done. The next layer can't start until it
+	returns, so it should hand the timings off rather than write them anywhere slow.
+*/
+typedef std::function<void(const LaserSharkLayerTimings&)> LaserSharkLayerTimingsListener;
+
+/*
+	Holds back the start of a layer. The push thread calls it once the layer is ready to be drawn, before the output
+	is enabled, and keeps calling it until it returns true. It should not block for more than a few ms per call so
+	stopping the layer is not held up. Throwing std::runtime_error fails the layer.
+*/
+typedef std::function<bool()> LaserSharkStartGate;
+
 
 /*
 	TODO:
@@ -42,7 +96,7 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 class LaserShark
 {
 	public:
-		LaserShark();
+		LaserShark(LaserSharkUsbSession *usb);
 		~LaserShark();
 
 		bool connect() throw (std::runtime_error);
@@ -57,9 +111,11 @@ class LaserShark
 		int getFWMajorVersion() throw (std::runtime_error);
 		int getFWMinorVersion() throw (std::runtime_error);
 
-		bool setLayer(AbstractLaserSharkLayer *layer);
+		bool setLayer(AbstractLaserSharkLayer *layer, const LaserSharkLayerTimings &timings = LaserSharkLayerTimings());
 
-		bool startLayer()  throw (std::runtime_error);
+		bool startLayer(const LaserSharkStartGate &start_gate = LaserSharkStartGate())  throw (std::runtime_error);
+		bool resumeLayer() throw (std::runtime_error);
+		unsigned int getLayerCheckpoint();
 		void stopAndClearLayer();
 
 		unsigned int getLayerTotalSamples();
@@ -68,18 +124,33 @@ class LaserShark
 		bool layerRunning();
 
 		bool layerDone();
+		bool waitForLayerDone(unsigned int timeout_ms);
 		std::string getLayerErrorMessage();
 
+		bool setPushThreadScheduling(int rt_priority, int cpu, bool lock_memory);
+		LaserSharkPushStats getPushStats();
+		LaserSharkLayerTimings getLayerTimings();
+		void setLayerTimingsListener(const LaserSharkLayerTimingsListener &listener);
 
 
-	private:
-		void release();
-		void shutdown();
 
+	private:
 		void cleanupPushThread();
 		void cleanupLayer();
 
 		void pushLayerThread();
+		bool beginLayer(const LaserSharkStartGate &start_gate, bool resume) throw (std::runtime_error);
+		void pushLayer(char *buf, const LaserSharkStartGate &start_gate, unsigned int resume_from,
+			LaserSharkLayerTimings &timings);
+		void updateLayerCheckpoint(unsigned int samples_sent, unsigned int ringbuffer_samples) throw (std::runtime_error);
+		bool applyPushThreadScheduling();
+		void resetPushStats();
+		void recordTransferGap(unsigned int gap_us);
+		void usbHotplug(LaserSharkUsbSession::HotplugEvent event);
+		LaserSharkUsbSession::Priority commandPriority(LaserSharkUsbSession::Priority priority);
+		int transfer(unsigned char endpoint, unsigned char *data, int length, int *actual, unsigned int timeout_ms,
+			const std::atomic<bool> *keep_running = NULL);
+		unsigned int transferTimeoutMs(unsigned int samples);
 		void packAndSendSamples(unsigned int to_send_samples, char* buf)  throw (std::runtime_error);
 
 		bool setOutput(bool enable)  throw (std::runtime_error);
@@ -97,15 +168,48 @@ class LaserShark
 		std::mutex push_thread_mutex;
 		std::string layer_error_message;
 		std::thread *push_thread;
+		std::condition_variable push_thread_cv;
+		std::condition_variable push_thread_done_cv;
+		bool push_thread_should_exit;
+		bool layer_start_pending;
+		LaserSharkStartGate layer_start_gate;
+
+		int push_rt_priority;
+		int push_cpu;
+		cpu_set_t process_cpus; // The affinity before any pinning, restored when push_cpu is turned off.
+		bool push_scheduling_changed;
+		std::atomic<bool> push_realtime;
+		std::atomic<unsigned int> push_transfers;
+		std::atomic<unsigned int> push_max_gap_us;
+		std::atomic<unsigned long long> push_total_gap_us;
+
+		unsigned int layer_count;
+		LaserSharkLayerTimings layer_timings; // Of the layer that was set, filled in as it runs.
+		LaserSharkLayerTimings last_layer_timings;
+		std::chrono::steady_clock::time_point layer_set_time;
+		std::mutex layer_timings_listener_mutex; // Held while the listener is called, so replacing it waits the call out.
+		LaserSharkLayerTimingsListener layer_timings_listener;
 
 		std::mutex layer_mutex;
 		AbstractLaserSharkLayer *layer;
+		AbstractLaserSharkLayer *next_layer; // Set while a layer runs, takes its place once it is done.
+		LaserSharkLayerTimings next_layer_timings;
+		bool layer_resumable; // The layer failed part way and was kept.
+		unsigned int layer_resume_from;
+		std::atomic<unsigned int> layer_checkpoint; // Samples of the layer known to have been drawn.
 
 		std::mutex cmd_mutex;
-		bool devh_ctl_claimed;
-		bool devh_data_claimed;
-		struct libusb_device_handle *devh_ctl;
-		struct libusb_device_handle *devh_data;
+		LaserSharkUsbSession *usb;
+		bool usb_open;
+		int hotplug_listener_id;
+		std::atomic<unsigned int> sample_rate;
+
+		MetricsCounter *metric_samples_streamed;
+		MetricsCounter *metric_bytes_streamed;
+		MetricsGauge *metric_stream_bytes_per_second;
+		MetricsHistogram *metric_transfer_seconds;
+		MetricsHistogram *metric_ringbuffer_fill;
+		MetricsHistogram *metric_drain_seconds;
 };
 
 #endif //_LASERSHARK_H_
@@ -0,0 +1,372 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LaserSharkLayerPreprocessor.h"
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <cmath>
+#include "debug.h"
+
+#define LASERSHARK_PREPROCESSOR_DEFAULT_THRESHOLD 1
+#define LASERSHARK_PREPROCESSOR_DEFAULT_TILE_SIZE 128
+
+// Distance (in pixels) between the points tested along a hatch line.
+#define LASERSHARK_PREPROCESSOR_HATCH_STEP 0.5f
+
+#define LASERSHARK_PREPROCESSOR_PI 3.14159265358979f
+
+
+/*
+	Contour points sit on pixel edge midpoints, so they are kept as doubled integer coordinates (offset so
+	they are never negative) packed into a single key while segments are joined.
+*/
+static long long contourKey(int x2, int y2)
+{
+	return ((long long)(x2 + 2) << 32) | (long long)(y2 + 2);
+}
+
+static int contourKeyX(long long key)
+{
+	return (int)(key >> 32) - 2;
+}
+
+static int contourKeyY(long long key)
+{
+	return (int)(key & 0xFFFFFFFF) - 2;
+}
+
+
+LaserSharkLayerPreprocessor::LaserSharkLayerPreprocessor(unsigned int thread_count) :
+	pool(thread_count)
+{
+	settings.threshold = LASERSHARK_PREPROCESSOR_DEFAULT_THRESHOLD;
+	settings.tile_size = LASERSHARK_PREPROCESSOR_DEFAULT_TILE_SIZE;
+	settings.outline = true;
+	settings.hatch_angle = 0;
+	settings.hatch_spacing = 0;
+}
+
+
+/*
+	Pixels with a value of at least threshold are considered lit.
+*/
+void LaserSharkLayerPreprocessor::setThreshold(unsigned char threshold)
+{
+	settings_mutex.lock();
+	settings.threshold = threshold ? threshold : 1;
+	settings_mutex.unlock();
+}
+
+
+void LaserSharkLayerPreprocessor::setTileSize(unsigned int tile_size)
+{
+	settings_mutex.lock();
+	settings.tile_size = tile_size ? tile_size : LASERSHARK_PREPROCESSOR_DEFAULT_TILE_SIZE;
+	settings_mutex.unlock();
+}
+
+
+void LaserSharkLayerPreprocessor::setOutline(bool enable)
+{
+	settings_mutex.lock();
+	settings.outline = enable;
+	settings_mutex.unlock();
+}
+
+
+/*
+	Fills lit areas with parallel lines spacing pixels apart, angle_degrees from the x axis.
+	A spacing of 0 disables hatching.
+*/
+void LaserSharkLayerPreprocessor::setHatch(float angle_degrees, float spacing)
+{
+	settings_mutex.lock();
+	settings.hatch_angle = angle_degrees;
+	settings.hatch_spacing = spacing > 0 ? spacing : 0;
+	settings_mutex.unlock();
+}
+
+
+/*
+	Returns false if the image was empty or did not match the dimensions given.
+*/
+bool LaserSharkLayerPreprocessor::process(const std::vector<unsigned char> &image, unsigned int width,
+	unsigned int height, std::vector<LaserSharkPolyline> &polylines)
+{
+	polylines.clear();
+
+	if (width == 0 || height == 0 || image.size() < width*height) {
+		std::cerr << "Preprocessor image was empty or too small!" << std::endl;
+		return false;
+	}
+
+	settings_mutex.lock();
+	Settings current = settings;
+	settings_mutex.unlock();
+
+	if (current.outline) {
+		extractContours(current, image, width, height, polylines);
+	}
+
+	if (current.hatch_spacing > 0) {
+		generateHatch(current, image, width, height, polylines);
+	}
+
+	D(std::cout << "Preprocessor produced " << polylines.size() << " polylines" << std::endl;)
+
+	return true;
+}
+
+
+void LaserSharkLayerPreprocessor::extractContours(const Settings &settings, const std::vector<unsigned char> &image,
+	unsigned int width, unsigned int height, std::vector<LaserSharkPolyline> &polylines)
+{
+	// Cells are anchored on their upper left pixel and start one pixel outside the image so
+	// shapes touching the border still produce closed outlines.
+	unsigned int cells_x = width + 1;
+	unsigned int cells_y = height + 1;
+	unsigned int tiles_x = (cells_x + settings.tile_size - 1) / settings.tile_size;
+	unsigned int tiles_y = (cells_y + settings.tile_size - 1) / settings.tile_size;
+
+	std::vector<std::vector<Segment> > tile_segments(tiles_x*tiles_y);
+
+	pool.run(tiles_x*tiles_y, [&](unsigned int tile) {
+		int cell_x0 = (int)((tile % tiles_x) * settings.tile_size) - 1;
+		int cell_y0 = (int)((tile / tiles_x) * settings.tile_size) - 1;
+		contourTile(settings, image, width, height, cell_x0, cell_y0, tile_segments[tile]);
+	});
+
+	joinSegments(tile_segments, width, height, polylines);
+}
+
+
+void LaserSharkLayerPreprocessor::contourTile(const Settings &settings, const std::vector<unsigned char> &image,
+	int width, int height, int cell_x0, int cell_y0, std::vector<Segment> &segments)
+{
+	int cell_x1 = std::min(cell_x0 + (int)settings.tile_size, width);
+	int cell_y1 = std::min(cell_y0 + (int)settings.tile_size, height);
+
+	for (int y = cell_y0; y < cell_y1; y++) {
+		for (int x = cell_x0; x < cell_x1; x++) {
+			bool tl = x >= 0 && y >= 0 && image[y*width + x] >= settings.threshold;
+			bool tr = x + 1 < width && y >= 0 && image[y*width + x + 1] >= settings.threshold;
+			bool br = x + 1 < width && y + 1 < height && image[(y + 1)*width + x + 1] >= settings.threshold;
+			bool bl = x >= 0 && y + 1 < height && image[(y + 1)*width + x] >= settings.threshold;
+			int index = (tl ? 8 : 0) | (tr ? 4 : 0) | (br ? 2 : 0) | (bl ? 1 : 0);
+
+			if (index == 0 || index == 15) {
+				continue;
+			}
+
+			long long top = contourKey(2*x + 1, 2*y);
+			long long right = contourKey(2*x + 2, 2*y + 1);
+			long long bottom = contourKey(2*x + 1, 2*y + 2);
+			long long left = contourKey(2*x, 2*y + 1);
+
+			// Saddles (5 and 10) keep the diagonal pixels apart.
+			switch (index) {
+				case 1: case 14: addSegment(segments, left, bottom); break;
+				case 2: case 13: addSegment(segments, bottom, right); break;
+				case 3: case 12: addSegment(segments, left, right); break;
+				case 4: case 11: addSegment(segments, top, right); break;
+				case 6: case 9: addSegment(segments, top, bottom); break;
+				case 7: case 8: addSegment(segments, left, top); break;
+				case 5:
+					addSegment(segments, left, bottom);
+					addSegment(segments, top, right);
+					break;
+				case 10:
+					addSegment(segments, left, top);
+					addSegment(segments, bottom, right);
+					break;
+			}
+		}
+	}
+}
+
+
+void LaserSharkLayerPreprocessor::addSegment(std::vector<Segment> &segments, long long a, long long b)
+{
+	Segment segment = { a, b };
+	segments.push_back(segment);
+}
+
+
+/*
+	Every edge midpoint a contour crosses is shared by exactly two segments, so walking from segment to
+	segment through shared points yields closed loops. Points on straight runs are dropped.
+*/
+void LaserSharkLayerPreprocessor::joinSegments(const std::vector<std::vector<Segment> > &tile_segments,
+	unsigned int width, unsigned int height, std::vector<LaserSharkPolyline> &polylines)
+{
+	std::vector<Segment> segments;
+	for (unsigned int i = 0; i < tile_segments.size(); i++) {
+		segments.insert(segments.end(), tile_segments[i].begin(), tile_segments[i].end());
+	}
+
+	std::unordered_map<long long, std::pair<int, int> > links;
+	links.reserve(segments.size()*2);
+	for (unsigned int i = 0; i < segments.size(); i++) {
+		long long ends[2] = { segments[i].a, segments[i].b };
+		for (int e = 0; e < 2; e++) {
+			std::unordered_map<long long, std::pair<int, int> >::iterator it = links.find(ends[e]);
+			if (it == links.end()) {
+				links[ends[e]] = std::make_pair((int)i, -1);
+			} else {
+				it->second.second = i;
+			}
+		}
+	}
+
+	std::vector<bool> used(segments.size(), false);
+	std::vector<long long> loop;
+	for (unsigned int i = 0; i < segments.size(); i++) {
+		if (used[i]) {
+			continue;
+		}
+		used[i] = true;
+
+		loop.clear();
+		loop.push_back(segments[i].a);
+		loop.push_back(segments[i].b);
+		long long start = segments[i].a;
+		long long curr = segments[i].b;
+		while (curr != start) {
+			const std::pair<int, int> &link = links[curr];
+			int next = -1;
+			if (link.first != -1 && !used[link.first]) {
+				next = link.first;
+			} else if (link.second != -1 && !used[link.second]) {
+				next = link.second;
+			}
+			if (next == -1) {
+				break;
+			}
+			used[next] = true;
+			curr = segments[next].a == curr ? segments[next].b : segments[next].a;
+			loop.push_back(curr);
+		}
+
+		LaserSharkPolyline polyline;
+		for (unsigned int j = 0; j < loop.size(); j++) {
+			int x2 = contourKeyX(loop[j]);
+			int y2 = contourKeyY(loop[j]);
+			if (j > 0 && j + 1 < loop.size()) {
+				int ax = x2 - contourKeyX(loop[j-1]), ay = y2 - contourKeyY(loop[j-1]);
+				int bx = contourKeyX(loop[j+1]) - x2, by = contourKeyY(loop[j+1]) - y2;
+				if (ax*by - ay*bx == 0 && ax*bx + ay*by > 0) {
+					continue;
+				}
+			}
+			LaserSharkVectorPoint p;
+			p.x = std::min(std::max(x2 / 2.0f, 0.0f), (float)(width - 1));
+			p.y = std::min(std::max(y2 / 2.0f, 0.0f), (float)(height - 1));
+			// Clamping to the image can fold border points onto each other.
+			if (!polyline.empty() && polyline.back().x == p.x && polyline.back().y == p.y) {
+				continue;
+			}
+			polyline.push_back(p);
+		}
+		polylines.push_back(polyline);
+	}
+}
+
+
+void LaserSharkLayerPreprocessor::generateHatch(const Settings &settings, const std::vector<unsigned char> &image,
+	unsigned int width, unsigned int height, std::vector<LaserSharkPolyline> &polylines)
+{
+	float angle = settings.hatch_angle * LASERSHARK_PREPROCESSOR_PI / 180.0f;
+	float dir_x = cosf(angle), dir_y = sinf(angle);
+	float norm_x = -dir_y, norm_y = dir_x;
+
+	// Project the image corners onto the line direction and its normal to find the range to cover.
+	float corners_x[4] = { 0, (float)(width - 1), 0, (float)(width - 1) };
+	float corners_y[4] = { 0, 0, (float)(height - 1), (float)(height - 1) };
+	float d_min = 0, d_max = 0, n_min = 0, n_max = 0;
+	for (int i = 0; i < 4; i++) {
+		float d = corners_x[i]*dir_x + corners_y[i]*dir_y;
+		float n = corners_x[i]*norm_x + corners_y[i]*norm_y;
+		if (i == 0 || d < d_min) d_min = d;
+		if (i == 0 || d > d_max) d_max = d;
+		if (i == 0 || n < n_min) n_min = n;
+		if (i == 0 || n > n_max) n_max = n;
+	}
+
+	unsigned int line_count = (unsigned int)((n_max - n_min) / settings.hatch_spacing) + 1;
+	unsigned int steps = (unsigned int)((d_max - d_min) / LASERSHARK_PREPROCESSOR_HATCH_STEP) + 1;
+	unsigned int band_size = std::max(1u, line_count / (pool.getThreadCount()*4));
+	unsigned int bands = (line_count + band_size - 1) / band_size;
+
+	std::vector<std::vector<LaserSharkPolyline> > band_lines(bands);
+
+	pool.run(bands, [&](unsigned int band) {
+		unsigned int line_end = std::min((band + 1)*band_size, line_count);
+		for (unsigned int line = band*band_size; line < line_end; line++) {
+			float n = n_min + settings.hatch_spacing/2 + line*settings.hatch_spacing;
+			if (n > n_max) {
+				break;
+			}
+
+			std::vector<LaserSharkPolyline> runs;
+			bool in_run = false;
+			float run_start = 0, run_end = 0;
+			for (unsigned int s = 0; s <= steps; s++) {
+				float d = d_min + s*LASERSHARK_PREPROCESSOR_HATCH_STEP;
+				long px = lroundf(n*norm_x + d*dir_x);
+				long py = lroundf(n*norm_y + d*dir_y);
+				bool lit = s < steps && px >= 0 && py >= 0 && px < (long)width && py < (long)height &&
+					image[py*width + px] >= settings.threshold;
+
+				if (lit) {
+					if (!in_run) {
+						run_start = d;
+						in_run = true;
+					}
+					run_end = d;
+				} else if (in_run) {
+					LaserSharkPolyline run(2);
+					run[0].x = n*norm_x + run_start*dir_x;
+					run[0].y = n*norm_y + run_start*dir_y;
+					run[1].x = n*norm_x + run_end*dir_x;
+					run[1].y = n*norm_y + run_end*dir_y;
+					for (int i = 0; i < 2; i++) {
+						run[i].x = std::min(std::max(run[i].x, 0.0f), (float)(width - 1));
+						run[i].y = std::min(std::max(run[i].y, 0.0f), (float)(height - 1));
+					}
+					runs.push_back(run);
+					in_run = false;
+				}
+			}
+
+			// Alternate the direction of every other line so consecutive lines join up end to start.
+			if (line & 1) {
+				std::reverse(runs.begin(), runs.end());
+				for (unsigned int i = 0; i < runs.size(); i++) {
+					std::reverse(runs[i].begin(), runs[i].end());
+				}
+			}
+			band_lines[band].insert(band_lines[band].end(), runs.begin(), runs.end());
+		}
+	});
+
+	for (unsigned int i = 0; i < bands; i++) {
+		polylines.insert(polylines.end(), band_lines[i].begin(), band_lines[i].end());
+	}
+}
@@ -0,0 +1,80 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LASERSHARKLAYERPREPROCESSOR_H_
+#define _LASERSHARKLAYERPREPROCESSOR_H_
+
+#include "LaserSharkPolyline.h"
+#include "LaserSharkThreadPool.h"
+#include <vector>
+#include <mutex>
+
+
+/*
+	Turns a decoded 8 bit grey layer image (as LaserSharkZigZagLayer decodes it) into polylines: the outlines of
+	the lit areas found with marching squares, and optionally hatch lines filling them. Work is split into image
+	tiles (outlines) and bands of hatch lines which run on a thread pool.
+	Safe to share between threads, process() calls are serialized.
+*/
+class LaserSharkLayerPreprocessor
+{
+	public:
+		LaserSharkLayerPreprocessor(unsigned int thread_count = 0);
+
+		void setThreshold(unsigned char threshold);
+		void setTileSize(unsigned int tile_size);
+		void setOutline(bool enable);
+		void setHatch(float angle_degrees, float spacing);
+
+		bool process(const std::vector<unsigned char> &image, unsigned int width, unsigned int height,
+			std::vector<LaserSharkPolyline> &polylines);
+
+	private:
+		struct Settings
+		{
+			unsigned char threshold;
+			unsigned int tile_size;
+			bool outline;
+			float hatch_angle;
+			float hatch_spacing;
+		};
+
+		struct Segment
+		{
+			long long a, b;
+		};
+
+		void extractContours(const Settings &settings, const std::vector<unsigned char> &image,
+			unsigned int width, unsigned int height, std::vector<LaserSharkPolyline> &polylines);
+		void contourTile(const Settings &settings, const std::vector<unsigned char> &image,
+			int width, int height, int cell_x0, int cell_y0, std::vector<Segment> &segments);
+		void addSegment(std::vector<Segment> &segments, long long a, long long b);
+		void joinSegments(const std::vector<std::vector<Segment> > &tile_segments,
+			unsigned int width, unsigned int height, std::vector<LaserSharkPolyline> &polylines);
+
+		void generateHatch(const Settings &settings, const std::vector<unsigned char> &image,
+			unsigned int width, unsigned int height, std::vector<LaserSharkPolyline> &polylines);
+
+		std::mutex settings_mutex;
+		Settings settings;
+
+		LaserSharkThreadPool pool;
+};
+
+#endif //_LASERSHARKLAYERPREPROCESSOR_H_
@@ -0,0 +1,58 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LASERSHARKSAMPLE_H_
+#define _LASERSHARKSAMPLE_H_
+
+/*
+This struct is only compatible with Lasershark V2.X modules. The format is a 16 byte (little endian) array of 4 elements
+[0] = Channel A output (lower 12 bits), LASERSHARK_C_BITMASK field(0x4000), LASERSHARK_INTL_A_BITMASK(0x8000)
+[1] = Channel B output (lower 12 bits)
+[2] = X Galvo output (lower 12 bits)
+[3] = Y Galvo output (lower 12 bits).
+
+It's pretty messy... A version command should probably be added to the protocol and a check added so this can be used
+with multiple different lasershark versions... but for now, it's good enough.
+*/
+struct laserSharkSample
+{
+	unsigned short a	: 12;
+	unsigned short pad	: 2;
+	bool c				: 1;
+	bool intl_a			: 1;
+	unsigned short b	: 16;
+	unsigned short x	: 16;
+	unsigned short y	: 16;
+} __attribute__((packed));
+
+
+// Fills in a sample from an 8 bit intensity value.
+inline void setLaserSharkSample(laserSharkSample &sample, unsigned char intensity,
+	unsigned short x, unsigned short y)
+{
+	int val = (intensity << 4); // Change to 12 bit
+	sample.a = val;
+	sample.c = val > 2048 ? true : false;
+	sample.intl_a = true;
+	sample.b = val;
+	sample.x = x;
+	sample.y = y;
+}
+
+#endif //_LASERSHARKSAMPLE_H_
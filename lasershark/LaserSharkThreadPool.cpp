@@ -0,0 +1,121 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LaserSharkThreadPool.h"
+
+
+/*
+	A thread_count of 0 uses one thread per hardware thread. The thread calling run() also works on jobs,
+	so one less worker thread than requested is started.
+*/
+LaserSharkThreadPool::LaserSharkThreadPool(unsigned int thread_count)
+{
+	job = NULL;
+	job_count = 0;
+	next_job = 0;
+	jobs_done = 0;
+	should_exit = false;
+
+	if (thread_count == 0) {
+		thread_count = std::thread::hardware_concurrency();
+	}
+
+	for (unsigned int i = 1; i < thread_count; i++) {
+		threads.push_back(new std::thread(&LaserSharkThreadPool::workerThread, this));
+	}
+}
+
+
+LaserSharkThreadPool::~LaserSharkThreadPool()
+{
+	job_mutex.lock();
+	should_exit = true;
+	job_mutex.unlock();
+	work_cv.notify_all();
+
+	for (unsigned int i = 0; i < threads.size(); i++) {
+		threads[i]->join();
+		delete threads[i];
+	}
+}
+
+
+unsigned int LaserSharkThreadPool::getThreadCount()
+{
+	return threads.size() + 1;
+}
+
+
+/*
+	Calls job(0) through job(job_count - 1) across the pool and returns once all of them have completed.
+*/
+void LaserSharkThreadPool::run(unsigned int job_count, const std::function<void(unsigned int)> &job)
+{
+	std::lock_guard<std::mutex> run_lock(run_mutex);
+
+	std::unique_lock<std::mutex> lock(job_mutex);
+	this->job = &job;
+	this->job_count = job_count;
+	next_job = 0;
+	jobs_done = 0;
+	work_cv.notify_all();
+
+	while (runOneJob(lock)) {
+	}
+
+	while (jobs_done < this->job_count) {
+		done_cv.wait(lock);
+	}
+	this->job = NULL;
+	this->job_count = 0;
+}
+
+
+void LaserSharkThreadPool::workerThread()
+{
+	std::unique_lock<std::mutex> lock(job_mutex);
+	while (!should_exit) {
+		if (!runOneJob(lock)) {
+			work_cv.wait(lock);
+		}
+	}
+}
+
+
+/*
+	Expects job_mutex to be held, which is released while the job runs. Returns false if there was no job to run.
+*/
+bool LaserSharkThreadPool::runOneJob(std::unique_lock<std::mutex> &lock)
+{
+	if (!job || next_job >= job_count) {
+		return false;
+	}
+
+	unsigned int index = next_job++;
+	const std::function<void(unsigned int)> *current = job;
+	lock.unlock();
+	(*current)(index);
+	lock.lock();
+
+	jobs_done++;
+	if (jobs_done == job_count) {
+		done_cv.notify_all();
+	}
+	return true;
+}
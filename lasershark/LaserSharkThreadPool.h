@@ -0,0 +1,59 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LASERSHARKTHREADPOOL_H_
+#define _LASERSHARKTHREADPOOL_H_
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+
+// Fixed set of worker threads used to split layer processing into independent jobs.
+class LaserSharkThreadPool
+{
+	public:
+		LaserSharkThreadPool(unsigned int thread_count = 0);
+		~LaserSharkThreadPool();
+
+		unsigned int getThreadCount();
+
+		void run(unsigned int job_count, const std::function<void(unsigned int)> &job);
+
+	private:
+		void workerThread();
+		bool runOneJob(std::unique_lock<std::mutex> &lock);
+
+		std::vector<std::thread*> threads;
+
+		std::mutex run_mutex;
+
+		std::mutex job_mutex;
+		std::condition_variable work_cv;
+		std::condition_variable done_cv;
+		const std::function<void(unsigned int)> *job;
+		unsigned int job_count;
+		unsigned int next_job;
+		unsigned int jobs_done;
+		bool should_exit;
+};
+
+#endif //_LASERSHARKTHREADPOOL_H_
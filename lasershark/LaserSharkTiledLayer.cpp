@@ -0,0 +1,242 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LaserSharkTiledLayer.h"
+#include "LaserSharkSample.h"
+#include <algorithm>
+#include <iostream>
+#include <climits>
+#include "debug.h"
+
+
+LaserSharkTiledLayer::LaserSharkTiledLayer()
+{
+	forward_offset = 0;
+	reverse_offset = 0;
+	ramp_samples = 0;
+	dwell_max_repeats = 1;
+	clear();
+}
+
+
+LaserSharkTiledLayer::~LaserSharkTiledLayer()
+{
+	clear();
+}
+
+
+/*
+	Populates the layer with a single tile.
+*/
+bool LaserSharkTiledLayer::populate(unsigned int x_origin, unsigned int y_origin, const unsigned char* png_image_data, unsigned int png_image_data_len)
+{
+	std::vector<LaserSharkTile> tiles(1);
+	tiles[0].x_origin = x_origin;
+	tiles[0].y_origin = y_origin;
+	tiles[0].png_image_data = png_image_data;
+	tiles[0].png_image_data_len = png_image_data_len;
+	return populate(tiles);
+}
+
+
+/*
+	Each tile is a png placed at its own origin. Only tiles with something to draw are kept, so memory follows
+	the area of the parts rather than the plate. Tiles are drawn one after the other, top to bottom and then
+	left to right by origin.
+	Returns false if a tile could not be decoded or no tile had anything to draw.
+*/
+bool LaserSharkTiledLayer::populate(const std::vector<LaserSharkTile> &tiles)
+{
+	if (initialized) {
+	    std::cerr << "Layer is populated, can't re-populate." << std::endl;
+		return false;
+	}
+
+	for (unsigned int i = 0; i < tiles.size(); i++) {
+		LaserSharkZigZagLayer *layer = new LaserSharkZigZagLayer();
+		layer->setScanCompensation(forward_offset, reverse_offset, ramp_samples);
+		layer->setDwell(dwell_max_repeats);
+
+		if (!layer->populate(tiles[i].x_origin, tiles[i].y_origin, tiles[i].png_image_data, tiles[i].png_image_data_len)) {
+			std::cerr << "Layer tile " << i << " did not populate." << std::endl;
+			delete layer;
+			clear();
+			return false;
+		}
+		inflate_us += layer->getInflateUs();
+
+		if (layer->getTotalSamples() == 0) {
+			delete layer;
+			continue;
+		}
+
+		Tile tile;
+		tile.x_origin = tiles[i].x_origin;
+		tile.y_origin = tiles[i].y_origin;
+		tile.layer = layer;
+		this->tiles.push_back(tile);
+
+		width = std::max(width, tile.x_origin + layer->getWidth());
+		height = std::max(height, tile.y_origin + layer->getHeight());
+		if (total_samples > UINT_MAX - layer->getTotalSamples()) {
+			std::cerr << "Layer has too many samples!" << std::endl;
+			clear();
+			return false;
+		}
+		total_samples += layer->getTotalSamples();
+	}
+
+	if (this->tiles.empty()) {
+		std::cerr << "Layer was empty!" << std::endl;
+		clear();
+		return false;
+	}
+
+	std::sort(this->tiles.begin(), this->tiles.end(), tileBefore);
+
+    D(std::cout << "Layer tiles: " << this->tiles.size() << " total_samples:" << total_samples << std::endl;)
+
+	samples_left = total_samples;
+	curr_tile = 0;
+	initialized = true;
+
+	return true;
+}
+
+
+/*
+	Fills buf with sample_count samples, see LaserSharkSample.h for the sample format. A tile is never asked for
+	more samples than it has left, so its trailing blank pixels are skipped.
+*/
+unsigned int LaserSharkTiledLayer::fillLaserSharkTransferBuffer(unsigned int sample_count, unsigned char *buf)
+{
+	if (!initialized) {
+		return 0;
+	}
+
+	if (buf == NULL) {
+		std::cerr << "Layer fillLaserSharkTransferBuffer buff was null!" << std::endl;
+		return 0;
+	}
+
+	unsigned int count = 0;
+	while (count < sample_count && curr_tile < tiles.size()) {
+		LaserSharkZigZagLayer *layer = tiles[curr_tile].layer;
+		unsigned int tile_samples_left = layer->getSamplesLeft();
+		if (tile_samples_left == 0) {
+			curr_tile++;
+			continue;
+		}
+
+		unsigned int to_fill = std::min(sample_count - count, tile_samples_left);
+		count += layer->fillLaserSharkTransferBuffer(to_fill, buf + count*sizeof(laserSharkSample));
+		samples_left -= tile_samples_left - layer->getSamplesLeft();
+	}
+
+	return count;
+}
+
+
+unsigned int LaserSharkTiledLayer::getSamplesLeft()
+{
+	return samples_left;
+}
+
+
+unsigned int LaserSharkTiledLayer::getTotalSamples()
+{
+	return total_samples;
+}
+
+
+/*
+	Unlike the other layers the width and height include the tile origins, they cover everything the layer
+	draws.
+*/
+unsigned int LaserSharkTiledLayer::getWidth()
+{
+	return width;
+}
+
+
+unsigned int LaserSharkTiledLayer::getHeight()
+{
+	return height;
+}
+
+
+unsigned int LaserSharkTiledLayer::getInflateUs()
+{
+	return inflate_us;
+}
+
+
+void LaserSharkTiledLayer::setScanCompensation(int forward_offset, int reverse_offset, unsigned int ramp_samples)
+{
+	this->forward_offset = forward_offset;
+	this->reverse_offset = reverse_offset;
+	this->ramp_samples = ramp_samples;
+}
+
+
+void LaserSharkTiledLayer::setDwell(unsigned int max_repeats)
+{
+	dwell_max_repeats = max_repeats;
+}
+
+
+void LaserSharkTiledLayer::clear()
+{
+	for (unsigned int i = 0; i < tiles.size(); i++) {
+		delete tiles[i].layer;
+	}
+	tiles.clear();
+	curr_tile = 0;
+	width = 0;
+	height = 0;
+	total_samples = 0;
+	samples_left = 0;
+	initialized = false;
+	inflate_us = 0;
+}
+
+
+bool LaserSharkTiledLayer::populated()
+{
+	return initialized;
+}
+
+
+void LaserSharkTiledLayer::rewind()
+{
+	for (unsigned int i = 0; i < tiles.size(); i++) {
+		tiles[i].layer->rewind();
+	}
+	curr_tile = 0;
+	samples_left = total_samples;
+}
+
+
+bool LaserSharkTiledLayer::tileBefore(const Tile &a, const Tile &b)
+{
+	if (a.y_origin != b.y_origin) {
+		return a.y_origin < b.y_origin;
+	}
+	return a.x_origin < b.x_origin;
+}
@@ -0,0 +1,81 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LASERSHARKTILEDLAYER_H_
+#define _LASERSHARKTILEDLAYER_H_
+
+#include "AbstractLaserSharkLayer.h"
+#include "LaserSharkZigZagLayer.h"
+#include <vector>
+
+
+struct LaserSharkTile
+{
+	unsigned int x_origin, y_origin;
+	const unsigned char* png_image_data;
+	unsigned int png_image_data_len;
+};
+
+
+// Not intended to be thread safe.
+class LaserSharkTiledLayer : public AbstractLaserSharkLayer
+{
+	public:
+		LaserSharkTiledLayer();
+		~LaserSharkTiledLayer();
+		bool populate(unsigned int x_origin, unsigned int y_origin, const unsigned char* png_image_data, unsigned int png_image_data_len);
+		bool populate(const std::vector<LaserSharkTile> &tiles);
+		void clear();
+		bool populated();
+		void rewind();
+
+		unsigned int fillLaserSharkTransferBuffer(unsigned int sample_count, unsigned char *buf);
+		unsigned int getSamplesLeft();
+		unsigned int getTotalSamples();
+		unsigned int getWidth();
+		unsigned int getHeight();
+		unsigned int getInflateUs();
+
+		// These must be called before populate.
+		void setScanCompensation(int forward_offset, int reverse_offset, unsigned int ramp_samples);
+		void setDwell(unsigned int max_repeats);
+
+	private:
+		struct Tile
+		{
+			unsigned int x_origin, y_origin;
+			LaserSharkZigZagLayer *layer;
+		};
+
+		static bool tileBefore(const Tile &a, const Tile &b);
+
+		bool initialized;
+		unsigned int inflate_us;
+		std::vector<Tile> tiles;
+		unsigned int curr_tile;
+		unsigned int width, height;
+		unsigned int total_samples;
+		unsigned int samples_left;
+
+		int forward_offset, reverse_offset;
+		unsigned int ramp_samples;
+		unsigned int dwell_max_repeats;
+};
+
+#endif //_LASERSHARKTILEDLAYER_H_
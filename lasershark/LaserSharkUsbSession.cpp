@@ -0,0 +1,493 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LaserSharkUsbSession.h"
+#include <iostream>
+#include <sstream>
+#include "metrics/Trace.h"
+#include "debug.h"
+
+
+#define LASERSHARK_VIN 0x1fc9
+#define LASERSHARK_PID 0x04d8
+
+#define LASERSHARK_INTERFACE_COUNT 3
+#define LASERSHARK_DATA_INTERFACE 1
+
+// How long the event thread blocks in libusb at a time, this bounds how long stopping it takes.
+#define LASERSHARK_USB_EVENT_TIMEOUT_US 100000
+
+// How often a thread waiting on a transfer checks whether it should be cancelled.
+#define LASERSHARK_USB_TRANSFER_POLL_US 5000
+
+
+LaserSharkUsbSession::LaserSharkUsbSession()
+{
+	open_count = 0;
+	devh = NULL;
+	interfaces_claimed = 0;
+	attached = true;
+	bus_busy = false;
+	for (int i = 0; i < PRIORITY_COUNT; i++) {
+		bus_waiting[i] = 0;
+	}
+	event_thread = NULL;
+	event_thread_should_exit = false;
+	hotplug_registered = false;
+	hotplug_handle = 0;
+	next_listener_id = 0;
+}
+
+
+LaserSharkUsbSession::~LaserSharkUsbSession()
+{
+	stopEventThread();
+	open_mutex.lock();
+	release();
+	open_mutex.unlock();
+}
+
+
+/*
+	Opens the device the first time it is called and just counts later calls, each needs a matching close.
+	Returns false if no device was found. Throws errors if an interface could not be set up.
+	libusb is expected to have been initialized before calling this.
+*/
+bool LaserSharkUsbSession::open() throw (std::runtime_error)
+{
+	open_mutex.lock();
+	if (open_count) {
+		open_count++;
+		open_mutex.unlock();
+		return true;
+	}
+
+	try {
+		if (!openDevice()) {
+			// No device
+			open_mutex.unlock();
+			return false;
+		}
+	} catch (std::runtime_error e) {
+		open_mutex.unlock();
+		throw;
+	}
+	attached = true;
+
+	open_count = 1;
+	open_mutex.unlock();
+
+	D(std::cout << "USB session opened" << std::endl;)
+	return true;
+}
+
+
+void LaserSharkUsbSession::close()
+{
+	open_mutex.lock();
+	if (open_count && --open_count == 0) {
+		release();
+		D(std::cout << "USB session closed" << std::endl;)
+	}
+	open_mutex.unlock();
+}
+
+
+bool LaserSharkUsbSession::isOpen()
+{
+	return open_count != 0;
+}
+
+
+/*
+	False from the device being unplugged while open until it is reopened. Transfers fail in the meantime.
+*/
+bool LaserSharkUsbSession::isAttached()
+{
+	return attached;
+}
+
+
+struct libusb_device_handle *LaserSharkUsbSession::getHandle()
+{
+	return devh;
+}
+
+
+/*
+	Waits until the bus is free and nobody of a higher priority is waiting for it. Must be paired with unlock.
+*/
+void LaserSharkUsbSession::lock(Priority priority)
+{
+	TraceScope trace("bus_lock_wait", "usb", priority);
+	std::unique_lock<std::mutex> lock(bus_mutex);
+	bus_waiting[priority]++;
+	while (true) {
+		bool higher_waiting = false;
+		for (int i = 0; i < priority; i++) {
+			if (bus_waiting[i]) {
+				higher_waiting = true;
+			}
+		}
+		if (!bus_busy && !higher_waiting) {
+			break;
+		}
+		bus_cv.wait(lock);
+	}
+	bus_waiting[priority]--;
+	bus_busy = true;
+}
+
+
+void LaserSharkUsbSession::unlock()
+{
+	bus_mutex.lock();
+	bus_busy = false;
+	bus_cv.notify_all();
+	bus_mutex.unlock();
+}
+
+
+/*
+	A bulk transfer that gives up after timeout_ms, and that is cancelled as soon as keep_running goes false if
+	it is given. Returns 0 or a libusb error, LIBUSB_ERROR_TIMEOUT and LIBUSB_ERROR_INTERRUPTED for those two.
+	The calling thread handles libusb events while it waits, so this works without the event thread too.
+	A thread that transfers often can pass a transfer of its own from libusb_alloc_transfer in reuse, which is
+	refilled each time instead of one being allocated and freed per call.
+*/
+int LaserSharkUsbSession::transfer(unsigned char endpoint, unsigned char *data, int length, int *actual,
+	unsigned int timeout_ms, const std::atomic<bool> *keep_running, struct libusb_transfer *reuse)
+{
+	*actual = 0;
+
+	struct libusb_transfer *xfer = reuse ? reuse : libusb_alloc_transfer(0);
+	if (!xfer) {
+		return LIBUSB_ERROR_NO_MEM;
+	}
+
+	int completed = 0;
+	libusb_fill_bulk_transfer(xfer, devh, endpoint, data, length, &LaserSharkUsbSession::transferCallback,
+		&completed, timeout_ms);
+	int rc = libusb_submit_transfer(xfer);
+	if (rc < 0) {
+		if (!reuse) {
+			libusb_free_transfer(xfer);
+		}
+		return rc;
+	}
+
+	bool cancelled = false;
+	while (!completed) {
+		if (!cancelled && keep_running && !*keep_running) {
+			libusb_cancel_transfer(xfer);
+			cancelled = true;
+		}
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = LASERSHARK_USB_TRANSFER_POLL_US;
+		libusb_handle_events_timeout_completed(NULL, &tv, &completed);
+	}
+
+	*actual = xfer->actual_length;
+	switch (xfer->status) {
+		case LIBUSB_TRANSFER_COMPLETED:
+			rc = 0;
+			break;
+		case LIBUSB_TRANSFER_TIMED_OUT:
+			rc = LIBUSB_ERROR_TIMEOUT;
+			break;
+		case LIBUSB_TRANSFER_CANCELLED:
+			rc = LIBUSB_ERROR_INTERRUPTED;
+			break;
+		case LIBUSB_TRANSFER_STALL:
+			rc = LIBUSB_ERROR_PIPE;
+			break;
+		case LIBUSB_TRANSFER_NO_DEVICE:
+			rc = LIBUSB_ERROR_NO_DEVICE;
+			break;
+		case LIBUSB_TRANSFER_OVERFLOW:
+			rc = LIBUSB_ERROR_OVERFLOW;
+			break;
+		default:
+			rc = LIBUSB_ERROR_IO;
+			break;
+	}
+	if (!reuse) {
+		libusb_free_transfer(xfer);
+	}
+
+	return rc;
+}
+
+
+void LIBUSB_CALL LaserSharkUsbSession::transferCallback(struct libusb_transfer *transfer)
+{
+	*(int*)transfer->user_data = 1;
+}
+
+
+/*
+	Starts the libusb event thread and, if libusb supports it on this platform, watches for the device being
+	unplugged and plugged back in. Returns false if hotplug isn't supported.
+*/
+bool LaserSharkUsbSession::startEventThread() throw (std::runtime_error)
+{
+	if (event_thread) {
+		return hotplug_registered;
+	}
+
+	if (libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)) {
+		int rc = libusb_hotplug_register_callback(NULL,
+			(libusb_hotplug_event)(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+			LIBUSB_HOTPLUG_NO_FLAGS, LASERSHARK_VIN, LASERSHARK_PID, LIBUSB_HOTPLUG_MATCH_ANY,
+			&LaserSharkUsbSession::hotplugCallback, this, &hotplug_handle);
+		if (rc == LIBUSB_SUCCESS) {
+			hotplug_registered = true;
+		} else {
+			std::cerr << "Error registering USB hotplug callback: " << libusb_error_name(rc) << std::endl;
+		}
+	}
+
+	event_thread_should_exit = false;
+	try {
+		event_thread = new std::thread(&LaserSharkUsbSession::eventThread, this);
+	} catch (std::system_error e) {
+		if (hotplug_registered) {
+			libusb_hotplug_deregister_callback(NULL, hotplug_handle);
+			hotplug_registered = false;
+		}
+		std::ostringstream oss;
+		oss << "Error allocating thread: " << e.what();
+		throw std::runtime_error(oss.str());
+	}
+
+	return hotplug_registered;
+}
+
+
+/*
+	Must be called before libusb_exit.
+*/
+void LaserSharkUsbSession::stopEventThread()
+{
+	if (!event_thread) {
+		return;
+	}
+
+	if (hotplug_registered) {
+		libusb_hotplug_deregister_callback(NULL, hotplug_handle);
+		hotplug_registered = false;
+	}
+
+	event_thread_should_exit = true;
+	event_thread->join();
+	delete event_thread;
+	event_thread = NULL;
+}
+
+
+/*
+	Returns an id for removeHotplugListener. Listeners must be removed before whatever they call is destroyed.
+*/
+int LaserSharkUsbSession::addHotplugListener(const HotplugListener &listener)
+{
+	listener_mutex.lock();
+	int id = next_listener_id++;
+	listeners[id] = listener;
+	listener_mutex.unlock();
+	return id;
+}
+
+
+void LaserSharkUsbSession::removeHotplugListener(int id)
+{
+	listener_mutex.lock();
+	listeners.erase(id);
+	listener_mutex.unlock();
+}
+
+
+/*
+	libusb doesn't allow transfers from within its callbacks, so the event is only queued here and handled once
+	the event thread is back out of libusb.
+*/
+int LIBUSB_CALL LaserSharkUsbSession::hotplugCallback(libusb_context *ctx, libusb_device *device,
+	libusb_hotplug_event event, void *user_data)
+{
+	LaserSharkUsbSession *session = (LaserSharkUsbSession*)user_data;
+	session->hotplug_mutex.lock();
+	session->hotplug_events.push_back(event);
+	session->hotplug_mutex.unlock();
+	return 0;
+}
+
+
+void LaserSharkUsbSession::eventThread()
+{
+	D(std::cout << "USB event thread starting" << std::endl;)
+
+	while (!event_thread_should_exit) {
+		struct timeval tv;
+		tv.tv_sec = 0;
+		tv.tv_usec = LASERSHARK_USB_EVENT_TIMEOUT_US;
+		libusb_handle_events_timeout_completed(NULL, &tv, NULL);
+		handleHotplugEvents();
+	}
+
+	D(std::cout << "USB event thread exiting" << std::endl;)
+}
+
+
+void LaserSharkUsbSession::handleHotplugEvents()
+{
+	hotplug_mutex.lock();
+	std::vector<libusb_hotplug_event> events;
+	events.swap(hotplug_events);
+	hotplug_mutex.unlock();
+
+	for (unsigned int i = 0; i < events.size(); i++) {
+		if (events[i] == LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT) {
+			if (!attached) {
+				continue;
+			}
+			std::cerr << "LaserShark detached." << std::endl;
+			attached = false;
+			notifyHotplugListeners(HOTPLUG_DETACHED);
+		} else if (!attached) {
+			bool reopened = false;
+			try {
+				reopened = swapHandle();
+			} catch (std::runtime_error e) {
+				std::cerr << e.what() << std::endl;
+			}
+
+			if (reopened) {
+				std::cerr << "LaserShark reattached." << std::endl;
+				notifyHotplugListeners(HOTPLUG_ATTACHED);
+			} else {
+				std::cerr << "LaserShark reattached but could not be reopened." << std::endl;
+			}
+		}
+	}
+}
+
+
+/*
+	Closes and reopens the device handle, for recovering from transfer errors that left the device plugged in.
+	Listeners are told the handle was reopened. Returns false if the device couldn't be opened again.
+	Nothing may be streaming when this is called.
+*/
+bool LaserSharkUsbSession::reopen() throw (std::runtime_error)
+{
+	if (!swapHandle()) {
+		return false;
+	}
+	notifyHotplugListeners(HOTPLUG_REOPENED);
+	return true;
+}
+
+
+/*
+	The old handle is swapped under the bus lock so no exchange is using it. Streaming on it must have already
+	been stopped.
+*/
+bool LaserSharkUsbSession::swapHandle() throw (std::runtime_error)
+{
+	lock(PRIORITY_STREAM);
+	open_mutex.lock();
+	bool reopened = true;
+	try {
+		if (open_count) {
+			release();
+			reopened = openDevice();
+		}
+	} catch (std::runtime_error e) {
+		attached = false;
+		open_mutex.unlock();
+		unlock();
+		throw;
+	}
+	attached = reopened;
+	open_mutex.unlock();
+	unlock();
+
+	return reopened;
+}
+
+
+void LaserSharkUsbSession::notifyHotplugListeners(HotplugEvent event)
+{
+	listener_mutex.lock();
+	for (std::map<int, HotplugListener>::iterator it = listeners.begin(); it != listeners.end(); it++) {
+		it->second(event);
+	}
+	listener_mutex.unlock();
+}
+
+
+/*
+	Opens the device and sets up its interfaces. open_mutex must be held when calling this.
+*/
+bool LaserSharkUsbSession::openDevice() throw (std::runtime_error)
+{
+	int rc;
+
+	devh = libusb_open_device_with_vid_pid(NULL, LASERSHARK_VIN, LASERSHARK_PID);
+	if (!devh) {
+		return false;
+	}
+
+	libusb_set_debug(NULL, 3);
+
+	for (int i = 0; i < LASERSHARK_INTERFACE_COUNT; i++) {
+		rc = libusb_claim_interface(devh, i);
+		if (rc < 0) {
+			release();
+
+			std::ostringstream oss;
+			oss << "Error claiming interface " << i << ": " << libusb_error_name(rc);
+			throw std::runtime_error(oss.str());
+		}
+		interfaces_claimed++;
+	}
+
+	// Use the following if you want to use BULK transfers instead of ISO transfers in your hostapp code.
+	rc = libusb_set_interface_alt_setting(devh, LASERSHARK_DATA_INTERFACE, 1);
+	if (rc < 0) {
+		release();
+
+		std::ostringstream oss;
+		oss << "Error setting alternative (BULK) data interface: " << libusb_error_name(rc);
+		throw std::runtime_error(oss.str());
+	}
+
+	return true;
+}
+
+
+void LaserSharkUsbSession::release()
+{
+	while (interfaces_claimed) {
+		libusb_release_interface(devh, --interfaces_claimed);
+	}
+	if (devh) {
+		libusb_close(devh);
+		devh = NULL;
+	}
+}
@@ -0,0 +1,125 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LASERSHARKUSBSESSION_H_
+#define _LASERSHARKUSBSESSION_H_
+
+#include <libusb-1.0/libusb.h>
+#include <stdexcept>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <vector>
+
+
+/*
+	Owns the one libusb handle to a LaserShark with all of its interfaces claimed: control (0), sample data (1)
+	and the uart bridge (2) a TwoStep hangs off. LaserShark and TwoStep both open the session, and the device is
+	only closed once the last of them closes it.
+
+	Control and uart bridge exchanges are served by the same firmware, so each one takes the bus lock at a
+	priority. Commands the push thread needs to keep the stream going are let through ahead of stepper and
+	laser commands, and those ahead of status queries. Sample data has its own endpoint and isn't locked.
+
+	The event thread runs the libusb event loop, for async transfer completions and hotplug. If the device goes
+	away while the session is open, listeners are told it was detached, and when it comes back the session
+	reopens it before telling them it was attached so they can restore their settings.
+*/
+class LaserSharkUsbSession
+{
+	public:
+		enum Priority {
+			PRIORITY_STREAM,
+			PRIORITY_COMMAND,
+			PRIORITY_STATUS,
+			PRIORITY_COUNT
+		};
+
+		enum HotplugEvent {
+			HOTPLUG_DETACHED,
+			HOTPLUG_ATTACHED,
+			HOTPLUG_REOPENED // The handle was reopened, but the device itself wasn't unplugged.
+		};
+
+		// Called on the event thread, not from within libusb, so transfers can be made.
+		typedef std::function<void(HotplugEvent event)> HotplugListener;
+
+		LaserSharkUsbSession();
+		~LaserSharkUsbSession();
+
+		bool open() throw (std::runtime_error);
+		void close();
+		bool isOpen();
+		bool isAttached();
+
+		struct libusb_device_handle *getHandle();
+
+		void lock(Priority priority);
+		void unlock();
+
+		int transfer(unsigned char endpoint, unsigned char *data, int length, int *actual, unsigned int timeout_ms,
+			const std::atomic<bool> *keep_running = NULL, struct libusb_transfer *reuse = NULL);
+
+		bool reopen() throw (std::runtime_error);
+
+		bool startEventThread() throw (std::runtime_error);
+		void stopEventThread();
+
+		int addHotplugListener(const HotplugListener &listener);
+		void removeHotplugListener(int id);
+
+	private:
+		static int LIBUSB_CALL hotplugCallback(libusb_context *ctx, libusb_device *device,
+			libusb_hotplug_event event, void *user_data);
+		static void LIBUSB_CALL transferCallback(struct libusb_transfer *transfer);
+
+		void release();
+		bool openDevice() throw (std::runtime_error);
+		bool swapHandle() throw (std::runtime_error);
+		void eventThread();
+		void handleHotplugEvents();
+		void notifyHotplugListeners(HotplugEvent event);
+
+		std::mutex open_mutex;
+		unsigned int open_count;
+		struct libusb_device_handle *devh;
+		int interfaces_claimed;
+		std::atomic<bool> attached;
+
+		std::mutex bus_mutex;
+		std::condition_variable bus_cv;
+		bool bus_busy;
+		unsigned int bus_waiting[PRIORITY_COUNT];
+
+		std::thread *event_thread;
+		std::atomic<bool> event_thread_should_exit;
+		bool hotplug_registered;
+		libusb_hotplug_callback_handle hotplug_handle;
+		std::mutex hotplug_mutex;
+		std::vector<libusb_hotplug_event> hotplug_events;
+
+		std::mutex listener_mutex;
+		std::map<int, HotplugListener> listeners;
+		int next_listener_id;
+};
+
+#endif //_LASERSHARKUSBSESSION_H_
@@ -0,0 +1,451 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "LaserSharkVectorLayer.h"
+#include "LaserSharkSample.h"
+#include "lodepng.h"
+#include <iostream>
+#include <chrono>
+#include <algorithm>
+#include <cmath>
+#include "debug.h"
+
+// Galvo step per sample (in pixels) while the laser is on and while blanking.
+#define LASERSHARK_VECTOR_DEFAULT_LIT_STEP 1.0f
+#define LASERSHARK_VECTOR_DEFAULT_BLANK_STEP 8.0f
+
+#define LASERSHARK_VECTOR_DEFAULT_CORNER_DWELL_SAMPLES 2
+#define LASERSHARK_VECTOR_DEFAULT_CORNER_MIN_ANGLE 45.0f
+#define LASERSHARK_VECTOR_DEFAULT_BLANK_SETTLE_SAMPLES 4
+
+// 2-opt is O(n^2) per pass, past this many paths nearest neighbour ordering is used alone.
+#define LASERSHARK_VECTOR_MAX_TWO_OPT_PATHS 2000
+#define LASERSHARK_VECTOR_MAX_TWO_OPT_PASSES 20
+
+#define LASERSHARK_VECTOR_PI 3.14159265358979f
+
+
+static float pointDistance(const LaserSharkVectorPoint &a, const LaserSharkVectorPoint &b)
+{
+	float dx = a.x - b.x;
+	float dy = a.y - b.y;
+	return sqrtf(dx*dx + dy*dy);
+}
+
+
+LaserSharkVectorLayer::LaserSharkVectorLayer()
+{
+	lit_step = LASERSHARK_VECTOR_DEFAULT_LIT_STEP;
+	blank_step = LASERSHARK_VECTOR_DEFAULT_BLANK_STEP;
+	corner_dwell_samples = LASERSHARK_VECTOR_DEFAULT_CORNER_DWELL_SAMPLES;
+	corner_min_angle = LASERSHARK_VECTOR_DEFAULT_CORNER_MIN_ANGLE;
+	blank_settle_samples = LASERSHARK_VECTOR_DEFAULT_BLANK_SETTLE_SAMPLES;
+	intensity = 0xFF;
+	preprocessor = NULL;
+	clear();
+}
+
+
+/*
+	Extracts vectors (outlines and any hatching) from the png using the preprocessor set with setPreprocessor,
+	or a single threaded one if none was set.
+*/
+bool LaserSharkVectorLayer::populate(unsigned int x_origin, unsigned int y_origin, const unsigned char* png_image_data, unsigned int png_image_data_len)
+{
+	if (initialized) {
+	    std::cerr << "Layer is populated, can't re-populate." << std::endl;
+		return false;
+	}
+
+	std::vector<unsigned char> image;
+	unsigned int image_width, image_height;
+	std::chrono::steady_clock::time_point inflate_start = std::chrono::steady_clock::now();
+    unsigned error = lodepng::decode(image, image_width, image_height, png_image_data, png_image_data_len, LCT_GREY, 8);
+	inflate_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - inflate_start).count();
+
+    if(error) {
+		std::cerr << "Layer decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+		return false;
+	}
+
+	std::vector<LaserSharkPolyline> polylines;
+	bool processed;
+	if (preprocessor) {
+		processed = preprocessor->process(image, image_width, image_height, polylines);
+	} else {
+		LaserSharkLayerPreprocessor local_preprocessor(1);
+		processed = local_preprocessor.process(image, image_width, image_height, polylines);
+	}
+	if (!processed) {
+		return false;
+	}
+
+	if (!populate(x_origin, y_origin, polylines)) {
+		return false;
+	}
+
+	// Report the png's dimensions rather than the traced extents so layers line up with the zig zag layer.
+	width = image_width;
+	height = image_height;
+
+	return true;
+}
+
+
+bool LaserSharkVectorLayer::populate(unsigned int x_origin, unsigned int y_origin, const std::vector<LaserSharkPolyline> &polylines)
+{
+	if (initialized) {
+	    std::cerr << "Layer is populated, can't re-populate." << std::endl;
+		return false;
+	}
+
+	paths.clear();
+	width = 0;
+	height = 0;
+	for (unsigned int i = 0; i < polylines.size(); i++) {
+		if (polylines[i].empty()) {
+			continue;
+		}
+		for (unsigned int j = 0; j < polylines[i].size(); j++) {
+			const LaserSharkVectorPoint &p = polylines[i][j];
+			if (p.x < 0 || p.y < 0) {
+				std::cerr << "Layer polyline point was negative!" << std::endl;
+				clear();
+				return false;
+			}
+			if ((unsigned int)ceilf(p.x) + 1 > width) {
+				width = (unsigned int)ceilf(p.x) + 1;
+			}
+			if ((unsigned int)ceilf(p.y) + 1 > height) {
+				height = (unsigned int)ceilf(p.y) + 1;
+			}
+		}
+		paths.push_back(polylines[i]);
+	}
+
+	if (paths.empty()) {
+		std::cerr << "Layer was empty!" << std::endl;
+		clear();
+		return false;
+	}
+
+	this->x_origin = x_origin;
+	this->y_origin = y_origin;
+
+	orderPaths();
+	buildSamples();
+
+	// The paths aren't needed once the samples exist.
+	paths.clear();
+
+	initialized = true;
+	curr_sample = 0;
+
+    D(std::cout << "Vector layer total_samples:" << samples.size() << std::endl;)
+
+	return true;
+}
+
+
+unsigned int LaserSharkVectorLayer::fillLaserSharkTransferBuffer(unsigned int sample_count, unsigned char *buf)
+{
+	if (!initialized) {
+		return 0;
+	}
+
+	if (buf == NULL) {
+		std::cerr << "Layer fillLaserSharkTransferBuffer buff was null!" << std::endl;
+		return 0;
+	}
+
+	if (sample_count > getSamplesLeft()) {
+		sample_count = getSamplesLeft();
+	}
+
+	laserSharkSample *sample = (laserSharkSample*)buf;
+	for (unsigned int count = 0; count < sample_count; count++) {
+		const VectorSample &s = samples[curr_sample++];
+		setLaserSharkSample(sample[count], s.lit ? intensity : 0, s.x + x_origin, s.y + y_origin);
+	}
+
+	return sample_count;
+}
+
+
+unsigned int LaserSharkVectorLayer::getSamplesLeft()
+{
+	return samples.size() - curr_sample;
+}
+
+
+unsigned int LaserSharkVectorLayer::getTotalSamples()
+{
+	return samples.size();
+}
+
+
+unsigned int LaserSharkVectorLayer::getWidth()
+{
+	return width;
+}
+
+
+unsigned int LaserSharkVectorLayer::getHeight()
+{
+	return height;
+}
+
+
+unsigned int LaserSharkVectorLayer::getInflateUs()
+{
+	return inflate_us;
+}
+
+
+void LaserSharkVectorLayer::setMaxStep(float lit_step, float blank_step)
+{
+	if (lit_step > 0) {
+		this->lit_step = lit_step;
+	}
+	if (blank_step > 0) {
+		this->blank_step = blank_step;
+	}
+}
+
+
+/*
+	Vertices where the path turns by at least min_angle_degrees are held for dwell_samples extra samples
+	so the galvos can catch up before the next segment starts.
+*/
+void LaserSharkVectorLayer::setCornerDwell(unsigned int dwell_samples, float min_angle_degrees)
+{
+	corner_dwell_samples = dwell_samples;
+	corner_min_angle = min_angle_degrees;
+}
+
+
+/*
+	Number of blanked samples held at the start of a path after a jump, letting the galvos settle.
+*/
+void LaserSharkVectorLayer::setBlankSettle(unsigned int settle_samples)
+{
+	blank_settle_samples = settle_samples;
+}
+
+
+void LaserSharkVectorLayer::setIntensity(unsigned char intensity)
+{
+	this->intensity = intensity;
+}
+
+
+/*
+	The preprocessor is not owned by the layer and must outlive populate.
+*/
+void LaserSharkVectorLayer::setPreprocessor(LaserSharkLayerPreprocessor *preprocessor)
+{
+	this->preprocessor = preprocessor;
+}
+
+
+void LaserSharkVectorLayer::clear()
+{
+	paths.clear();
+	samples.clear();
+	width = 0;
+	height = 0;
+	x_origin = 0;
+	y_origin = 0;
+	curr_sample = 0;
+	initialized = false;
+	inflate_us = 0;
+}
+
+
+bool LaserSharkVectorLayer::populated()
+{
+	return initialized;
+}
+
+
+void LaserSharkVectorLayer::rewind()
+{
+	curr_sample = 0;
+}
+
+
+/*
+	Orders the paths to minimize blanked travel. A greedy nearest neighbour pass picks the next path (and
+	which end to enter it from), then 2-opt passes reverse runs of paths while that shortens the travel.
+*/
+void LaserSharkVectorLayer::orderPaths()
+{
+	unsigned int n = paths.size();
+	if (n < 2) {
+		return;
+	}
+
+	std::vector<unsigned int> order;
+	std::vector<bool> reversed;
+	std::vector<bool> used(n, false);
+	LaserSharkVectorPoint pos = { 0, 0 };
+
+	for (unsigned int k = 0; k < n; k++) {
+		unsigned int best = 0;
+		bool best_reversed = false;
+		float best_dist = -1;
+		for (unsigned int i = 0; i < n; i++) {
+			if (used[i]) {
+				continue;
+			}
+			float d = pointDistance(pos, paths[i].front());
+			if (best_dist < 0 || d < best_dist) {
+				best = i;
+				best_reversed = false;
+				best_dist = d;
+			}
+			d = pointDistance(pos, paths[i].back());
+			if (d < best_dist) {
+				best = i;
+				best_reversed = true;
+				best_dist = d;
+			}
+		}
+		used[best] = true;
+		order.push_back(best);
+		reversed.push_back(best_reversed);
+		pos = best_reversed ? paths[best].front() : paths[best].back();
+	}
+
+	if (n <= LASERSHARK_VECTOR_MAX_TWO_OPT_PATHS) {
+		LaserSharkVectorPoint origin = { 0, 0 };
+		bool improved = true;
+		for (unsigned int pass = 0; improved && pass < LASERSHARK_VECTOR_MAX_TWO_OPT_PASSES; pass++) {
+			improved = false;
+			for (unsigned int i = 0; i < n - 1; i++) {
+				const LaserSharkVectorPoint &prev_end = i == 0 ? origin :
+					(reversed[i-1] ? paths[order[i-1]].front() : paths[order[i-1]].back());
+				const LaserSharkVectorPoint &i_start = reversed[i] ? paths[order[i]].back() : paths[order[i]].front();
+
+				for (unsigned int j = i + 1; j < n; j++) {
+					const LaserSharkVectorPoint &j_end = reversed[j] ? paths[order[j]].front() : paths[order[j]].back();
+					float before = pointDistance(prev_end, i_start);
+					float after = pointDistance(prev_end, j_end);
+					if (j + 1 < n) {
+						const LaserSharkVectorPoint &next_start = reversed[j+1] ?
+							paths[order[j+1]].back() : paths[order[j+1]].front();
+						before += pointDistance(j_end, next_start);
+						after += pointDistance(i_start, next_start);
+					}
+
+					if (after + 0.001f < before) {
+						// Reverse the run, which also flips the direction each path is traversed in.
+						for (unsigned int a = i, b = j; a < b; a++, b--) {
+							std::swap(order[a], order[b]);
+							bool tmp = reversed[a];
+							reversed[a] = reversed[b];
+							reversed[b] = tmp;
+						}
+						for (unsigned int a = i; a <= j; a++) {
+							reversed[a] = !reversed[a];
+						}
+						improved = true;
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	std::vector<LaserSharkPolyline> ordered(n);
+	for (unsigned int k = 0; k < n; k++) {
+		ordered[k].swap(paths[order[k]]);
+		if (reversed[k]) {
+			std::reverse(ordered[k].begin(), ordered[k].end());
+		}
+	}
+	paths.swap(ordered);
+}
+
+
+void LaserSharkVectorLayer::buildSamples()
+{
+	samples.clear();
+
+	float pos_x = 0, pos_y = 0;
+	float cos_limit = cosf(corner_min_angle * LASERSHARK_VECTOR_PI / 180.0f);
+
+	for (unsigned int i = 0; i < paths.size(); i++) {
+		const LaserSharkPolyline &path = paths[i];
+
+		// Blank jump to the start of the path.
+		appendLine(pos_x, pos_y, path[0].x, path[0].y, blank_step, false);
+		appendDwell(path[0].x, path[0].y, blank_settle_samples, false);
+		appendDwell(path[0].x, path[0].y, 1, true);
+
+		for (unsigned int j = 1; j < path.size(); j++) {
+			appendLine(path[j-1].x, path[j-1].y, path[j].x, path[j].y, lit_step, true);
+
+			if (j + 1 < path.size() && corner_dwell_samples) {
+				float ax = path[j].x - path[j-1].x, ay = path[j].y - path[j-1].y;
+				float bx = path[j+1].x - path[j].x, by = path[j+1].y - path[j].y;
+				float la = sqrtf(ax*ax + ay*ay), lb = sqrtf(bx*bx + by*by);
+				// The turn angle is the angle between the incoming and outgoing segment directions.
+				if (la > 0 && lb > 0 && (ax*bx + ay*by) / (la*lb) <= cos_limit) {
+					appendDwell(path[j].x, path[j].y, corner_dwell_samples, true);
+				}
+			}
+		}
+
+		pos_x = path.back().x;
+		pos_y = path.back().y;
+	}
+
+	// Leave the laser off at the end of the layer.
+	appendDwell(pos_x, pos_y, 1, false);
+}
+
+
+/*
+	Appends samples from (but not including) x0,y0 through x1,y1, spaced no more than step apart.
+*/
+void LaserSharkVectorLayer::appendLine(float x0, float y0, float x1, float y1, float step, bool lit)
+{
+	float len = sqrtf((x1 - x0)*(x1 - x0) + (y1 - y0)*(y1 - y0));
+	unsigned int steps = (unsigned int)ceilf(len / step);
+
+	for (unsigned int k = 1; k <= steps; k++) {
+		float t = (float)k / steps;
+		VectorSample s;
+		s.x = (unsigned short)lroundf(x0 + (x1 - x0)*t);
+		s.y = (unsigned short)lroundf(y0 + (y1 - y0)*t);
+		s.lit = lit;
+		samples.push_back(s);
+	}
+}
+
+
+void LaserSharkVectorLayer::appendDwell(float x, float y, unsigned int count, bool lit)
+{
+	VectorSample s;
+	s.x = (unsigned short)lroundf(x);
+	s.y = (unsigned short)lroundf(y);
+	s.lit = lit;
+	samples.insert(samples.end(), count, s);
+}
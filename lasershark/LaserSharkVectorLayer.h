@@ -0,0 +1,82 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LASERSHARKVECTORLAYER_H_
+#define _LASERSHARKVECTORLAYER_H_
+
+#include "AbstractLaserSharkLayer.h"
+#include "LaserSharkPolyline.h"
+#include "LaserSharkLayerPreprocessor.h"
+#include <vector>
+
+
+// Not intended to be thread safe.
+class LaserSharkVectorLayer : public AbstractLaserSharkLayer
+{
+	public:
+		LaserSharkVectorLayer();
+		bool populate(unsigned int x_origin, unsigned int y_origin, const unsigned char* png_image_data, unsigned int png_image_data_len);
+		bool populate(unsigned int x_origin, unsigned int y_origin, const std::vector<LaserSharkPolyline> &polylines);
+		void clear();
+		bool populated();
+		void rewind();
+
+		unsigned int fillLaserSharkTransferBuffer(unsigned int sample_count, unsigned char *buf);
+		unsigned int getSamplesLeft();
+		unsigned int getTotalSamples();
+		unsigned int getWidth();
+		unsigned int getHeight();
+		unsigned int getInflateUs();
+
+		// These must be called before populate.
+		void setMaxStep(float lit_step, float blank_step);
+		void setCornerDwell(unsigned int dwell_samples, float min_angle_degrees);
+		void setBlankSettle(unsigned int settle_samples);
+		void setIntensity(unsigned char intensity);
+		void setPreprocessor(LaserSharkLayerPreprocessor *preprocessor);
+
+	private:
+		struct VectorSample
+		{
+			unsigned short x, y;
+			bool lit;
+		};
+
+		void orderPaths();
+		void buildSamples();
+		void appendLine(float x0, float y0, float x1, float y1, float step, bool lit);
+		void appendDwell(float x, float y, unsigned int count, bool lit);
+
+		bool initialized;
+		unsigned int inflate_us;
+		unsigned int width, height;
+		unsigned int x_origin, y_origin;
+		std::vector<LaserSharkPolyline> paths;
+		std::vector<VectorSample> samples;
+		unsigned int curr_sample;
+
+		float lit_step, blank_step;
+		unsigned int corner_dwell_samples;
+		float corner_min_angle;
+		unsigned int blank_settle_samples;
+		unsigned char intensity;
+		LaserSharkLayerPreprocessor *preprocessor;
+};
+
+#endif //_LASERSHARKVECTORLAYER_H_
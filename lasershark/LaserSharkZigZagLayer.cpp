@@ -18,8 +18,11 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "LaserSharkZigZagLayer.h"
+#include "LaserSharkSample.h"
 #include "lodepng.h"
 #include <iostream>
+#include <chrono>
+#include <climits>
 #include "debug.h"
 
 /*
@@ -31,6 +34,12 @@ todo: Improve memory efficiency
 
 LaserSharkZigZagLayer::LaserSharkZigZagLayer()
 {
+	forward_offset = 0;
+	reverse_offset = 0;
+	ramp_samples = 0;
+	dwell_max_repeats = 1;
+	dwell_map_width = 0;
+	dwell_map_height = 0;
 	clear();
 }
 
@@ -44,7 +53,9 @@ bool LaserSharkZigZagLayer::populate(unsigned int x_origin, unsigned int y_origi
 
 
 	// TODO allow option to not use 16 bits.
+	std::chrono::steady_clock::time_point inflate_start = std::chrono::steady_clock::now();
     unsigned error = lodepng::decode(image, width, height, png_image_data, png_image_data_len, LCT_GREY, 8); 
+	inflate_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - inflate_start).count();
 
     //if there's an error, display it
     if(error) {
@@ -64,16 +75,38 @@ bool LaserSharkZigZagLayer::populate(unsigned int x_origin, unsigned int y_origi
 	}
 
 
+	if (!dwell_map.empty() && (dwell_map_width != width || dwell_map_height != height)) {
+		std::cerr << "Layer dwell map dimensions did not match the layer!" << std::endl;
+		clear();
+		return false;
+	}
+
+
 	initialized = true;
+	this->x_origin = x_origin;
+	this->y_origin = y_origin;
 	curr_x_pos = 0;
 	curr_y_pos = 0;
+	ramp_pos = 0;
+	scan_phase = ramp_samples ? SCAN_PHASE_RAMP_IN : SCAN_PHASE_ROW;
+	dwell_pos = 0;
+	buildScanTables();
+	buildDwellTable();
 
+	unsigned long long samples = 0;
 	for (unsigned int i = total_samples; i > 0; i--) {
-			if (0 == image[i-1]) {
-				total_samples--;
+			if (0 != image[i-1]) {
+				samples += getPixelRepeats(i-1);
 			}
 	}
 
+	if (samples > UINT_MAX) {
+		std::cerr << "Layer has too many samples with this dwell!" << std::endl;
+		clear();
+		return false;
+	}
+	total_samples = samples;
+
     D(std::cout << "Layer total_samples:" << total_samples  << std::endl;)
 
 	samples_left = total_samples;
@@ -98,15 +131,7 @@ bool LaserSharkZigZagLayer::populate(unsigned int x_origin, unsigned int y_origi
 
 
 /*
-This function is only compatible with Lasershark V2.X modules. The format is a 16 byte (little endian) array of 4 elements
-[0] = Channel A output (lower 12 bits), LASERSHARK_C_BITMASK field(0x4000), LASERSHARK_INTL_A_BITMASK(0x8000)
-[1] = Channel B output (lower 12 bits)
-[2] = X Galvo output (lower 12 bits)
-[3] = Y Galvo output (lower 12 bits).
-
-It's pretty messy... A version command should probably be added to the protocol and a check added so this can be used
-with multiple different lasershark versions... but for now, it's good enough.
-
+Fills buf with sample_count samples, see LaserSharkSample.h for the sample format.
 */
 unsigned int LaserSharkZigZagLayer::fillLaserSharkTransferBuffer(unsigned int sample_count, unsigned char *buf)
 {
@@ -119,16 +144,7 @@ unsigned int LaserSharkZigZagLayer::fillLaserSharkTransferBuffer(unsigned int sa
 		return 0; // TODO throw error?
 	}
 
-	struct laserSharkSample
-	{
-	    unsigned short a	: 12;
-		unsigned short pad	: 2;
-		bool c				: 1;
-		bool intl_a			: 1; 
-	    unsigned short b	: 16;
-	    unsigned short x	: 16;
-	    unsigned short y	: 16;
-	} __attribute__((packed)) *sample = (laserSharkSample*)buf;
+	laserSharkSample *sample = (laserSharkSample*)buf;
 
     // This is being removed.. we send "blank" pixels and that could definitely be more than samples_left
 	/*if (sample_count > samples_left) {
@@ -143,35 +159,71 @@ unsigned int LaserSharkZigZagLayer::fillLaserSharkTransferBuffer(unsigned int sa
 	
 
 	while (count < sample_count) {
-        int val = (image[curr_y_pos*width + curr_x_pos] << 4); // Change to 12 bit TODO (remove divide by 8)
-		sample[count].a = val;
-		sample[count].c = val > 2048 ? true : false; 
-		sample[count].intl_a = true; 
-		sample[count].b = val;
-		sample[count].x = curr_x_pos + x_origin;
-		sample[count].y = curr_y_pos + y_origin;
-		count++;
-		
-		if (val) {
-		    samples_left--;
-		}
+		if (scan_phase == SCAN_PHASE_ROW) {
+			unsigned int index = curr_y_pos*width + curr_x_pos;
+			unsigned char val = image[index];
+			unsigned short x = (curr_y_pos & 1) ? reverse_x[curr_x_pos] : forward_x[curr_x_pos];
+			// Without a dwell map the pixel value sets the dwell, so the laser runs at full power.
+			unsigned char intensity = (val && dwell_max_repeats > 1 && dwell_map.empty()) ? 0xFF : val;
+			setLaserSharkSample(sample[count], intensity, x, curr_y_pos + y_origin);
+			count++;
+
+			if (val) {
+				samples_left--;
+			}
 
-        printf("\tx:\t%d\ty:\t%d\t= %d\n", curr_y_pos, curr_x_pos, val);
+			D(printf("\tx:\t%d\ty:\t%d\t= %d\n", curr_y_pos, curr_x_pos, val);)
 
+			// Stay on this pixel until it has been given all its samples.
+			if (val && ++dwell_pos < getPixelRepeats(index)) {
+				continue;
+			}
+			dwell_pos = 0;
+
+			bool row_done = false;
+			if (curr_y_pos & 1) { // Odd row
+				if (curr_x_pos == 0) {
+					row_done = true;
+				} else {
+					curr_x_pos--;
+				}
+			} else { // Even row
+				if (curr_x_pos == width-1) {
+					row_done = true;
+				} else {
+					curr_x_pos++;
+				}
+			}
 
-        if (curr_y_pos & 1) { // Odd row
-			if (curr_x_pos == 0) {
-			    curr_y_pos++;
-            } else {
-                curr_x_pos--;
-            }        
-        } else { // Even row
-            if (curr_x_pos == width-1) {
-                curr_y_pos++;
-            } else {
-                curr_x_pos++;
-            }
-        }
+			if (row_done) {
+				if (ramp_samples) {
+					scan_phase = SCAN_PHASE_RAMP_OUT;
+					ramp_pos = 0;
+				} else {
+					curr_y_pos++;
+				}
+			}
+		} else if (scan_phase == SCAN_PHASE_RAMP_OUT) {
+			// Blanked deceleration past the end of the row just drawn.
+			unsigned short x = (curr_y_pos & 1) ? left_ramp_out[ramp_pos] : right_ramp_out[ramp_pos];
+			setLaserSharkSample(sample[count], 0, x, curr_y_pos + y_origin);
+			count++;
+
+			if (++ramp_pos == ramp_samples) {
+				curr_y_pos++;
+				scan_phase = SCAN_PHASE_RAMP_IN;
+				ramp_pos = 0;
+			}
+		} else {
+			// Blanked acceleration into the row about to be drawn.
+			unsigned short x = (curr_y_pos & 1) ? right_ramp_in[ramp_pos] : left_ramp_in[ramp_pos];
+			setLaserSharkSample(sample[count], 0, x, curr_y_pos + y_origin);
+			count++;
+
+			if (++ramp_pos == ramp_samples) {
+				scan_phase = SCAN_PHASE_ROW;
+			}
+		}
 	}
 	
 	D(std::cout << "sl: " << samples_left << " y: " << curr_y_pos << " x: " << curr_x_pos << std::endl;)
@@ -202,6 +254,73 @@ unsigned int LaserSharkZigZagLayer::getHeight()
 }
 
 
+unsigned int LaserSharkZigZagLayer::getInflateUs()
+{
+	return inflate_us;
+}
+
+
+
+/*
+	Galvo lag makes rows drawn left to right and right to left land at different x positions. forward_offset
+	and reverse_offset (in pixels) shift the rows drawn in each direction to line the edges back up.
+	ramp_samples blanked samples are added at each end of a row, decelerating out of the row and accelerating
+	into the next one, so each row is drawn at full speed.
+*/
+void LaserSharkZigZagLayer::setScanCompensation(int forward_offset, int reverse_offset, unsigned int ramp_samples)
+{
+	this->forward_offset = forward_offset;
+	this->reverse_offset = reverse_offset;
+	this->ramp_samples = ramp_samples;
+}
+
+
+/*
+	Lets lit pixels be exposed for up to max_repeats consecutive samples instead of one, giving more energy to
+	some areas without lowering the sample rate for the whole layer. The number of samples comes from the
+	pixel's value (and the laser runs at full power) or, if a dwell map is set, from the map's value for that
+	pixel. A max_repeats of 0 or 1 disables dwell, more than LASERSHARK_MAX_DWELL_REPEATS is clamped to it.
+*/
+void LaserSharkZigZagLayer::setDwell(unsigned int max_repeats)
+{
+	dwell_max_repeats = max_repeats ? max_repeats : 1;
+	if (dwell_max_repeats > LASERSHARK_MAX_DWELL_REPEATS) {
+		dwell_max_repeats = LASERSHARK_MAX_DWELL_REPEATS;
+	}
+}
+
+
+/*
+	dwell_map is a map from decodeDwellMap, one byte per pixel, with the same dimensions as the layer.
+*/
+void LaserSharkZigZagLayer::setDwellMap(const std::vector<unsigned char> &dwell_map, unsigned int width, unsigned int height)
+{
+	this->dwell_map = dwell_map;
+	dwell_map_width = width;
+	dwell_map_height = height;
+}
+
+
+/*
+	Decodes a greyscale PNG dwell map. Returns false, leaving dwell_map empty, if it doesn't decode or is empty.
+*/
+bool LaserSharkZigZagLayer::decodeDwellMap(const unsigned char* png_dwell_data, unsigned int png_dwell_data_len,
+	std::vector<unsigned char> &dwell_map, unsigned int &width, unsigned int &height)
+{
+	dwell_map.clear();
+	unsigned error = lodepng::decode(dwell_map, width, height, png_dwell_data, png_dwell_data_len, LCT_GREY, 8);
+	if (error) {
+		std::cerr << "Layer dwell map decoder error " << error << ": " << lodepng_error_text(error) << std::endl;
+		dwell_map.clear();
+		return false;
+	}
+	if (dwell_map.empty()) {
+		std::cerr << "Layer dwell map was empty!" << std::endl;
+		return false;
+	}
+	return true;
+}
+
 
 void LaserSharkZigZagLayer::clear()
 {
@@ -214,7 +333,17 @@ void LaserSharkZigZagLayer::clear()
 	curr_y_pos = 0;
 	total_samples = 0;
 	samples_left = 0;
+	scan_phase = SCAN_PHASE_ROW;
+	ramp_pos = 0;
+	dwell_pos = 0;
+	forward_x.clear();
+	reverse_x.clear();
+	right_ramp_out.clear();
+	right_ramp_in.clear();
+	left_ramp_out.clear();
+	left_ramp_in.clear();
 	initialized = false;
+	inflate_us = 0;
 }
 
 
@@ -223,3 +352,86 @@ bool LaserSharkZigZagLayer::populated()
 	return initialized;
 }
 
+
+void LaserSharkZigZagLayer::rewind()
+{
+	if (!initialized) {
+		return;
+	}
+	curr_x_pos = 0;
+	curr_y_pos = 0;
+	ramp_pos = 0;
+	scan_phase = ramp_samples ? SCAN_PHASE_RAMP_IN : SCAN_PHASE_ROW;
+	dwell_pos = 0;
+	samples_left = total_samples;
+}
+
+
+
+static unsigned short clampGalvoPosition(float pos)
+{
+	if (pos < 0) {
+		return 0;
+	}
+	if (pos > 0xFFFF) {
+		return 0xFFFF;
+	}
+	return (unsigned short)(pos + 0.5f);
+}
+
+
+/*
+	Precomputes the galvo x positions for both scan directions and for the turnaround ramps so the fill loop
+	only has to look them up.
+*/
+void LaserSharkZigZagLayer::buildScanTables()
+{
+	forward_x.resize(width);
+	reverse_x.resize(width);
+	for (unsigned int x = 0; x < width; x++) {
+		forward_x[x] = clampGalvoPosition((float)x + x_origin + forward_offset);
+		reverse_x[x] = clampGalvoPosition((float)x + x_origin + reverse_offset);
+	}
+
+	right_ramp_out.resize(ramp_samples);
+	right_ramp_in.resize(ramp_samples);
+	left_ramp_out.resize(ramp_samples);
+	left_ramp_in.resize(ramp_samples);
+
+	// Speed falls linearly from one pixel per sample to rest over the ramp.
+	std::vector<float> ramp(ramp_samples);
+	float distance = 0;
+	for (unsigned int i = 0; i < ramp_samples; i++) {
+		distance += 1.0f - (float)(i + 1)/(ramp_samples + 1);
+		ramp[i] = distance;
+	}
+
+	for (unsigned int i = 0; i < ramp_samples; i++) {
+		right_ramp_out[i] = clampGalvoPosition(forward_x[width-1] + ramp[i]);
+		right_ramp_in[i] = clampGalvoPosition(reverse_x[width-1] + ramp[ramp_samples-1-i]);
+		left_ramp_out[i] = clampGalvoPosition(reverse_x[0] - ramp[i]);
+		left_ramp_in[i] = clampGalvoPosition(forward_x[0] - ramp[ramp_samples-1-i]);
+	}
+}
+
+
+void LaserSharkZigZagLayer::buildDwellTable()
+{
+	for (unsigned int val = 0; val < 256; val++) {
+		if (dwell_max_repeats <= 1) {
+			dwell_table[val] = 1;
+		} else if (dwell_map.empty()) {
+			// Pixel values 1-255 map onto 1-max_repeats samples.
+			dwell_table[val] = val ? 1 + ((val - 1)*(dwell_max_repeats - 1) + 127)/254 : 1;
+		} else {
+			// Dwell map values 0-255 map onto 1-max_repeats samples.
+			dwell_table[val] = 1 + (val*(dwell_max_repeats - 1) + 127)/255;
+		}
+	}
+}
+
+
+unsigned int LaserSharkZigZagLayer::getPixelRepeats(unsigned int index)
+{
+	return dwell_table[dwell_map.empty() ? image[index] : dwell_map[index]];
+}
@@ -23,6 +23,9 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "AbstractLaserSharkLayer.h"
 #include <vector>
 
+// The most samples one pixel can be given by dwell.
+#define LASERSHARK_MAX_DWELL_REPEATS 255
+
 
 // Not intended to be thread safe.
 class LaserSharkZigZagLayer : public AbstractLaserSharkLayer
@@ -32,22 +35,56 @@ class LaserSharkZigZagLayer : public AbstractLaserSharkLayer
 		bool populate(unsigned int x_origin, unsigned int y_origin, const unsigned char* png_image_data, unsigned int png_image_data_len);
 		void clear();
 		bool populated();
+		void rewind();
 
 		unsigned int fillLaserSharkTransferBuffer(unsigned int sample_count, unsigned char *buf);
 		unsigned int getSamplesLeft();
 		unsigned int getTotalSamples();
 		unsigned int getWidth();
 		unsigned int getHeight();
+		unsigned int getInflateUs();
+
+		// These must be called before populate.
+		void setScanCompensation(int forward_offset, int reverse_offset, unsigned int ramp_samples);
+		void setDwell(unsigned int max_repeats);
+		void setDwellMap(const std::vector<unsigned char> &dwell_map, unsigned int width, unsigned int height);
+
+		static bool decodeDwellMap(const unsigned char* png_dwell_data, unsigned int png_dwell_data_len,
+			std::vector<unsigned char> &dwell_map, unsigned int &width, unsigned int &height);
 
 
 	private:
+		enum ScanPhase {
+			SCAN_PHASE_ROW,
+			SCAN_PHASE_RAMP_OUT,
+			SCAN_PHASE_RAMP_IN
+		};
+
+		void buildScanTables();
+		void buildDwellTable();
+		unsigned int getPixelRepeats(unsigned int index);
+
 		bool initialized;
+		unsigned int inflate_us;
 		unsigned int width, height;
 		unsigned int x_origin, y_origin;
 		std::vector<unsigned char> image;
 		unsigned int curr_x_pos, curr_y_pos;
 		unsigned int total_samples, samples_left;
 
+		int forward_offset, reverse_offset;
+		unsigned int ramp_samples;
+		ScanPhase scan_phase;
+		unsigned int ramp_pos;
+		std::vector<unsigned short> forward_x, reverse_x;
+		std::vector<unsigned short> right_ramp_out, right_ramp_in, left_ramp_out, left_ramp_in;
+
+		unsigned int dwell_max_repeats;
+		std::vector<unsigned char> dwell_map;
+		unsigned int dwell_map_width, dwell_map_height;
+		unsigned int dwell_table[256];
+		unsigned int dwell_pos;
+
 };
 
 #endif //_LASERSHARKLAYER_H_
@@ -23,12 +23,19 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include <unistd.h>
 #include <signal.h>
 #include <string.h>
+#include <stdlib.h>
+#include <sched.h>
 
 #include "LaserSharkJSONServer.h"
 #include "LaserShark.h"
+#include "LaserSharkUsbSession.h"
 
 #include "TwoStepJSONServer.h"
+#include "CombinedJSONServer.h"
+#include "BinRpcServer.h"
 #include "TwoStep.h"
+#include "metrics/MetricsHttpServer.h"
+#include "metrics/Trace.h"
 #include "debug.h"
 
 
@@ -37,6 +44,7 @@ using namespace jsonrpc;
 
 
 bool do_exit = 0;
+volatile sig_atomic_t do_dump_trace = 0;
 
 
 sigset_t mask, oldmask;
@@ -52,6 +60,9 @@ static void sig_hdlr(int signum)
         printf("sigusr1 caught\n");
         do_exit = 1;
         break;
+    case SIGUSR2:
+        do_dump_trace = 1;
+        break;
     default:
         printf("Received unexpected signal\n");
     }
@@ -60,33 +71,80 @@ static void sig_hdlr(int signum)
 
 void print_help(char* program)
 {
-    cout << program << "[--help|--lasershark_only]" << endl;
+    cout << program << "[--help|--lasershark_only|--rt_priority N|--cpu N|--mlock|--metrics_port N|--combined_port N|--binrpc_port N|--binrpc_socket PATH|--layer_log FILE|--trace N|--trace_file FILE]" << endl;
     cout << "\t--help - Prints this help text" << endl;
     cout << "\t--lasershark_only -- Initializes and uses LaserShark component only." << endl;
+    cout << "\t--rt_priority N -- Runs the LaserShark push thread with SCHED_FIFO priority N (1-99)." << endl;
+    cout << "\t--cpu N -- Pins the LaserShark push thread to cpu N." << endl;
+    cout << "\t--mlock -- Locks the process memory so layers don't stall on page faults." << endl;
+    cout << "\t--metrics_port N -- Serves Prometheus metrics at http://host:N/metrics." << endl;
+    cout << "\t--combined_port N -- Also serves both APIs on port N, as laser.* and stepper.* methods." << endl;
+    cout << "\t--binrpc_port N -- Also serves both APIs over the compact binary protocol on port N." << endl;
+    cout << "\t--binrpc_socket PATH -- Also serves both APIs over the compact binary protocol on a Unix socket at PATH." << endl;
+    cout << "\t--layer_log FILE -- Appends a line of JSON with the timings of each layer to FILE." << endl;
+    cout << "\t--trace N -- Keeps the last N LaserShark and TwoStep events, SIGUSR2 writes them out as a Chrome trace." << endl;
+    cout << "\t--trace_file FILE -- Where SIGUSR2 and dumpTrace write the trace, lasershark_trace.json by default." << endl;
+}
+
+
+bool parse_int_arg(const char* arg, int min, int max, int &val)
+{
+    char *end;
+    long tmp = strtol(arg, &end, 10);
+    if (*arg == '\0' || *end != '\0' || tmp < min || tmp > max) {
+        return false;
+    }
+    val = tmp;
+    return true;
 }
 
 
 int main(int argc, char** argv)
 {
     int rc;
-    LaserShark ls;
-    TwoStep ts;
+    // Both share the one device handle, so the session has to outlive them.
+    LaserSharkUsbSession usb;
+    LaserShark ls(&usb);
+    TwoStep ts(&usb);
     bool ls_only = false;
+    int rt_priority = 0;
+    int cpu = -1;
+    bool lock_memory = false;
+    int metrics_port = 0;
+    int combined_port = 0;
+    int binrpc_port = 0;
+    const char *binrpc_socket = "";
+    const char *layer_log = NULL;
+    int trace_events = 0;
+    const char *trace_file = "lasershark_trace.json";
     struct sigaction sigact;
 
-    if (argc > 2) {
-        cerr << "Invalid args" << endl;
-        print_help(argv[0]);
-        return 1;
-    }
-
-    if (argc == 2) {
-        if (0 == strcmp(argv[1], "--lasershark_only")) {
+    for (int i = 1; i < argc; i++) {
+        if (0 == strcmp(argv[i], "--lasershark_only")) {
             ls_only = true;
-
-        } else if (0 == strcmp(argv[1], "--help")) {
+        } else if (0 == strcmp(argv[i], "--help")) {
             print_help(argv[0]);
             return 0;
+        } else if (0 == strcmp(argv[i], "--rt_priority") && i + 1 < argc && parse_int_arg(argv[i + 1], 1, 99, rt_priority)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "--cpu") && i + 1 < argc && parse_int_arg(argv[i + 1], 0, CPU_SETSIZE - 1, cpu)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "--mlock")) {
+            lock_memory = true;
+        } else if (0 == strcmp(argv[i], "--metrics_port") && i + 1 < argc && parse_int_arg(argv[i + 1], 1, 65535, metrics_port)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "--combined_port") && i + 1 < argc && parse_int_arg(argv[i + 1], 1, 65535, combined_port)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "--binrpc_port") && i + 1 < argc && parse_int_arg(argv[i + 1], 1, 65535, binrpc_port)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "--binrpc_socket") && i + 1 < argc) {
+            binrpc_socket = argv[++i];
+        } else if (0 == strcmp(argv[i], "--layer_log") && i + 1 < argc) {
+            layer_log = argv[++i];
+        } else if (0 == strcmp(argv[i], "--trace") && i + 1 < argc && parse_int_arg(argv[i + 1], 1, 100000000, trace_events)) {
+            i++;
+        } else if (0 == strcmp(argv[i], "--trace_file") && i + 1 < argc) {
+            trace_file = argv[++i];
         } else {
             cerr << "Invalid args" << endl;
             print_help(argv[0]);
@@ -94,6 +152,15 @@ int main(int argc, char** argv)
         }
     }
 
+    // Before any of the traced threads start.
+    if (trace_events) {
+        Tracer::instance().enable(trace_events);
+    }
+
+    if (!ls.setPushThreadScheduling(rt_priority, cpu, lock_memory)) {
+        cerr << "Continuing without locked memory." << endl;
+    }
+
     rc = libusb_init(NULL);
     if (rc < 0) {
         cerr << "Error initializing libusb: " << libusb_error_name(rc) << endl;
@@ -106,6 +173,7 @@ int main(int argc, char** argv)
     sigact.sa_flags = 0;
     sigaction(SIGINT, &sigact, NULL);
     sigaction(SIGUSR1, &sigact, NULL);
+    sigaction(SIGUSR2, &sigact, NULL);
 
     try {
         if (!ls.connect()) {
@@ -137,12 +205,30 @@ int main(int argc, char** argv)
         }
     }
 
+    try {
+        if (!usb.startEventThread()) {
+            cout << "USB hotplug not supported, the LaserShark won't be reconnected if it is unplugged." << endl;
+        }
+    } catch (runtime_error e) {
+        cerr << e.what() << endl;
+    }
+
     try {
         LaserSharkJSONServer ls_serv;
         TwoStepJSONServer ts_serv;
+        MetricsHttpServer metrics_serv(&MetricsRegistry::instance(), metrics_port);
+        CombinedJSONServer combined_serv(combined_port, &ls_serv, ls_only ? NULL : &ts_serv);
+        BinRpcServer binrpc_serv(&ls_serv, ls_only ? NULL : &ts_serv, binrpc_port, binrpc_socket);
         ls_serv.setLaserShark(&ls);
+        ls_serv.setTraceFile(trace_file);
+        if (layer_log && !ls_serv.setLayerLog(layer_log)) {
+            std::ostringstream oss;
+            oss << "Error opening layer log " << layer_log << ".";
+            throw std::runtime_error(oss.str());
+        }
         if (!ls_only) {
             ts_serv.setTwoStep(&ts);
+            ls_serv.setTwoStep(&ts);
         }
 
         if (!ls_serv.StartListening()) {
@@ -159,10 +245,29 @@ int main(int argc, char** argv)
             }
         }
 
+        if (combined_port && !combined_serv.StartListening()) {
+            std::ostringstream oss;
+            oss << "Error encountered initializing combined JSON server.";
+            throw std::runtime_error(oss.str());
+        }
+
+        if ((binrpc_port || binrpc_socket[0]) && !binrpc_serv.StartListening()) {
+            std::ostringstream oss;
+            oss << "Error encountered initializing binary RPC server.";
+            throw std::runtime_error(oss.str());
+        }
+
+        if (metrics_port && !metrics_serv.StartListening()) {
+            std::ostringstream oss;
+            oss << "Error encountered initializing metrics server.";
+            throw std::runtime_error(oss.str());
+        }
+
         cout << "Servers started successfully. Type ctrl-c to quit." << endl;
 
         sigemptyset (&mask);
         sigaddset (&mask, SIGUSR1);
+        sigaddset (&mask, SIGUSR2);
 
         sigprocmask (SIG_BLOCK, &mask, &oldmask);
 
@@ -170,20 +275,36 @@ int main(int argc, char** argv)
         while (!do_exit) {
             sigsuspend (&oldmask);
             printf("Looping... (Must have recieved a signal, don't panic)\n");
+            if (do_dump_trace) {
+                do_dump_trace = 0;
+                unsigned int count;
+                if (Tracer::instance().dump(trace_file, &count)) {
+                    cout << "Wrote " << count << " trace events to " << trace_file << endl;
+                } else {
+                    cerr << "Could not write trace, was lasershark_3dp started with --trace?" << endl;
+                }
+            }
         }
         sigprocmask (SIG_UNBLOCK, &mask, NULL);
         cout << "Exiting loop" << endl;
 
+        binrpc_serv.StopListening();
+        if (combined_port) {
+            combined_serv.StopListening();
+        }
         ls_serv.StopListening();
         if (!ls_only) {
             ts_serv.StopListening();
         }
+        metrics_serv.StopListening();
     } catch (jsonrpc::JsonRpcException& e) {
         cerr << e.what() << endl;
     } catch (runtime_error e) {
         cerr << e.what() << endl;
     }
 
+    usb.stopEventThread();
+
     if (!ls_only) {
         cout << "TwoStep disconnecting" << endl;
         ts.disconnect();
@@ -0,0 +1,98 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <jsonrpc/rpc.h>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+
+#include "lasersharkjsonclient.h"
+#include "KeepAliveHttpClient.h"
+#include "lasersharkbinrpcclient.h"
+
+using namespace jsonrpc;
+using namespace std;
+
+
+/*
+	Makes count calls to call, which should only read host side state so the times are the transport's and the
+	server's overhead rather than the device's, and prints how long they took.
+*/
+void benchmark(const string &name, function<void()> call, unsigned int count)
+{
+    vector<double> times_us;
+
+    // The first call opens the kept alive connection, leave it out like any later call would.
+    call();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (unsigned int i = 0; i < count; i++) {
+        chrono::steady_clock::time_point call_start = chrono::steady_clock::now();
+        call();
+        times_us.push_back(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - call_start).count()/1000.0);
+    }
+    double total_ms = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count()/1000.0;
+
+    sort(times_us.begin(), times_us.end());
+    cout << name << ": " << count << " calls in " << total_ms << " ms, " <<
+        "mean " << total_ms*1000/count << " us, " <<
+        "median " << times_us[count/2] << " us, " <<
+        "p99 " << times_us[count*99/100] << " us, " <<
+        "max " << times_us[count - 1] << " us" << endl;
+}
+
+
+int main(int argc, char** argv)
+{
+    if (argc > 4) {
+        cout << "Usage: " << argv[0] << " [url] [calls] [binrpc address]" << endl;
+        cout << "Defaults to http://localhost:8080 and 1000 calls. Given an address, host:port or a socket path, the" << endl;
+        cout << "binary RPC client is timed too." << endl;
+        return 1;
+    }
+
+    string url = argc > 1 ? argv[1] : "http://localhost:8080";
+    int count = argc > 2 ? atoi(argv[2]) : 1000;
+    if (count <= 0) {
+        cout << "calls must be more than 0" << endl;
+        return 1;
+    }
+
+    try {
+        LaserSharkJSONClient lsc(new HttpClient(url));
+        benchmark("HttpClient", [&]() { lsc.getLaserSharkJSONVersion(); }, count);
+        LaserSharkJSONClient kalsc(new KeepAliveHttpClient(url));
+        benchmark("KeepAliveHttpClient", [&]() { kalsc.getLaserSharkJSONVersion(); }, count);
+        if (argc > 3) {
+            LaserSharkBinRpcClient blsc(argv[3]);
+            benchmark("LaserSharkBinRpcClient", [&]() { blsc.getLaserSharkJSONVersion(); }, count);
+        }
+    } catch (JsonRpcException e) {
+        cerr << e.what() << endl;
+        return 1;
+    } catch (runtime_error e) {
+        cerr << e.what() << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -26,11 +26,16 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #include "base64/base64_cpp.h"
 #include "lasersharkjsonclient.h"
 #include "twostepjsonclient.h"
+#include "twostepjsonbatch.h"
 #include "twostep_common_lib.h"
+#include "KeepAliveHttpClient.h"
 
 using namespace jsonrpc;
 using namespace std;
 
+// How many times a failed layer is resumed before giving up on it.
+#define MAX_LAYER_RESUMES 3
+
 
 Json::Value cr(Json::Value value) throw (std::runtime_error)
 {
@@ -81,9 +86,8 @@ char* read_and_base64_encode_image(const char* image_file)
 }
 
 
-void sendAndWaitForLayer(LaserSharkJSONClient &lsc, string file_name, unsigned int sleep_delay) throw (std::runtime_error)
+void sendLayer(LaserSharkJSONClient &lsc, string file_name) throw (std::runtime_error)
 {
-    Json::Value value;
     char* base64_img = read_and_base64_encode_image(file_name.c_str());
     if (!base64_img) {
         std::ostringstream oss;
@@ -93,41 +97,74 @@ void sendAndWaitForLayer(LaserSharkJSONClient &lsc, string file_name, unsigned i
 
     cout << "Sending Layer" << endl;
     cr(lsc.sendLayer(base64_img, 0, 0));
-    cout << "Starting Layer" << endl;
-    cr(lsc.startLayer());
+}
+
+
+void waitForLayer(LaserSharkJSONClient &lsc, unsigned int sleep_delay) throw (std::runtime_error)
+{
+    Json::Value value;
+    int resumes = 0;
     int totalSamples = cr(lsc.getLayerTotalSamples())["value"].asInt();
     while(1) {
-        sleep(sleep_delay);
-        int layerSamplesLeft = cr(lsc.getLayerSamplesLeft())["value"].asInt();
-        value = cr(lsc.getLayerDone());
+        // Returns as soon as the layer is done, or after sleep_delay to report progress.
+        value = cr(lsc.waitForLayerDone(sleep_delay*1000));
         if (value["value"].asBool() == false) {
+            int layerSamplesLeft = cr(lsc.getLayerSamplesLeft())["value"].asInt();
             cout << "Completed " << layerSamplesLeft << " of " << totalSamples << " layer samples." << endl;
         } else {
+            string error = cr(lsc.getLayerErrorMessage())["value"].asString();
+            if (!error.empty() && resumes < MAX_LAYER_RESUMES) {
+                // Picks the layer back up from where it failed rather than losing it.
+                cout << "Layer failed: " << error << endl;
+                resumes++;
+                // Counts every sample sent, where the progress above leaves out blank pixels and scan ramps.
+                int checkpoint = cr(lsc.resumeLayer())["value"].asInt();
+                cout << "Resumed layer from output sample " << checkpoint << " (blank pixels included)" << endl;
+                continue;
+            }
+            if (!error.empty()) {
+                std::ostringstream oss;
+                oss << "Layer failed: " << error;
+                throw std::runtime_error(oss.str());
+            }
             cout << "Layer Completed" << endl;
             break;
         }
     }
+}
+
 
+void sendAndWaitForLayer(LaserSharkJSONClient &lsc, string file_name, unsigned int sleep_delay) throw (std::runtime_error)
+{
+    sendLayer(lsc, file_name);
+    cout << "Starting Layer" << endl;
+    cr(lsc.startLayer());
+    waitForLayer(lsc, sleep_delay);
 }
 
+
 void initializeSteppers(TwoStepJSONClient &tsc) throw (std::runtime_error)
 {
     cout << "Initializing steppers" << endl;
-    cr(tsc.stop(true, true));
-    cr(tsc.setMicrosteps(TWOSTEP_STEPPER_1, TWOSTEP_MICROSTEP_BITFIELD_FULL_STEP));
-    cr(tsc.setMicrosteps(TWOSTEP_STEPPER_2, TWOSTEP_MICROSTEP_BITFIELD_FULL_STEP));
-    cr(tsc.setCurrent(TWOSTEP_STEPPER_1, 50/*TWOSTEP_MIN_CURRENT_VAL*/));
-    cr(tsc.setCurrent(TWOSTEP_STEPPER_2, 50/*TWOSTEP_MIN_CURRENT_VAL*/));
-    cr(tsc.set100uSDelay(TWOSTEP_STEPPER_1, TWOSTEP_STEP_100US_DELAY_5MS));
-    cr(tsc.setEnable(TWOSTEP_STEPPER_1, true));
-    cr(tsc.setEnable(TWOSTEP_STEPPER_2, true));
+    // Sent as one request, the calls still run in order and nothing else reaches the TwoStep in between.
+    TwoStepJSONBatch batch;
+    batch.stop(true, true);
+    batch.setMicrosteps(TWOSTEP_STEPPER_1, TWOSTEP_MICROSTEP_BITFIELD_FULL_STEP);
+    batch.setMicrosteps(TWOSTEP_STEPPER_2, TWOSTEP_MICROSTEP_BITFIELD_FULL_STEP);
+    batch.setCurrent(TWOSTEP_STEPPER_1, 50/*TWOSTEP_MIN_CURRENT_VAL*/);
+    batch.setCurrent(TWOSTEP_STEPPER_2, 50/*TWOSTEP_MIN_CURRENT_VAL*/);
+    batch.set100uSDelay(TWOSTEP_STEPPER_1, TWOSTEP_STEP_100US_DELAY_5MS);
+    batch.setEnable(TWOSTEP_STEPPER_1, true);
+    batch.setEnable(TWOSTEP_STEPPER_2, true);
+    cr(tsc.executeBatch(batch.calls()));
 }
 
 
 void waitForStepperToStop(TwoStepJSONClient &tsc, int stepperNum) throw (std::runtime_error)
 {
-    while (cr(tsc.getIsMoving(stepperNum))["value"].asBool()) {
-        sleep(1);
+    int stepperMask = stepperNum == TWOSTEP_STEPPER_1 ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : TWOSTEP_STEPPER_BITFIELD_STEPPER_2;
+    while (!cr(tsc.waitForMotionComplete(stepperMask, 5000))["value"].asBool()) {
+        // Still moving when the wait timed out, wait again.
     }
 }
 
@@ -163,23 +200,24 @@ void performHomingSequence(TwoStepJSONClient &tsc) throw (std::runtime_error)
 }
 
 
-void performInterStepSequence(TwoStepJSONClient &tsc) throw (std::runtime_error)
+// Only starts the moves, the next layer is started with startLayerAfterMotion so it can be sent while they run.
+void startInterStepSequence(TwoStepJSONClient &tsc) throw (std::runtime_error)
 {
-    cout << "Running inter-layer sequence" << endl;
+    cout << "Starting inter-layer sequence" << endl;
     // This is going to be machine dependent. The following is here to demonstrate
     // how two stepper motors can be configured differently yet still started at the
     // same time.
 
+    TwoStepJSONBatch batch;
     // Configure Stepper 1 to do one thing...
-    cr(tsc.setDir(TWOSTEP_STEPPER_1, TWOSTEP_STEPPER_DIR_LOW));
-    cr(tsc.setSafeSteps(TWOSTEP_STEPPER_1, 500));
+    batch.setDir(TWOSTEP_STEPPER_1, TWOSTEP_STEPPER_DIR_LOW);
+    batch.setSafeSteps(TWOSTEP_STEPPER_1, 500);
 
     // Configure Stepper 2 to do another thing...
-    cr(tsc.setDir(TWOSTEP_STEPPER_2, TWOSTEP_STEPPER_DIR_HIGH));
-    cr(tsc.setSafeSteps(TWOSTEP_STEPPER_2, 1000));
-    cr(tsc.start(true, true));
-    waitForStepperToStop(tsc, TWOSTEP_STEPPER_1);
-    waitForStepperToStop(tsc, TWOSTEP_STEPPER_2);
+    batch.setDir(TWOSTEP_STEPPER_2, TWOSTEP_STEPPER_DIR_HIGH);
+    batch.setSafeSteps(TWOSTEP_STEPPER_2, 1000);
+    batch.start(true, true);
+    cr(tsc.executeBatch(batch.calls()));
 }
 
 
@@ -190,14 +228,18 @@ void performPostFinalLayerSequence(TwoStepJSONClient &tsc) throw (std::runtime_e
     // how two stepper motors can be started at different times yet stopped at the same time
 
     // Configure Stepper 1 to do one thing...
-    cr(tsc.setDir(TWOSTEP_STEPPER_1, TWOSTEP_STEPPER_DIR_LOW));
-    cr(tsc.setStepUntilSwitch(TWOSTEP_STEPPER_1));
-    cr(tsc.start(true, false));
+    TwoStepJSONBatch batch;
+    batch.setDir(TWOSTEP_STEPPER_1, TWOSTEP_STEPPER_DIR_LOW);
+    batch.setStepUntilSwitch(TWOSTEP_STEPPER_1);
+    batch.start(true, false);
+    cr(tsc.executeBatch(batch.calls()));
     sleep(1);
     // Configure Stepper 2 to do another thing...
-    cr(tsc.setDir(TWOSTEP_STEPPER_2, TWOSTEP_STEPPER_DIR_LOW));
-    cr(tsc.setStepUntilSwitch(TWOSTEP_STEPPER_2));
-    cr(tsc.start(false, true));
+    batch.clear();
+    batch.setDir(TWOSTEP_STEPPER_2, TWOSTEP_STEPPER_DIR_LOW);
+    batch.setStepUntilSwitch(TWOSTEP_STEPPER_2);
+    batch.start(false, true);
+    cr(tsc.executeBatch(batch.calls()));
     sleep(2);
 
     cr(tsc.stop(true, true));
@@ -206,9 +248,11 @@ void performPostFinalLayerSequence(TwoStepJSONClient &tsc) throw (std::runtime_e
 void performShutdownSequence(TwoStepJSONClient &tsc) throw (std::runtime_error)
 {
     cout << "Shutting down steppers" << endl;
-    cr(tsc.stop(true, true));
-    cr(tsc.setEnable(TWOSTEP_STEPPER_1, false));
-    cr(tsc.setEnable(TWOSTEP_STEPPER_2, false));
+    TwoStepJSONBatch batch;
+    batch.stop(true, true);
+    batch.setEnable(TWOSTEP_STEPPER_1, false);
+    batch.setEnable(TWOSTEP_STEPPER_2, false);
+    cr(tsc.executeBatch(batch.calls()));
 }
 
 
@@ -223,8 +267,9 @@ int main(int argc, char** argv)
 
     char *file_name = argv[1];
 
-    LaserSharkJSONClient lsc(new HttpClient("http://localhost:8080"));
-    TwoStepJSONClient tsc(new HttpClient("http://localhost:8081"));
+    // The layer loop polls every second, so connections are kept open rather than made for every call.
+    LaserSharkJSONClient lsc(new KeepAliveHttpClient("http://localhost:8080"));
+    TwoStepJSONClient tsc(new KeepAliveHttpClient("http://localhost:8081"));
 
     try {
         tsc.printText("Hello from client!");
@@ -238,7 +283,13 @@ int main(int argc, char** argv)
         performHomingSequence(tsc);
 
         sendAndWaitForLayer(lsc, file_name, 1);
-        performInterStepSequence(tsc);
+
+        // The second layer is sent while the steppers move and is only drawn once they stop and settle.
+        startInterStepSequence(tsc);
+        sendLayer(lsc, file_name);
+        cout << "Starting Layer after motion" << endl;
+        cr(lsc.startLayerAfterMotion(250, TWOSTEP_STEPPER_BITFIELD_STEPPER_1 | TWOSTEP_STEPPER_BITFIELD_STEPPER_2));
+        waitForLayer(lsc, 1);
         cout << "Sleeping" << endl;
         sleep(5);
         performPostFinalLayerSequence(tsc);
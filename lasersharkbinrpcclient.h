@@ -0,0 +1,196 @@
+/**
+ * THIS FILE IS GENERATED BY binrpcstub FROM lasershark_spec.json, DO NOT CHANGE IT!!!!!
+ */
+
+#ifndef _LASERSHARKBINRPCCLIENT_H_
+#define _LASERSHARKBINRPCCLIENT_H_
+
+#include "BinRpcClient.h"
+#include "lasersharkbinrpcmethods.h"
+
+class LaserSharkBinRpcClient : public BinRpcClient
+{
+    public:
+        LaserSharkBinRpcClient(const std::string &address) :
+            BinRpcClient(address, LASERSHARKBINRPC_SPEC_HASH)
+        {
+        }
+
+        std::string getLaserSharkJSONVersion() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(0, p).getString();
+        }
+
+        void sendLayer(const std::string& base64PNGData, const int& xUpperLeftPos, const int& yUpperLeftPos) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putString(base64PNGData);
+            p.putInt(xUpperLeftPos);
+            p.putInt(yUpperLeftPos);
+            this->call(1, p);
+        }
+
+        void startLayer() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            this->call(2, p);
+        }
+
+        void stopAndClearLayer() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            this->call(3, p);
+        }
+
+        bool getLayerRunning() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(4, p).getBool();
+        }
+
+        bool getLayerDone() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(5, p).getBool();
+        }
+
+        std::string getLayerErrorMessage() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(6, p).getString();
+        }
+
+        int getLayerTotalSamples() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(7, p).getInt();
+        }
+
+        int getLayerSamplesLeft() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(8, p).getInt();
+        }
+
+        void setSampleRate(const int& rate) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(rate);
+            this->call(9, p);
+        }
+
+        int getMaxSampleRate() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(10, p).getInt();
+        }
+
+        int getResolution() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(11, p).getInt();
+        }
+
+        void setLayerType(const std::string& type) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putString(type);
+            this->call(12, p);
+        }
+
+        void setVectorLayerOptions(const int& blankSettleSamples, const int& cornerDwellSamples, const int& cornerMinAngle) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(blankSettleSamples);
+            p.putInt(cornerDwellSamples);
+            p.putInt(cornerMinAngle);
+            this->call(13, p);
+        }
+
+        void setHatchOptions(const int& angle, const int& spacing) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(angle);
+            p.putInt(spacing);
+            this->call(14, p);
+        }
+
+        void setScanCompensation(const int& forwardOffset, const int& rampSamples, const int& reverseOffset) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(forwardOffset);
+            p.putInt(rampSamples);
+            p.putInt(reverseOffset);
+            this->call(15, p);
+        }
+
+        void setDwellMode(const int& maxRepeats) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(maxRepeats);
+            this->call(16, p);
+        }
+
+        void sendDwellMap(const std::string& base64PNGData) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putString(base64PNGData);
+            this->call(17, p);
+        }
+
+        void sendTiledLayer(const Json::Value& tiles) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putJson(tiles);
+            this->call(18, p);
+        }
+
+        Json::Value getPushThreadStats() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(19, p).getJson();
+        }
+
+        bool waitForLayerDone(const int& timeoutMs) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(timeoutMs);
+            return this->call(20, p).getBool();
+        }
+
+        void startLayerAfterMotion(const int& settleMs, const int& stepperMask) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(settleMs);
+            p.putInt(stepperMask);
+            this->call(21, p);
+        }
+
+        int resumeLayer() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(22, p).getInt();
+        }
+
+        Json::Value getLayerTimings() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(23, p).getJson();
+        }
+
+        int dumpTrace() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(24, p).getInt();
+        }
+
+        Json::Value executeBatch(const Json::Value& calls) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putJson(calls);
+            return this->call(25, p).getJson();
+        }
+};
+
+#endif //_LASERSHARKBINRPCCLIENT_H_
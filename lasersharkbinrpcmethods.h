@@ -0,0 +1,71 @@
+/**
+ * THIS FILE IS GENERATED BY binrpcstub FROM lasershark_spec.json, DO NOT CHANGE IT!!!!!
+ */
+
+#ifndef _LASERSHARKBINRPCMETHODS_H_
+#define _LASERSHARKBINRPCMETHODS_H_
+
+#include "BinRpc.h"
+
+#define LASERSHARKBINRPC_SPEC_HASH 0x3767b1d7u
+
+static const BinRpcField LaserSharkBinRpc_getLaserSharkJSONVersion_returns[] = {{"value", BINRPC_STRING}};
+static const BinRpcField LaserSharkBinRpc_sendLayer_params[] = {{"base64PNGData", BINRPC_STRING}, {"xUpperLeftPos", BINRPC_INT}, {"yUpperLeftPos", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_getLayerRunning_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField LaserSharkBinRpc_getLayerDone_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField LaserSharkBinRpc_getLayerErrorMessage_returns[] = {{"value", BINRPC_STRING}};
+static const BinRpcField LaserSharkBinRpc_getLayerTotalSamples_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_getLayerSamplesLeft_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_setSampleRate_params[] = {{"rate", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_getMaxSampleRate_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_getResolution_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_setLayerType_params[] = {{"type", BINRPC_STRING}};
+static const BinRpcField LaserSharkBinRpc_setVectorLayerOptions_params[] = {{"blankSettleSamples", BINRPC_INT}, {"cornerDwellSamples", BINRPC_INT}, {"cornerMinAngle", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_setHatchOptions_params[] = {{"angle", BINRPC_INT}, {"spacing", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_setScanCompensation_params[] = {{"forwardOffset", BINRPC_INT}, {"rampSamples", BINRPC_INT}, {"reverseOffset", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_setDwellMode_params[] = {{"maxRepeats", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_sendDwellMap_params[] = {{"base64PNGData", BINRPC_STRING}};
+static const BinRpcField LaserSharkBinRpc_sendTiledLayer_params[] = {{"tiles", BINRPC_ARRAY}};
+static const BinRpcField LaserSharkBinRpc_getPushThreadStats_returns[] = {{"value", BINRPC_OBJECT}};
+static const BinRpcField LaserSharkBinRpc_waitForLayerDone_params[] = {{"timeoutMs", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_waitForLayerDone_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField LaserSharkBinRpc_startLayerAfterMotion_params[] = {{"settleMs", BINRPC_INT}, {"stepperMask", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_resumeLayer_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_getLayerTimings_returns[] = {{"value", BINRPC_OBJECT}};
+static const BinRpcField LaserSharkBinRpc_dumpTrace_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField LaserSharkBinRpc_executeBatch_params[] = {{"calls", BINRPC_ARRAY}};
+static const BinRpcField LaserSharkBinRpc_executeBatch_returns[] = {{"value", BINRPC_ARRAY}};
+
+// Indexed by method id.
+static const BinRpcMethod LaserSharkBinRpcMethods[] = {
+    {"getLaserSharkJSONVersion", NULL, 0, LaserSharkBinRpc_getLaserSharkJSONVersion_returns, 1, true},
+    {"sendLayer", LaserSharkBinRpc_sendLayer_params, 3, NULL, 0, false},
+    {"startLayer", NULL, 0, NULL, 0, false},
+    {"stopAndClearLayer", NULL, 0, NULL, 0, false},
+    {"getLayerRunning", NULL, 0, LaserSharkBinRpc_getLayerRunning_returns, 1, false},
+    {"getLayerDone", NULL, 0, LaserSharkBinRpc_getLayerDone_returns, 1, false},
+    {"getLayerErrorMessage", NULL, 0, LaserSharkBinRpc_getLayerErrorMessage_returns, 1, false},
+    {"getLayerTotalSamples", NULL, 0, LaserSharkBinRpc_getLayerTotalSamples_returns, 1, false},
+    {"getLayerSamplesLeft", NULL, 0, LaserSharkBinRpc_getLayerSamplesLeft_returns, 1, false},
+    {"setSampleRate", LaserSharkBinRpc_setSampleRate_params, 1, NULL, 0, false},
+    {"getMaxSampleRate", NULL, 0, LaserSharkBinRpc_getMaxSampleRate_returns, 1, false},
+    {"getResolution", NULL, 0, LaserSharkBinRpc_getResolution_returns, 1, false},
+    {"setLayerType", LaserSharkBinRpc_setLayerType_params, 1, NULL, 0, false},
+    {"setVectorLayerOptions", LaserSharkBinRpc_setVectorLayerOptions_params, 3, NULL, 0, false},
+    {"setHatchOptions", LaserSharkBinRpc_setHatchOptions_params, 2, NULL, 0, false},
+    {"setScanCompensation", LaserSharkBinRpc_setScanCompensation_params, 3, NULL, 0, false},
+    {"setDwellMode", LaserSharkBinRpc_setDwellMode_params, 1, NULL, 0, false},
+    {"sendDwellMap", LaserSharkBinRpc_sendDwellMap_params, 1, NULL, 0, false},
+    {"sendTiledLayer", LaserSharkBinRpc_sendTiledLayer_params, 1, NULL, 0, false},
+    {"getPushThreadStats", NULL, 0, LaserSharkBinRpc_getPushThreadStats_returns, 1, false},
+    {"waitForLayerDone", LaserSharkBinRpc_waitForLayerDone_params, 1, LaserSharkBinRpc_waitForLayerDone_returns, 1, false},
+    {"startLayerAfterMotion", LaserSharkBinRpc_startLayerAfterMotion_params, 2, NULL, 0, false},
+    {"resumeLayer", NULL, 0, LaserSharkBinRpc_resumeLayer_returns, 1, false},
+    {"getLayerTimings", NULL, 0, LaserSharkBinRpc_getLayerTimings_returns, 1, false},
+    {"dumpTrace", NULL, 0, LaserSharkBinRpc_dumpTrace_returns, 1, false},
+    {"executeBatch", LaserSharkBinRpc_executeBatch_params, 1, LaserSharkBinRpc_executeBatch_returns, 1, false}
+};
+
+#define LASERSHARKBINRPC_METHOD_COUNT 26
+
+#endif //_LASERSHARKBINRPCMETHODS_H_
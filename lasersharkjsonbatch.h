@@ -0,0 +1,210 @@
+/**
+ * THIS FILE IS GENERATED BY binrpcstub FROM lasershark_spec.json, DO NOT CHANGE IT!!!!!
+ */
+
+#ifndef _LASERSHARKJSONBATCH_H_
+#define _LASERSHARKJSONBATCH_H_
+
+#include <jsonrpc/rpc.h>
+
+class LaserSharkJSONBatch
+{
+    public:
+        LaserSharkJSONBatch() :
+            list(Json::arrayValue)
+        {
+        }
+
+        // What to pass to executeBatch.
+        const Json::Value& calls() const
+        {
+            return this->list;
+        }
+
+        void clear()
+        {
+            this->list = Json::Value(Json::arrayValue);
+        }
+
+        void getLaserSharkJSONVersion()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLaserSharkJSONVersion", p);
+        }
+
+        void sendLayer(const int& xUpperLeftPos, const int& yUpperLeftPos, const std::string& base64PNGData)
+        {
+            Json::Value p(Json::objectValue);
+            p["base64PNGData"] = base64PNGData;
+            p["xUpperLeftPos"] = xUpperLeftPos;
+            p["yUpperLeftPos"] = yUpperLeftPos;
+            this->add("sendLayer", p);
+        }
+
+        void startLayer()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("startLayer", p);
+        }
+
+        void stopAndClearLayer()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("stopAndClearLayer", p);
+        }
+
+        void getLayerRunning()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLayerRunning", p);
+        }
+
+        void getLayerDone()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLayerDone", p);
+        }
+
+        void getLayerErrorMessage()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLayerErrorMessage", p);
+        }
+
+        void getLayerTotalSamples()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLayerTotalSamples", p);
+        }
+
+        void getLayerSamplesLeft()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLayerSamplesLeft", p);
+        }
+
+        void setSampleRate(const int& rate)
+        {
+            Json::Value p(Json::objectValue);
+            p["rate"] = rate;
+            this->add("setSampleRate", p);
+        }
+
+        void getMaxSampleRate()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getMaxSampleRate", p);
+        }
+
+        void getResolution()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getResolution", p);
+        }
+
+        void setLayerType(const std::string& type)
+        {
+            Json::Value p(Json::objectValue);
+            p["type"] = type;
+            this->add("setLayerType", p);
+        }
+
+        void setVectorLayerOptions(const int& cornerDwellSamples, const int& cornerMinAngle, const int& blankSettleSamples)
+        {
+            Json::Value p(Json::objectValue);
+            p["blankSettleSamples"] = blankSettleSamples;
+            p["cornerDwellSamples"] = cornerDwellSamples;
+            p["cornerMinAngle"] = cornerMinAngle;
+            this->add("setVectorLayerOptions", p);
+        }
+
+        void setHatchOptions(const int& angle, const int& spacing)
+        {
+            Json::Value p(Json::objectValue);
+            p["angle"] = angle;
+            p["spacing"] = spacing;
+            this->add("setHatchOptions", p);
+        }
+
+        void setScanCompensation(const int& forwardOffset, const int& reverseOffset, const int& rampSamples)
+        {
+            Json::Value p(Json::objectValue);
+            p["forwardOffset"] = forwardOffset;
+            p["rampSamples"] = rampSamples;
+            p["reverseOffset"] = reverseOffset;
+            this->add("setScanCompensation", p);
+        }
+
+        void setDwellMode(const int& maxRepeats)
+        {
+            Json::Value p(Json::objectValue);
+            p["maxRepeats"] = maxRepeats;
+            this->add("setDwellMode", p);
+        }
+
+        void sendDwellMap(const std::string& base64PNGData)
+        {
+            Json::Value p(Json::objectValue);
+            p["base64PNGData"] = base64PNGData;
+            this->add("sendDwellMap", p);
+        }
+
+        void sendTiledLayer(const Json::Value& tiles)
+        {
+            Json::Value p(Json::objectValue);
+            p["tiles"] = tiles;
+            this->add("sendTiledLayer", p);
+        }
+
+        void getPushThreadStats()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getPushThreadStats", p);
+        }
+
+        void waitForLayerDone(const int& timeoutMs)
+        {
+            Json::Value p(Json::objectValue);
+            p["timeoutMs"] = timeoutMs;
+            this->add("waitForLayerDone", p);
+        }
+
+        void startLayerAfterMotion(const int& stepperMask, const int& settleMs)
+        {
+            Json::Value p(Json::objectValue);
+            p["settleMs"] = settleMs;
+            p["stepperMask"] = stepperMask;
+            this->add("startLayerAfterMotion", p);
+        }
+
+        void resumeLayer()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("resumeLayer", p);
+        }
+
+        void getLayerTimings()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getLayerTimings", p);
+        }
+
+        void dumpTrace()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("dumpTrace", p);
+        }
+
+    private:
+        Json::Value list;
+
+        void add(const char *method, const Json::Value& params)
+        {
+            Json::Value call;
+            call["method"] = method;
+            call["params"] = params;
+            this->list.append(call);
+        }
+};
+
+#endif //_LASERSHARKJSONBATCH_H_
@@ -19,6 +19,31 @@ class LaserSharkJSONClient
             delete this->client;
         }
 
+        Json::Value dumpTrace() throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p = Json::nullValue;
+            Json::Value result = this->client->CallMethod("dumpTrace",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value executeBatch(const Json::Value& calls) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["calls"] = calls; 
+
+            Json::Value result = this->client->CallMethod("executeBatch",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         std::string getLaserSharkJSONVersion() throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -79,6 +104,18 @@ class LaserSharkJSONClient
 
         }
 
+        Json::Value getLayerTimings() throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p = Json::nullValue;
+            Json::Value result = this->client->CallMethod("getLayerTimings",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value getLayerTotalSamples() throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -103,6 +140,18 @@ class LaserSharkJSONClient
 
         }
 
+        Json::Value getPushThreadStats() throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p = Json::nullValue;
+            Json::Value result = this->client->CallMethod("getPushThreadStats",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value getResolution() throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -123,6 +172,31 @@ class LaserSharkJSONClient
             this->client->CallNotification("printText",p);
         }
 
+        Json::Value resumeLayer() throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p = Json::nullValue;
+            Json::Value result = this->client->CallMethod("resumeLayer",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value sendDwellMap(const std::string& base64PNGData) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["base64PNGData"] = base64PNGData; 
+
+            Json::Value result = this->client->CallMethod("sendDwellMap",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value sendLayer(const std::string& base64PNGData, const int& xUpperLeftPos, const int& yUpperLeftPos) throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -138,6 +212,59 @@ p["yUpperLeftPos"] = yUpperLeftPos;
 
         }
 
+        Json::Value sendTiledLayer(const Json::Value& tiles) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["tiles"] = tiles; 
+
+            Json::Value result = this->client->CallMethod("sendTiledLayer",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value setDwellMode(const int& maxRepeats) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["maxRepeats"] = maxRepeats; 
+
+            Json::Value result = this->client->CallMethod("setDwellMode",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value setHatchOptions(const int& angle, const int& spacing) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["angle"] = angle; 
+p["spacing"] = spacing; 
+
+            Json::Value result = this->client->CallMethod("setHatchOptions",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value setLayerType(const std::string& type) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["type"] = type; 
+
+            Json::Value result = this->client->CallMethod("setLayerType",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value setSampleRate(const int& rate) throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -151,6 +278,36 @@ p["yUpperLeftPos"] = yUpperLeftPos;
 
         }
 
+        Json::Value setScanCompensation(const int& forwardOffset, const int& reverseOffset, const int& rampSamples) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["forwardOffset"] = forwardOffset; 
+p["rampSamples"] = rampSamples; 
+p["reverseOffset"] = reverseOffset; 
+
+            Json::Value result = this->client->CallMethod("setScanCompensation",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value setVectorLayerOptions(const int& blankSettleSamples, const int& cornerDwellSamples, const int& cornerMinAngle) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["blankSettleSamples"] = blankSettleSamples; 
+p["cornerDwellSamples"] = cornerDwellSamples; 
+p["cornerMinAngle"] = cornerMinAngle; 
+
+            Json::Value result = this->client->CallMethod("setVectorLayerOptions",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value startLayer() throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -163,6 +320,20 @@ p["yUpperLeftPos"] = yUpperLeftPos;
 
         }
 
+        Json::Value startLayerAfterMotion(const int& settleMs, const int& stepperMask) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["settleMs"] = settleMs; 
+p["stepperMask"] = stepperMask; 
+
+            Json::Value result = this->client->CallMethod("startLayerAfterMotion",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value stopAndClearLayer() throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -175,6 +346,19 @@ p["yUpperLeftPos"] = yUpperLeftPos;
 
         }
 
+        Json::Value waitForLayerDone(const int& timeoutMs) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["timeoutMs"] = timeoutMs; 
+
+            Json::Value result = this->client->CallMethod("waitForLayerDone",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
     private:
         jsonrpc::Client* client;
 };
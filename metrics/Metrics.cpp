@@ -0,0 +1,294 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Metrics.h"
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+
+static std::string formatDouble(double value)
+{
+	if (std::isinf(value)) {
+		return value > 0 ? "+Inf" : "-Inf";
+	}
+	if (std::isnan(value)) {
+		return "NaN";
+	}
+	char buf[32];
+	snprintf(buf, sizeof(buf), "%.12g", value);
+	return buf;
+}
+
+
+static void renderSample(std::string &out, const std::string &name, const std::string &labels, const std::string &value)
+{
+	out += name;
+	if (!labels.empty()) {
+		out += "{" + labels + "}";
+	}
+	out += " " + value + "\n";
+}
+
+
+static std::string escape(const std::string &text, bool quotes)
+{
+	std::string res;
+	for (unsigned int i = 0; i < text.size(); i++) {
+		if (text[i] == '\\') {
+			res += "\\\\";
+		} else if (text[i] == '\n') {
+			res += "\\n";
+		} else if (text[i] == '"' && quotes) {
+			res += "\\\"";
+		} else {
+			res += text[i];
+		}
+	}
+	return res;
+}
+
+
+MetricsCounter::MetricsCounter()
+{
+	count = 0;
+}
+
+
+void MetricsCounter::inc(unsigned long long amount)
+{
+	count += amount;
+}
+
+
+unsigned long long MetricsCounter::value()
+{
+	return count;
+}
+
+
+void MetricsCounter::render(std::string &out, const std::string &name, const std::string &labels)
+{
+	renderSample(out, name, labels, std::to_string(count.load()));
+}
+
+
+MetricsGauge::MetricsGauge()
+{
+	val = 0;
+}
+
+
+void MetricsGauge::set(double value)
+{
+	val = value;
+}
+
+
+double MetricsGauge::value()
+{
+	return val;
+}
+
+
+void MetricsGauge::render(std::string &out, const std::string &name, const std::string &labels)
+{
+	renderSample(out, name, labels, formatDouble(val));
+}
+
+
+MetricsHistogram::MetricsHistogram(const std::vector<double> &bounds)
+{
+	this->bounds = bounds;
+	buckets = new std::atomic<unsigned long long>[bounds.size() + 1];
+	for (unsigned int i = 0; i <= bounds.size(); i++) {
+		buckets[i] = 0;
+	}
+	sum = 0;
+}
+
+
+MetricsHistogram::~MetricsHistogram()
+{
+	delete[] buckets;
+}
+
+
+void MetricsHistogram::observe(double value)
+{
+	unsigned int i = 0;
+	while (i < bounds.size() && value > bounds[i]) {
+		i++;
+	}
+	buckets[i]++;
+
+	// There is no atomic add for doubles.
+	double expected = sum;
+	while (!sum.compare_exchange_weak(expected, expected + value)) {
+	}
+}
+
+
+/*
+	Buckets are kept per range and only made cumulative here, the count is their total so the two always agree.
+*/
+void MetricsHistogram::render(std::string &out, const std::string &name, const std::string &labels)
+{
+	std::string prefix = labels.empty() ? "" : labels + ",";
+	unsigned long long count = 0;
+	for (unsigned int i = 0; i <= bounds.size(); i++) {
+		count += buckets[i];
+		std::string le = i < bounds.size() ? formatDouble(bounds[i]) : "+Inf";
+		renderSample(out, name + "_bucket", prefix + "le=\"" + le + "\"", std::to_string(count));
+	}
+	renderSample(out, name + "_sum", labels, formatDouble(sum));
+	renderSample(out, name + "_count", labels, std::to_string(count));
+}
+
+
+MetricsRegistry::~MetricsRegistry()
+{
+	for (std::map<std::string, Family>::iterator it = families.begin(); it != families.end(); it++) {
+		for (std::map<std::string, MetricsValue*>::iterator jt = it->second.values.begin(); jt != it->second.values.end(); jt++) {
+			delete jt->second;
+		}
+	}
+}
+
+
+/*
+	The registry the host application's components record into and the metrics endpoint serves.
+*/
+MetricsRegistry &MetricsRegistry::instance()
+{
+	static MetricsRegistry registry;
+	return registry;
+}
+
+
+MetricsCounter *MetricsRegistry::counter(const std::string &name, const std::string &help,
+	const std::string &labels) throw (std::runtime_error)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	MetricsValue *&value = slot(name, help, "counter", labels);
+	if (!value) {
+		value = new MetricsCounter();
+	}
+	return static_cast<MetricsCounter*>(value);
+}
+
+
+MetricsGauge *MetricsRegistry::gauge(const std::string &name, const std::string &help,
+	const std::string &labels) throw (std::runtime_error)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	MetricsValue *&value = slot(name, help, "gauge", labels);
+	if (!value) {
+		value = new MetricsGauge();
+	}
+	return static_cast<MetricsGauge*>(value);
+}
+
+
+/*
+	bounds is only used when the histogram is created.
+*/
+MetricsHistogram *MetricsRegistry::histogram(const std::string &name, const std::string &help,
+	const std::vector<double> &bounds, const std::string &labels) throw (std::runtime_error)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	MetricsValue *&value = slot(name, help, "histogram", labels);
+	if (!value) {
+		value = new MetricsHistogram(bounds);
+	}
+	return static_cast<MetricsHistogram*>(value);
+}
+
+
+/*
+	Returns every metric in the text exposition format, families sorted by name.
+*/
+std::string MetricsRegistry::render()
+{
+	std::string out;
+	mutex.lock();
+	for (std::map<std::string, Family>::iterator it = families.begin(); it != families.end(); it++) {
+		out += "# HELP " + it->first + " " + escape(it->second.help, false) + "\n";
+		out += "# TYPE " + it->first + " " + it->second.type + "\n";
+		for (std::map<std::string, MetricsValue*>::iterator jt = it->second.values.begin(); jt != it->second.values.end(); jt++) {
+			jt->second->render(out, it->first, jt->first);
+		}
+	}
+	mutex.unlock();
+	return out;
+}
+
+
+/*
+	Formats a label for the labels argument of the metric getters. Several are joined with commas.
+*/
+std::string MetricsRegistry::label(const std::string &name, const std::string &value)
+{
+	return name + "=\"" + escape(value, true) + "\"";
+}
+
+
+std::vector<double> MetricsRegistry::exponentialBuckets(double start, double factor, unsigned int count)
+{
+	std::vector<double> bounds;
+	for (unsigned int i = 0; i < count; i++) {
+		bounds.push_back(start);
+		start *= factor;
+	}
+	return bounds;
+}
+
+
+std::vector<double> MetricsRegistry::linearBuckets(double start, double width, unsigned int count)
+{
+	std::vector<double> bounds;
+	for (unsigned int i = 0; i < count; i++) {
+		bounds.push_back(start + i*width);
+	}
+	return bounds;
+}
+
+
+/*
+	Returns the family's slot for labels, NULL if it is new. Throws if name is already used by another type of
+	metric. mutex must be held when calling this.
+*/
+MetricsValue *&MetricsRegistry::slot(const std::string &name, const std::string &help, const std::string &type,
+	const std::string &labels) throw (std::runtime_error)
+{
+	std::map<std::string, Family>::iterator it = families.find(name);
+	if (it == families.end()) {
+		Family &family = families[name];
+		family.help = help;
+		family.type = type;
+		return family.values[labels];
+	}
+
+	if (it->second.type != type) {
+		std::ostringstream oss;
+		oss << "Metric " << name << " is already registered as a " << it->second.type << ".";
+		throw std::runtime_error(oss.str());
+	}
+	return it->second.values[labels];
+}
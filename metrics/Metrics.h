@@ -0,0 +1,128 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+
+/*
+	A single value in a metric family, rendered in the Prometheus text exposition format. Updates are lock free so
+	they can be made from the push thread.
+*/
+class MetricsValue
+{
+	public:
+		virtual ~MetricsValue() {}
+		virtual void render(std::string &out, const std::string &name, const std::string &labels) = 0;
+};
+
+
+class MetricsCounter : public MetricsValue
+{
+	public:
+		MetricsCounter();
+		void inc(unsigned long long amount = 1);
+		unsigned long long value();
+		void render(std::string &out, const std::string &name, const std::string &labels);
+
+	private:
+		std::atomic<unsigned long long> count;
+};
+
+
+class MetricsGauge : public MetricsValue
+{
+	public:
+		MetricsGauge();
+		void set(double value);
+		double value();
+		void render(std::string &out, const std::string &name, const std::string &labels);
+
+	private:
+		std::atomic<double> val;
+};
+
+
+/*
+	Counts observations into buckets with the given upper bounds, which must be ascending. Anything above the last
+	bound goes into the +Inf bucket.
+*/
+class MetricsHistogram : public MetricsValue
+{
+	public:
+		MetricsHistogram(const std::vector<double> &bounds);
+		~MetricsHistogram();
+		void observe(double value);
+		void render(std::string &out, const std::string &name, const std::string &labels);
+
+	private:
+		std::vector<double> bounds;
+		std::atomic<unsigned long long> *buckets; // bounds.size() + 1 of them, the last is +Inf.
+		std::atomic<double> sum;
+};
+
+
+/*
+	Holds metrics by name and label set. Asking for a metric that already exists returns it, so callers on hot
+	paths should look theirs up once and keep the pointer, which stays valid as long as the registry.
+	Labels are given preformatted, see label().
+*/
+class MetricsRegistry
+{
+	public:
+		~MetricsRegistry();
+
+		static MetricsRegistry &instance();
+
+		MetricsCounter *counter(const std::string &name, const std::string &help,
+			const std::string &labels = "") throw (std::runtime_error);
+		MetricsGauge *gauge(const std::string &name, const std::string &help,
+			const std::string &labels = "") throw (std::runtime_error);
+		MetricsHistogram *histogram(const std::string &name, const std::string &help, const std::vector<double> &bounds,
+			const std::string &labels = "") throw (std::runtime_error);
+
+		std::string render();
+
+		static std::string label(const std::string &name, const std::string &value);
+		static std::vector<double> exponentialBuckets(double start, double factor, unsigned int count);
+		static std::vector<double> linearBuckets(double start, double width, unsigned int count);
+
+	private:
+		struct Family
+		{
+			std::string help;
+			std::string type;
+			std::map<std::string, MetricsValue*> values;
+		};
+
+		MetricsValue *&slot(const std::string &name, const std::string &help, const std::string &type,
+			const std::string &labels) throw (std::runtime_error);
+
+		std::mutex mutex;
+		std::map<std::string, Family> families;
+};
+
+#endif //_METRICS_H_
@@ -0,0 +1,194 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "MetricsHttpServer.h"
+#include <iostream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include "debug.h"
+
+// How long the server thread blocks waiting for a connection, this bounds how long stopping it takes.
+#define METRICS_HTTP_POLL_MS 100
+
+// A scraper that stalls mid request is dropped after this long so it can't hold up the next one.
+#define METRICS_HTTP_IO_TIMEOUT_MS 1000
+
+#define METRICS_HTTP_MAX_REQUEST_SIZE 8192
+
+
+MetricsHttpServer::MetricsHttpServer(MetricsRegistry *registry, int port)
+{
+	this->registry = registry;
+	this->port = port;
+	listen_fd = -1;
+	thread = NULL;
+	thread_should_exit = false;
+}
+
+
+MetricsHttpServer::~MetricsHttpServer()
+{
+	StopListening();
+}
+
+
+/*
+	Returns false if the port could not be bound or the server thread started.
+*/
+bool MetricsHttpServer::StartListening()
+{
+	if (thread) {
+		return true;
+	}
+
+	listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listen_fd < 0) {
+		std::cerr << "Error creating metrics socket: " << strerror(errno) << std::endl;
+		return false;
+	}
+
+	int reuse = 1;
+	setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+	if (bind(listen_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(listen_fd, 8) != 0) {
+		std::cerr << "Error listening for metrics on port " << port << ": " << strerror(errno) << std::endl;
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+	}
+
+	thread_should_exit = false;
+	try {
+		thread = new std::thread(&MetricsHttpServer::serve, this);
+	} catch (std::system_error e) {
+		std::cerr << "Error allocating thread: " << e.what() << std::endl;
+		close(listen_fd);
+		listen_fd = -1;
+		return false;
+	}
+
+	return true;
+}
+
+
+bool MetricsHttpServer::StopListening()
+{
+	if (!thread) {
+		return false;
+	}
+
+	thread_should_exit = true;
+	thread->join();
+	delete thread;
+	thread = NULL;
+
+	close(listen_fd);
+	listen_fd = -1;
+	return true;
+}
+
+
+void MetricsHttpServer::serve()
+{
+	D(std::cout << "Metrics server thread starting" << std::endl;)
+
+	while (!thread_should_exit) {
+		struct pollfd pfd;
+		pfd.fd = listen_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, METRICS_HTTP_POLL_MS) <= 0) {
+			continue;
+		}
+
+		int fd = accept(listen_fd, NULL, NULL);
+		if (fd < 0) {
+			continue;
+		}
+
+		struct timeval tv;
+		tv.tv_sec = METRICS_HTTP_IO_TIMEOUT_MS/1000;
+		tv.tv_usec = (METRICS_HTTP_IO_TIMEOUT_MS%1000)*1000;
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+		handleConnection(fd);
+		close(fd);
+	}
+
+	D(std::cout << "Metrics server thread exiting" << std::endl;)
+}
+
+
+/*
+	Only the request line matters, the headers are read and ignored.
+*/
+void MetricsHttpServer::handleConnection(int fd)
+{
+	std::string request;
+	char buf[1024];
+	while (request.find("\r\n\r\n") == std::string::npos && request.size() < METRICS_HTTP_MAX_REQUEST_SIZE) {
+		ssize_t len = recv(fd, buf, sizeof(buf), 0);
+		if (len <= 0) {
+			return;
+		}
+		request.append(buf, len);
+	}
+
+	std::string line = request.substr(0, request.find("\r\n"));
+	std::string method = line.substr(0, line.find(' '));
+	std::string path = line.size() > method.size() ? line.substr(method.size() + 1) : "";
+	path = path.substr(0, path.find(' '));
+	path = path.substr(0, path.find('?'));
+
+	if (method != "GET") {
+		sendResponse(fd, "405 Method Not Allowed", "Only GET is supported.\n");
+	} else if (path != "/metrics") {
+		sendResponse(fd, "404 Not Found", "Metrics are served at /metrics.\n");
+	} else {
+		sendResponse(fd, "200 OK", registry->render());
+	}
+}
+
+
+void MetricsHttpServer::sendResponse(int fd, const std::string &status, const std::string &body)
+{
+	std::string response = "HTTP/1.1 " + status + "\r\n"
+		"Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+		"Content-Length: " + std::to_string(body.size()) + "\r\n"
+		"Connection: close\r\n\r\n" + body;
+
+	size_t sent = 0;
+	while (sent < response.size()) {
+		ssize_t len = send(fd, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+		if (len <= 0) {
+			return;
+		}
+		sent += len;
+	}
+}
@@ -0,0 +1,55 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _METRICSHTTPSERVER_H_
+#define _METRICSHTTPSERVER_H_
+
+#include <thread>
+#include <atomic>
+#include <string>
+
+#include "Metrics.h"
+
+
+/*
+	Serves a registry at GET /metrics for Prometheus to scrape. Scrapes are rare and cheap, so connections are
+	handled one at a time on a single thread and closed after each response.
+*/
+class MetricsHttpServer
+{
+	public:
+		MetricsHttpServer(MetricsRegistry *registry, int port);
+		~MetricsHttpServer();
+
+		bool StartListening();
+		bool StopListening();
+
+	private:
+		void serve();
+		void handleConnection(int fd);
+		void sendResponse(int fd, const std::string &status, const std::string &body);
+
+		MetricsRegistry *registry;
+		int port;
+		int listen_fd;
+		std::thread *thread;
+		std::atomic<bool> thread_should_exit;
+};
+
+#endif //_METRICSHTTPSERVER_H_
@@ -0,0 +1,252 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "Trace.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+
+static std::atomic<unsigned int> next_tid(1);
+static thread_local unsigned int trace_tid = 0;
+
+
+static std::string escape(const std::string &text)
+{
+	std::string res;
+	for (unsigned int i = 0; i < text.size(); i++) {
+		if (text[i] == '"' || text[i] == '\\') {
+			res += '\\';
+		}
+		res += text[i];
+	}
+	return res;
+}
+
+
+Tracer::Tracer()
+{
+	active = false;
+	events = NULL;
+	capacity = 0;
+	next = 0;
+}
+
+
+Tracer::~Tracer()
+{
+	delete[] events;
+}
+
+
+Tracer &Tracer::instance()
+{
+	static Tracer tracer;
+	return tracer;
+}
+
+
+/*
+	Starts recording, keeping the last capacity events. It can only be turned on once, and should be before the
+	threads being traced start. Returns false if it was already on or capacity is 0.
+*/
+bool Tracer::enable(unsigned int capacity)
+{
+	if (active || capacity == 0) {
+		return false;
+	}
+
+	events = new Event[capacity];
+	for (unsigned int i = 0; i < capacity; i++) {
+		events[i].seq = 0;
+	}
+	this->capacity = capacity;
+	active = true;
+
+	return true;
+}
+
+
+bool Tracer::enabled()
+{
+	return active.load(std::memory_order_relaxed);
+}
+
+
+/*
+	The clock events are timed with, in ns.
+*/
+unsigned long long Tracer::now()
+{
+	return timestamp(std::chrono::steady_clock::now());
+}
+
+
+unsigned long long Tracer::timestamp(std::chrono::steady_clock::time_point time)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+
+/*
+	Records an event that ran from start_ns to end_ns on the calling thread, see now. Does nothing if tracing is off.
+*/
+void Tracer::complete(const char *name, const char *category, unsigned long long start_ns, unsigned long long end_ns,
+	long long arg)
+{
+	if (!enabled()) {
+		return;
+	}
+
+	unsigned long long index = next.fetch_add(1, std::memory_order_relaxed);
+	Event &event = events[index % capacity];
+	// A reader that sees seq change while it copies the event throws the copy away.
+	event.seq.store(0, std::memory_order_release);
+	std::atomic_thread_fence(std::memory_order_release);
+	event.name = name;
+	event.category = category;
+	event.tid = threadId();
+	event.start_ns = start_ns;
+	event.dur_ns = end_ns > start_ns ? end_ns - start_ns : 0;
+	event.arg = arg;
+	event.seq.store(index + 1, std::memory_order_release);
+}
+
+
+/*
+	Names the calling thread in the trace.
+*/
+void Tracer::setThreadName(const std::string &name)
+{
+	thread_names_mutex.lock();
+	thread_names[threadId()] = name;
+	thread_names_mutex.unlock();
+}
+
+
+/*
+	Writes the trace to path. count is set to the number of events written. Returns false if tracing is off or
+	the file could not be written.
+*/
+bool Tracer::dump(const std::string &path, unsigned int *count)
+{
+	if (!enabled()) {
+		return false;
+	}
+
+	std::string trace = render(count);
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+	out << trace;
+	out.close();
+	if (out.fail()) {
+		std::cerr << "Error writing trace to " << path << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+/*
+	Returns the recorded events, oldest first, as a Chrome trace. Events still being written are left out. count
+	is set to the number of events if given.
+*/
+std::string Tracer::render(unsigned int *count)
+{
+	std::string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+	bool first = true;
+	unsigned int rendered = 0;
+
+	thread_names_mutex.lock();
+	for (std::map<unsigned int, std::string>::iterator it = thread_names.begin(); it != thread_names.end(); it++) {
+		out += first ? "" : ",";
+		out += "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(it->first) +
+			",\"args\":{\"name\":\"" + escape(it->second) + "\"}}";
+		first = false;
+	}
+	thread_names_mutex.unlock();
+
+	if (enabled()) {
+		unsigned long long end = next.load(std::memory_order_acquire);
+		unsigned long long begin = end > capacity ? end - capacity : 0;
+		for (unsigned long long index = begin; index < end; index++) {
+			Event &event = events[index % capacity];
+			unsigned long long seq = event.seq.load(std::memory_order_acquire);
+			const char *name = event.name;
+			const char *category = event.category;
+			unsigned int tid = event.tid;
+			unsigned long long start_ns = event.start_ns;
+			unsigned long long dur_ns = event.dur_ns;
+			long long arg = event.arg;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (seq != index + 1 || event.seq.load(std::memory_order_relaxed) != seq) {
+				continue;
+			}
+
+			// Chrome wants microseconds, the fraction keeps the ns.
+			char times[64];
+			snprintf(times, sizeof(times), "\"ts\":%llu.%03llu,\"dur\":%llu.%03llu",
+				start_ns/1000, start_ns%1000, dur_ns/1000, dur_ns%1000);
+			out += first ? "" : ",";
+			out += "\n{\"name\":\"" + escape(name) + "\",\"cat\":\"" + escape(category) + "\",\"ph\":\"X\",\"pid\":1,\"tid\":" +
+				std::to_string(tid) + "," + times;
+			if (arg >= 0) {
+				out += ",\"args\":{\"value\":" + std::to_string(arg) + "}";
+			}
+			out += "}";
+			first = false;
+			rendered++;
+		}
+	}
+	out += "\n]}\n";
+
+	if (count) {
+		*count = rendered;
+	}
+	return out;
+}
+
+
+/*
+	Small ids are given out as threads first record something, so traces are easy to read.
+*/
+unsigned int Tracer::threadId()
+{
+	if (!trace_tid) {
+		trace_tid = next_tid++;
+	}
+	return trace_tid;
+}
+
+
+TraceScope::TraceScope(const char *name, const char *category, long long arg)
+{
+	this->name = name;
+	this->category = category;
+	this->arg = arg;
+	start_ns = Tracer::instance().enabled() ? Tracer::now() : 0;
+}
+
+
+TraceScope::~TraceScope()
+{
+	if (start_ns) {
+		Tracer::instance().complete(name, category, start_ns, Tracer::now(), arg);
+	}
+}
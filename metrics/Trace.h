@@ -0,0 +1,98 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <chrono>
+
+
+/*
+	Keeps the most recent timed events in a fixed ring buffer and writes them out in the Chrome trace event format,
+	for viewing in chrome://tracing or Perfetto. Tracing is off until enable is called. When it is off recording
+	costs a single check, and when it is on recording an event doesn't lock or allocate, so it can be left in the
+	push thread.
+	Event names and categories must be string literals, only the pointers are kept.
+*/
+class Tracer
+{
+	public:
+		~Tracer();
+
+		static Tracer &instance();
+
+		bool enable(unsigned int capacity);
+		bool enabled();
+
+		static unsigned long long now();
+		static unsigned long long timestamp(std::chrono::steady_clock::time_point time);
+		void complete(const char *name, const char *category, unsigned long long start_ns, unsigned long long end_ns,
+			long long arg = -1);
+		void setThreadName(const std::string &name);
+
+		std::string render(unsigned int *count = NULL);
+		bool dump(const std::string &path, unsigned int *count = NULL);
+
+	private:
+		struct Event
+		{
+			std::atomic<unsigned long long> seq; // 0 while being written, otherwise the event's index + 1.
+			const char *name;
+			const char *category;
+			unsigned int tid;
+			unsigned long long start_ns;
+			unsigned long long dur_ns;
+			long long arg;
+		};
+
+		Tracer();
+		static unsigned int threadId();
+
+		std::atomic<bool> active;
+		Event *events;
+		unsigned int capacity;
+		std::atomic<unsigned long long> next;
+		std::mutex thread_names_mutex;
+		std::map<unsigned int, std::string> thread_names;
+};
+
+
+/*
+	Records the time from its construction to its destruction as an event, if tracing is on. arg is shown with the
+	event when it is 0 or more.
+*/
+class TraceScope
+{
+	public:
+		TraceScope(const char *name, const char *category, long long arg = -1);
+		~TraceScope();
+
+	private:
+		const char *name;
+		const char *category;
+		long long arg;
+		unsigned long long start_ns;
+};
+
+#endif //_TRACE_H_
@@ -19,7 +19,12 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 
 #include <iostream>
 #include <sstream>
+#include <chrono>
+#include <thread>
+#include <algorithm>
 #include "TwoStep.h"
+#include "metrics/Metrics.h"
+#include "metrics/Trace.h"
 #include "debug.h"
 
 extern "C" {
@@ -27,24 +32,40 @@ extern "C" {
 #include "lasershark_hostapp/ls_ub_twostep_lib.h"
 }
 
+//#define TWOSTEP_VERSION;
 
-#define LASERSHARK_VIN 0x1fc9
-#define LASERSHARK_PID 0x04d8
+// How often waitForMotionComplete asks the steppers if they are moving. Each poll is a uart bridge round trip,
+// so this trades a little bridge traffic for stopping within a few ms of the motion ending.
+#define TWOSTEP_MOTION_POLL_INTERVAL_MS 10
 
-//#define TWOSTEP_VERSION;
+// A profiled move starts polling for its end this long before it is expected to finish, then polls every
+// TWOSTEP_PROFILE_POLL_INTERVAL_MS so waitForMotionComplete returns right after.
+#define TWOSTEP_PROFILE_POLL_LEAD_MS 5
+#define TWOSTEP_PROFILE_POLL_INTERVAL_MS 1
+
+// The least time a slow down is sent ahead of its segment boundary, in case the bridge is slower than last time.
+#define TWOSTEP_PROFILE_SWITCH_LEAD_MS 5
 
 
-TwoStep::TwoStep()
+TwoStep::TwoStep(LaserSharkUsbSession *usb)
 {
-	devh_ub = NULL;
-	devh_ub_claimed = false;
+	this->usb = usb;
+	usb_open = false;
+	invalidateSettings();
+	profile_thread = NULL;
+	profile_running = false;
+	profile_stepper_mask = 0;
+	profile_cancel = false;
+	hotplug_listener_id = usb->addHotplugListener(std::bind(&TwoStep::usbHotplug, this, std::placeholders::_1));
 }
 
 TwoStep::~TwoStep()
 {
+	usb->removeHotplugListener(hotplug_listener_id);
 	if (connected()) {
 		disconnect();
 	}
+	cleanupProfileThread();
 }
 
 
@@ -55,7 +76,6 @@ TwoStep::~TwoStep()
 */
 bool TwoStep::connect() throw (std::runtime_error)
 {
-	int rc;
 	ub_mutex.lock();
 	if (connected()) {
 		// Already connected.
@@ -64,28 +84,22 @@ bool TwoStep::connect() throw (std::runtime_error)
 	}
 
 
-    devh_ub = libusb_open_device_with_vid_pid(NULL, LASERSHARK_VIN, LASERSHARK_PID);
-    if (!devh_ub)
-    {
-		// No device
-		shutdown();
-		ub_mutex.unlock();
-
-		return false;
-    }
-
-    rc = libusb_claim_interface(devh_ub, 2);
-    if (rc < 0)
-    {
-		shutdown();
+	try {
+		if (!usb->open()) {
+			// No device
+			ub_mutex.unlock();
+			return false;
+		}
+	} catch (std::runtime_error e) {
 		ub_mutex.unlock();
-
-		std::ostringstream oss;
-		oss << "Error claiming control interface: " << libusb_error_name(rc);
-		std::cerr << oss << std::endl;
-    	throw std::runtime_error(oss.str()); 
-    }
-	devh_ub_claimed = true;
+		std::cerr << e.what() << std::endl;
+		throw;
+	}
+	usb_open = true;
+	invalidateSettings();
+	for (int i = 0; i < TWOSTEP_STEPPER_COUNT; i++) {
+		configured[i] = settings[i];
+	}
 
 
     ub_mutex.unlock();
@@ -117,16 +131,20 @@ bool TwoStep::connect() throw (std::runtime_error)
 
 bool TwoStep::connected()
 {
-	return devh_ub_claimed;
+	return usb_open;
 }
 
 
 void TwoStep::disconnect() 
 {
 	stopAndDisable();
+	cleanupProfileThread();
 	ub_mutex.lock();
-	release();
-	shutdown();
+	if (usb_open) {
+		usb_open = false;
+		usb->close();
+	}
+	invalidateSettings();
 	ub_mutex.unlock();
 
 }
@@ -135,7 +153,8 @@ void TwoStep::disconnect()
 void TwoStep::setSafeSteps(int stepperNum, int steps) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_safe_steps(devh_ub, stepperNum, steps);
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	unsigned char res = endCommand("set_safe_steps", ls_ub_twostep_set_safe_steps(usb->getHandle(), stepperNum, steps));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -145,7 +164,8 @@ void TwoStep::setSafeSteps(int stepperNum, int steps) throw (std::runtime_error)
 void TwoStep::setSteps(int stepperNum, int steps) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_steps(devh_ub, stepperNum, steps);
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	unsigned char res = endCommand("set_steps", ls_ub_twostep_set_steps(usb->getHandle(), stepperNum, steps));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -154,7 +174,8 @@ void TwoStep::setSteps(int stepperNum, int steps) throw (std::runtime_error)
 void TwoStep::setStepUntilSwitch(int stepperNum) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_step_until_switch(devh_ub, stepperNum);
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	unsigned char res = endCommand("set_step_until_switch", ls_ub_twostep_set_step_until_switch(usb->getHandle(), stepperNum));
 	ub_mutex.unlock();
 	
 	handleBadResponse(res);
@@ -163,7 +184,8 @@ void TwoStep::setStepUntilSwitch(int stepperNum) throw (std::runtime_error)
 void TwoStep::start(bool stepperOne, bool stepperTwo) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_start(devh_ub, (stepperOne ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : 0) | (stepperTwo ? TWOSTEP_STEPPER_BITFIELD_STEPPER_2 : 0));
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	unsigned char res = endCommand("start", ls_ub_twostep_start(usb->getHandle(), (stepperOne ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : 0) | (stepperTwo ? TWOSTEP_STEPPER_BITFIELD_STEPPER_2 : 0)));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -172,8 +194,11 @@ void TwoStep::start(bool stepperOne, bool stepperTwo) throw (std::runtime_error)
 
 void TwoStep::stop(bool stepperOne, bool stepperTwo) throw (std::runtime_error)
 {
+	// Cancelled before taking ub_mutex so a profiled move can't start another segment after the stop.
+	cancelProfile((stepperOne ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : 0) | (stepperTwo ? TWOSTEP_STEPPER_BITFIELD_STEPPER_2 : 0));
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_stop(devh_ub, (stepperOne ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : 0) | (stepperTwo ? TWOSTEP_STEPPER_BITFIELD_STEPPER_2 : 0));
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	unsigned char res = endCommand("stop", ls_ub_twostep_stop(usb->getHandle(), (stepperOne ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : 0) | (stepperTwo ? TWOSTEP_STEPPER_BITFIELD_STEPPER_2 : 0)));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -184,7 +209,8 @@ bool TwoStep::getIsMoving(int stepperNum) throw (std::runtime_error)
 {
 	bool value;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_is_moving(devh_ub, stepperNum, &value);
+	beginCommand(LaserSharkUsbSession::PRIORITY_STATUS);
+	unsigned char res = endCommand("get_is_moving", ls_ub_twostep_get_is_moving(usb->getHandle(), stepperNum, &value));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -192,10 +218,51 @@ bool TwoStep::getIsMoving(int stepperNum) throw (std::runtime_error)
 }
 
 
+/*
+	Polls the steppers in stepperMask (TWOSTEP_STEPPER_BITFIELD_* values) until none of them are moving or
+	timeoutMs passes. Returns true if they all stopped. ub_mutex is only held for each poll, so other commands
+	can go through while waiting. A profiled move on one of the steppers is waited for as a whole, and if it
+	failed its error is thrown.
+*/
+bool TwoStep::waitForMotionComplete(int stepperMask, unsigned int timeoutMs) throw (std::runtime_error)
+{
+	if (stepperMask & ~(TWOSTEP_STEPPER_BITFIELD_STEPPER_1 | TWOSTEP_STEPPER_BITFIELD_STEPPER_2)) {
+		std::ostringstream oss;
+		oss << "Invalid stepper mask: " << stepperMask;
+		throw std::runtime_error(oss.str());
+	}
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+	if (!waitForProfile(stepperMask, deadline)) {
+		return false;
+	}
+
+	while (true) {
+		bool moving = false;
+		if (stepperMask & TWOSTEP_STEPPER_BITFIELD_STEPPER_1) {
+			moving = getIsMoving(TWOSTEP_STEPPER_1);
+		}
+		if (!moving && (stepperMask & TWOSTEP_STEPPER_BITFIELD_STEPPER_2)) {
+			moving = getIsMoving(TWOSTEP_STEPPER_2);
+		}
+
+		if (!moving) {
+			return true;
+		}
+
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now >= deadline) {
+			return false;
+		}
+		std::this_thread::sleep_for(std::min(std::chrono::steady_clock::duration(std::chrono::milliseconds(TWOSTEP_MOTION_POLL_INTERVAL_MS)), deadline - now));
+	}
+}
+
+
 void TwoStep::setEnable(int stepperNum, bool enable) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_enable(devh_ub, stepperNum, enable);
+	unsigned char res = writeSetting(stepperNum, &StepperSettings::enable, enable);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -204,9 +271,9 @@ void TwoStep::setEnable(int stepperNum, bool enable) throw (std::runtime_error)
 
 bool TwoStep::getEnable(int stepperNum) throw (std::runtime_error)
 {
-	bool value;
+	int value;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_enable(devh_ub, stepperNum, &value);
+	unsigned char res = readSetting(stepperNum, &StepperSettings::enable, value);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -217,7 +284,7 @@ bool TwoStep::getEnable(int stepperNum) throw (std::runtime_error)
 void TwoStep::setMicrosteps(int stepperNum,  int microsteps) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_microsteps(devh_ub, stepperNum, microsteps);
+	unsigned char res = writeSetting(stepperNum, &StepperSettings::microsteps, microsteps);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -226,9 +293,9 @@ void TwoStep::setMicrosteps(int stepperNum,  int microsteps) throw (std::runtime
 
 unsigned int TwoStep::getMicrosteps(int stepperNum) throw (std::runtime_error)
 {
-	unsigned char value;
+	int value;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_microsteps(devh_ub, stepperNum, &value);
+	unsigned char res = readSetting(stepperNum, &StepperSettings::microsteps, value);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -239,7 +306,7 @@ unsigned int TwoStep::getMicrosteps(int stepperNum) throw (std::runtime_error)
 void TwoStep::setDir(int stepperNum, bool high) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_dir(devh_ub, stepperNum, high);
+	unsigned char res = writeSetting(stepperNum, &StepperSettings::dir, high);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -248,9 +315,9 @@ void TwoStep::setDir(int stepperNum, bool high) throw (std::runtime_error)
 
 bool TwoStep::getDir(int stepperNum) throw (std::runtime_error)
 {
-	bool high;
+	int high;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_dir(devh_ub, stepperNum, &high);
+	unsigned char res = readSetting(stepperNum, &StepperSettings::dir, high);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -262,7 +329,7 @@ bool TwoStep::getDir(int stepperNum) throw (std::runtime_error)
 void TwoStep::setCurrent(int stepperNum, int value) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_current(devh_ub, stepperNum, value);
+	unsigned char res = writeSetting(stepperNum, &StepperSettings::current, value);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -271,9 +338,9 @@ void TwoStep::setCurrent(int stepperNum, int value) throw (std::runtime_error)
 
 unsigned int TwoStep::getCurrent(int stepperNum) throw (std::runtime_error)
 {
-	unsigned short value;
+	int value;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_current(devh_ub, stepperNum, &value);
+	unsigned char res = readSetting(stepperNum, &StepperSettings::current, value);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -284,7 +351,7 @@ unsigned int TwoStep::getCurrent(int stepperNum) throw (std::runtime_error)
 void TwoStep::set100uSDelay(int stepperNum, int value) throw (std::runtime_error)
 {
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_set_100uS_delay(devh_ub, stepperNum, value);
+	unsigned char res = writeSetting(stepperNum, &StepperSettings::delay, value);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -293,9 +360,9 @@ void TwoStep::set100uSDelay(int stepperNum, int value) throw (std::runtime_error
 
 unsigned int TwoStep::get100uSDelay(int stepperNum) throw (std::runtime_error)
 {
-	unsigned short value;
+	int value;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_100uS_delay(devh_ub, stepperNum, &value);
+	unsigned char res = readSetting(stepperNum, &StepperSettings::delay, value);
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -303,11 +370,113 @@ unsigned int TwoStep::get100uSDelay(int stepperNum) throw (std::runtime_error)
 }
 
 
+/*
+	Moves stepperNum by steps (as safe steps) and starts it. Settings that already have the requested value are
+	skipped, and ub_mutex is held for the whole sequence so no other command can change the stepper in between.
+*/
+void TwoStep::move(int stepperNum, bool high, int steps, int delay, int current, int microsteps) throw (std::runtime_error)
+{
+	if (!validStepper(stepperNum)) {
+		std::ostringstream oss;
+		oss << "Invalid stepper: " << stepperNum;
+		throw std::runtime_error(oss.str());
+	}
+
+	ub_mutex.lock();
+	unsigned char res = writeSetting(stepperNum, &StepperSettings::microsteps, microsteps);
+	if (res == LS_UB_TWOSTEP_SUCCESS) {
+		res = writeSetting(stepperNum, &StepperSettings::current, current);
+	}
+	if (res == LS_UB_TWOSTEP_SUCCESS) {
+		res = writeSetting(stepperNum, &StepperSettings::delay, delay);
+	}
+	if (res == LS_UB_TWOSTEP_SUCCESS) {
+		res = writeSetting(stepperNum, &StepperSettings::dir, high);
+	}
+	if (res == LS_UB_TWOSTEP_SUCCESS) {
+		beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+		res = endCommand("set_safe_steps", ls_ub_twostep_set_safe_steps(usb->getHandle(), stepperNum, steps));
+	}
+	if (res == LS_UB_TWOSTEP_SUCCESS) {
+		beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+		res = endCommand("start", ls_ub_twostep_start(usb->getHandle(), stepperNum == TWOSTEP_STEPPER_1 ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : TWOSTEP_STEPPER_BITFIELD_STEPPER_2));
+	}
+	ub_mutex.unlock();
+
+	handleBadResponse(res);
+}
+
+
+/*
+	Sets the speed profile moveProfiled uses for stepperNum, see TwoStepMotionPlanner::setProfile.
+*/
+void TwoStep::setMotionProfile(int stepperNum, int startDelay, int cruiseDelay, double acceleration) throw (std::runtime_error)
+{
+	if (!validStepper(stepperNum)) {
+		std::ostringstream oss;
+		oss << "Invalid stepper: " << stepperNum;
+		throw std::runtime_error(oss.str());
+	}
+
+	profile_mutex.lock();
+	planners[stepperNum].setProfile(startDelay, cruiseDelay, acceleration);
+	profile_mutex.unlock();
+}
+
+
+/*
+	Like move, but the move is split into accelerate, cruise and decelerate segments by the stepper's motion
+	profile. The segments run in the background, use waitForMotionComplete to wait for the whole move and stop
+	to cancel it. Only one profiled move can run at a time.
+*/
+void TwoStep::moveProfiled(int stepperNum, bool high, int steps, int current, int microsteps) throw (std::runtime_error)
+{
+	if (!validStepper(stepperNum)) {
+		std::ostringstream oss;
+		oss << "Invalid stepper: " << stepperNum;
+		throw std::runtime_error(oss.str());
+	}
+
+	profile_mutex.lock();
+	if (profile_running) {
+		profile_mutex.unlock();
+		std::ostringstream oss;
+		oss << "A profiled move is already running.";
+		throw std::runtime_error(oss.str());
+	}
+	std::vector<TwoStepMotionSegment> segments = planners[stepperNum].plan(steps);
+	profile_mutex.unlock();
+	if (segments.empty()) {
+		return;
+	}
+
+	// Joins the thread of the previous profiled move, which has finished.
+	cleanupProfileThread();
+
+	profile_mutex.lock();
+	profile_running = true;
+	profile_cancel = false;
+	profile_stepper_mask = stepperNum == TWOSTEP_STEPPER_1 ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : TWOSTEP_STEPPER_BITFIELD_STEPPER_2;
+	profile_error_message.clear();
+	try {
+		profile_thread = new std::thread(&TwoStep::runProfile, this, stepperNum, high, segments, current, microsteps);
+	} catch (std::system_error e) {
+		profile_running = false;
+		profile_mutex.unlock();
+		std::ostringstream oss;
+		oss << "Error allocating thread: " << e.what();
+		throw std::runtime_error(oss.str());
+	}
+	profile_mutex.unlock();
+}
+
+
 void TwoStep::getSwitchStatus(bool& r1_a, bool &r1_b, bool &r2_a, bool &r2_b) throw (std::runtime_error)
 {
 	unsigned char switches;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_switch_status(devh_ub, &switches);
+	beginCommand(LaserSharkUsbSession::PRIORITY_STATUS);
+	unsigned char res = endCommand("get_switch_status", ls_ub_twostep_get_switch_status(usb->getHandle(), &switches));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -343,7 +512,8 @@ int TwoStep::getVersion() throw (std::runtime_error)
 {
 	unsigned char version;
 	ub_mutex.lock();
-	unsigned char res = ls_ub_twostep_get_version(devh_ub, &version);
+	beginCommand(LaserSharkUsbSession::PRIORITY_STATUS);
+	unsigned char res = endCommand("get_version", ls_ub_twostep_get_version(usb->getHandle(), &version));
 	ub_mutex.unlock();
 
 	handleBadResponse(res);
@@ -351,22 +521,329 @@ int TwoStep::getVersion() throw (std::runtime_error)
 }
 
 
-void TwoStep::release()
+/*
+	A profiled move can't go on without the device, so it is cancelled when the device is detached. Once it is
+	back the steppers are stopped and given the settings they were last asked for, enable last.
+*/
+void TwoStep::usbHotplug(LaserSharkUsbSession::HotplugEvent event)
 {
-	if (devh_ub_claimed) {
-		devh_ub_claimed = false;
-    	libusb_release_interface(devh_ub, 0);
+	static int StepperSettings::* const restore_order[] = {
+		&StepperSettings::microsteps,
+		&StepperSettings::current,
+		&StepperSettings::delay,
+		&StepperSettings::dir,
+		&StepperSettings::enable
+	};
+
+	if (!connected()) {
+		return;
+	}
+
+	if (event == LaserSharkUsbSession::HOTPLUG_DETACHED) {
+		cancelProfile(TWOSTEP_STEPPER_BITFIELD_STEPPER_1 | TWOSTEP_STEPPER_BITFIELD_STEPPER_2);
+		return;
+	}
+	if (event == LaserSharkUsbSession::HOTPLUG_REOPENED) {
+		// The device wasn't unplugged, so the steppers still have their settings.
+		return;
+	}
+
+	ub_mutex.lock();
+	invalidateSettings();
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	unsigned char res = endCommand("stop", ls_ub_twostep_stop(usb->getHandle(), TWOSTEP_STEPPER_BITFIELD_STEPPER_1 | TWOSTEP_STEPPER_BITFIELD_STEPPER_2));
+	for (int i = 0; i < TWOSTEP_STEPPER_COUNT && res == LS_UB_TWOSTEP_SUCCESS; i++) {
+		for (unsigned int j = 0; j < sizeof(restore_order)/sizeof(restore_order[0]) && res == LS_UB_TWOSTEP_SUCCESS; j++) {
+			if (configured[i].*restore_order[j] != -1) {
+				res = writeSetting(i, restore_order[j], configured[i].*restore_order[j]);
+			}
+		}
+	}
+	ub_mutex.unlock();
+
+	if (res != LS_UB_TWOSTEP_SUCCESS) {
+		std::cerr << "Error restoring TwoStep settings: " << (int)res << std::endl;
 	}
 }
 
 
-void TwoStep::shutdown()
+bool TwoStep::validStepper(int stepperNum)
 {
-    if (devh_ub)
-    {
-        libusb_close(devh_ub);
-		devh_ub = NULL;
-    }
+	return stepperNum >= 0 && stepperNum < TWOSTEP_STEPPER_COUNT;
+}
+
+
+void TwoStep::invalidateSettings()
+{
+	for (int i = 0; i < TWOSTEP_STEPPER_COUNT; i++) {
+		settings[i].enable = -1;
+		settings[i].dir = -1;
+		settings[i].delay = -1;
+		settings[i].current = -1;
+		settings[i].microsteps = -1;
+	}
+}
+
+
+/*
+	Sends a setting unless the shadow copy says the stepper already has it. Any bridge failure forgets every
+	setting, since the stepper may or may not have taken the write.
+*/
+unsigned char TwoStep::writeSetting(int stepperNum, int StepperSettings::*setting, int value)
+{
+	if (validStepper(stepperNum)) {
+		configured[stepperNum].*setting = value;
+	}
+	if (validStepper(stepperNum) && settings[stepperNum].*setting == value) {
+		return LS_UB_TWOSTEP_SUCCESS;
+	}
+
+	unsigned char res;
+	beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+	if (setting == &StepperSettings::enable) {
+		res = endCommand("set_enable", ls_ub_twostep_set_enable(usb->getHandle(), stepperNum, value));
+	} else if (setting == &StepperSettings::dir) {
+		res = endCommand("set_dir", ls_ub_twostep_set_dir(usb->getHandle(), stepperNum, value));
+	} else if (setting == &StepperSettings::delay) {
+		res = endCommand("set_100uS_delay", ls_ub_twostep_set_100uS_delay(usb->getHandle(), stepperNum, value));
+	} else if (setting == &StepperSettings::current) {
+		res = endCommand("set_current", ls_ub_twostep_set_current(usb->getHandle(), stepperNum, value));
+	} else {
+		res = endCommand("set_microsteps", ls_ub_twostep_set_microsteps(usb->getHandle(), stepperNum, value));
+	}
+
+	if (res != LS_UB_TWOSTEP_SUCCESS) {
+		invalidateSettings();
+	} else if (validStepper(stepperNum)) {
+		settings[stepperNum].*setting = value;
+	}
+	return res;
+}
+
+
+/*
+	Serves a setting from the shadow copy, only going over the bridge the first time after a connect or error.
+*/
+unsigned char TwoStep::readSetting(int stepperNum, int StepperSettings::*setting, int &value)
+{
+	if (validStepper(stepperNum) && settings[stepperNum].*setting != -1) {
+		value = settings[stepperNum].*setting;
+		return LS_UB_TWOSTEP_SUCCESS;
+	}
+
+	unsigned char res;
+	beginCommand(LaserSharkUsbSession::PRIORITY_STATUS);
+	if (setting == &StepperSettings::enable || setting == &StepperSettings::dir) {
+		bool tmp = false;
+		if (setting == &StepperSettings::enable) {
+			res = endCommand("get_enable", ls_ub_twostep_get_enable(usb->getHandle(), stepperNum, &tmp));
+		} else {
+			res = endCommand("get_dir", ls_ub_twostep_get_dir(usb->getHandle(), stepperNum, &tmp));
+		}
+		value = tmp;
+	} else if (setting == &StepperSettings::microsteps) {
+		unsigned char tmp = 0;
+		res = endCommand("get_microsteps", ls_ub_twostep_get_microsteps(usb->getHandle(), stepperNum, &tmp));
+		value = tmp;
+	} else {
+		unsigned short tmp = 0;
+		if (setting == &StepperSettings::delay) {
+			res = endCommand("get_100uS_delay", ls_ub_twostep_get_100uS_delay(usb->getHandle(), stepperNum, &tmp));
+		} else {
+			res = endCommand("get_current", ls_ub_twostep_get_current(usb->getHandle(), stepperNum, &tmp));
+		}
+		value = tmp;
+	}
+
+	if (res != LS_UB_TWOSTEP_SUCCESS) {
+		invalidateSettings();
+	} else if (validStepper(stepperNum)) {
+		settings[stepperNum].*setting = value;
+	}
+	return res;
+}
+
+
+/*
+	Runs a profiled move as one move of all the steps, changing the step delay at each segment boundary while the
+	stepper keeps moving. The bridge applies a new delay from the next step, so segments follow on without the
+	stepper stopping in between.
+
+	The host can't read how far the stepper has got, so it is worked out from when each delay change was sent.
+	A change lands somewhere between sending the command and its reply, and the position is tracked as a range
+	covering both. Speeding up waits until the stepper has surely passed the boundary, slowing down is sent early
+	enough to land before it could have, so the acceleration is never more than planned.
+*/
+void TwoStep::runProfile(int stepperNum, bool high, std::vector<TwoStepMotionSegment> segments, int current, int microsteps)
+{
+	unsigned char mask = stepperNum == TWOSTEP_STEPPER_1 ? TWOSTEP_STEPPER_BITFIELD_STEPPER_1 : TWOSTEP_STEPPER_BITFIELD_STEPPER_2;
+	std::string error;
+	Tracer::instance().setThreadName("TwoStep profile");
+
+	int total_steps = 0;
+	for (unsigned int i = 0; i < segments.size(); i++) {
+		total_steps += segments[i].steps;
+	}
+
+	try {
+		// Steps done by the time the last command returned, at most and at least.
+		double steps_lo = 0, steps_hi = 0;
+		std::chrono::steady_clock::time_point sent, replied;
+		std::chrono::microseconds round_trip(0);
+
+		ub_mutex.lock();
+		unsigned char res = writeSetting(stepperNum, &StepperSettings::microsteps, microsteps);
+		if (res == LS_UB_TWOSTEP_SUCCESS) {
+			res = writeSetting(stepperNum, &StepperSettings::current, current);
+		}
+		if (res == LS_UB_TWOSTEP_SUCCESS) {
+			res = writeSetting(stepperNum, &StepperSettings::dir, high);
+		}
+		if (res == LS_UB_TWOSTEP_SUCCESS) {
+			res = writeSetting(stepperNum, &StepperSettings::delay, segments[0].delay);
+		}
+		if (res == LS_UB_TWOSTEP_SUCCESS) {
+			beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+			res = endCommand("set_safe_steps", ls_ub_twostep_set_safe_steps(usb->getHandle(), stepperNum, total_steps));
+		}
+		if (res == LS_UB_TWOSTEP_SUCCESS) {
+			sent = std::chrono::steady_clock::now();
+			beginCommand(LaserSharkUsbSession::PRIORITY_COMMAND);
+			res = endCommand("start", ls_ub_twostep_start(usb->getHandle(), mask));
+			replied = std::chrono::steady_clock::now();
+		}
+		ub_mutex.unlock();
+		handleBadResponse(res);
+		round_trip = std::chrono::duration_cast<std::chrono::microseconds>(replied - sent);
+		steps_hi = round_trip.count()/(100.0*segments[0].delay);
+
+		int boundary = 0;
+		for (unsigned int i = 0; i + 1 < segments.size() && !profile_cancel; i++) {
+			int delay = segments[i].delay;
+			int next_delay = segments[i + 1].delay;
+			boundary += segments[i].steps;
+
+			// Speeding up waits for the least the stepper could have done, slowing down goes by the most it could
+			// have done and allows for the command taking as long to land as the last one did.
+			std::chrono::steady_clock::time_point send_at;
+			if (next_delay < delay) {
+				send_at = replied + std::chrono::microseconds((long long)((boundary - steps_lo)*100.0*delay));
+			} else {
+				send_at = replied + std::chrono::microseconds((long long)((boundary - steps_hi)*100.0*delay)) -
+					std::max(round_trip, std::chrono::microseconds(1000LL*TWOSTEP_PROFILE_SWITCH_LEAD_MS));
+			}
+
+			std::unique_lock<std::mutex> lock(profile_mutex);
+			while (!profile_cancel) {
+				if (profile_cv.wait_until(lock, send_at) == std::cv_status::timeout) {
+					break;
+				}
+			}
+			lock.unlock();
+
+			ub_mutex.lock();
+			if (profile_cancel) {
+				ub_mutex.unlock();
+				break;
+			}
+			std::chrono::steady_clock::time_point last_replied = replied;
+			sent = std::chrono::steady_clock::now();
+			res = writeSetting(stepperNum, &StepperSettings::delay, next_delay);
+			replied = std::chrono::steady_clock::now();
+			ub_mutex.unlock();
+			handleBadResponse(res);
+
+			// The change landed somewhere between sent and replied, the steps done by replied are least if it landed
+			// at whichever end leaves the slower delay in effect for longer.
+			double before_sent = std::chrono::duration<double, std::micro>(sent - last_replied).count()/(100.0*delay);
+			double window = std::chrono::duration<double, std::micro>(replied - sent).count();
+			double at_old = window/(100.0*delay), at_new = window/(100.0*next_delay);
+			steps_lo += before_sent + std::min(at_old, at_new);
+			steps_hi += before_sent + std::max(at_old, at_new);
+			round_trip = std::chrono::duration_cast<std::chrono::microseconds>(replied - sent);
+		}
+
+		if (!profile_cancel) {
+			std::chrono::steady_clock::time_point poll_from = replied +
+				std::chrono::microseconds((long long)((total_steps - steps_hi)*100.0*segments.back().delay)) -
+				std::chrono::milliseconds(TWOSTEP_PROFILE_POLL_LEAD_MS);
+			std::unique_lock<std::mutex> lock(profile_mutex);
+			while (!profile_cancel) {
+				if (profile_cv.wait_until(lock, poll_from) == std::cv_status::timeout) {
+					break;
+				}
+			}
+			lock.unlock();
+		}
+
+		while (!profile_cancel && getIsMoving(stepperNum)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(TWOSTEP_PROFILE_POLL_INTERVAL_MS));
+		}
+	} catch (std::runtime_error e) {
+		error = e.what();
+	}
+
+	profile_mutex.lock();
+	profile_error_message = error;
+	profile_running = false;
+	profile_cv.notify_all();
+	profile_mutex.unlock();
+}
+
+
+void TwoStep::cancelProfile(int stepperMask)
+{
+	profile_mutex.lock();
+	if (profile_running && (profile_stepper_mask & stepperMask)) {
+		profile_cancel = true;
+		profile_cv.notify_all();
+	}
+	profile_mutex.unlock();
+}
+
+
+void TwoStep::cleanupProfileThread()
+{
+	profile_mutex.lock();
+	if (profile_running) {
+		profile_cancel = true;
+		profile_cv.notify_all();
+	}
+	std::thread *thread = profile_thread;
+	profile_thread = NULL;
+	profile_mutex.unlock();
+
+	if (thread) {
+		thread->join();
+		delete thread;
+	}
+}
+
+
+/*
+	Waits for a profiled move on a stepper in stepperMask to finish. Returns false if deadline passed first and
+	throws if the move failed.
+*/
+bool TwoStep::waitForProfile(int stepperMask, std::chrono::steady_clock::time_point deadline) throw (std::runtime_error)
+{
+	std::unique_lock<std::mutex> lock(profile_mutex);
+	if (!(profile_stepper_mask & stepperMask)) {
+		return true;
+	}
+
+	while (profile_running) {
+		if (profile_cv.wait_until(lock, deadline) == std::cv_status::timeout && profile_running) {
+			return false;
+		}
+	}
+
+	if (!profile_error_message.empty()) {
+		std::string error = profile_error_message;
+		profile_error_message.clear();
+		throw std::runtime_error(error);
+	}
+
+	return true;
 }
 
 
@@ -384,6 +861,59 @@ void TwoStep::stopAndDisable()
 }
 
 
+/*
+	Takes the bus lock for a single bridge exchange, endCommand must follow it.
+*/
+void TwoStep::beginCommand(LaserSharkUsbSession::Priority priority)
+{
+	usb->lock(priority);
+	command_start = std::chrono::steady_clock::now();
+}
+
+
+/*
+	Releases the bus lock and records how long the exchange took and whether it failed, then passes res through.
+	The exchange is traced with res as its value.
+*/
+unsigned char TwoStep::endCommand(const char *command, unsigned char res)
+{
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	// command_start belongs to whoever holds the bus next once it is released.
+	std::chrono::steady_clock::time_point start = command_start;
+	const CommandMetrics &metrics = commandMetrics(command);
+	usb->unlock();
+	Tracer::instance().complete(command, "twostep", Tracer::timestamp(start), Tracer::timestamp(end), res);
+
+	metrics.seconds->observe(std::chrono::duration<double>(end - start).count());
+	if (res != LS_UB_TWOSTEP_SUCCESS) {
+		metrics.failures->inc();
+	}
+
+	return res;
+}
+
+
+/*
+	Looks the metrics for a command up in the registry the first time it is run and keeps them after that.
+*/
+const TwoStep::CommandMetrics &TwoStep::commandMetrics(const char *command)
+{
+	std::map<const char*, CommandMetrics>::iterator it = command_metrics.find(command);
+	if (it != command_metrics.end()) {
+		return it->second;
+	}
+
+	MetricsRegistry &registry = MetricsRegistry::instance();
+	std::string labels = MetricsRegistry::label("command", command);
+	CommandMetrics &metrics = command_metrics[command];
+	metrics.seconds = registry.histogram("twostep_command_seconds",
+		"Time taken by each TwoStep command over the uart bridge.", MetricsRegistry::exponentialBuckets(0.0005, 2, 12),
+		labels);
+	metrics.failures = registry.counter("twostep_command_failures_total", "TwoStep commands that failed.", labels);
+	return metrics;
+}
+
+
 void TwoStep::handleBadResponse(unsigned char res) throw (std::runtime_error)
 {
 	std::ostringstream oss;
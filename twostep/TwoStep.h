@@ -21,11 +21,24 @@ along with this program. If not, see <http://www.gnu.org/licenses/>.
 #define _TWOSTEP_H_
 #include <stdexcept>
 #include <mutex>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <map>
+#include <chrono>
+
+#include "TwoStepMotionPlanner.h"
+#include "lasershark/LaserSharkUsbSession.h"
+#include "metrics/Metrics.h"
+
+#define TWOSTEP_STEPPER_COUNT 2
 
 class TwoStep
 {
 	public:
-		TwoStep();
+		TwoStep(LaserSharkUsbSession *usb);
 		~TwoStep();
 
 		bool connect() throw (std::runtime_error);
@@ -41,6 +54,7 @@ class TwoStep
         void stop(bool stepperOne, bool stepperTwo) throw (std::runtime_error);
 
         bool getIsMoving(int stepperNum) throw (std::runtime_error);
+        bool waitForMotionComplete(int stepperMask, unsigned int timeoutMs) throw (std::runtime_error);
 
         void setEnable(int stepperNum, bool enable) throw (std::runtime_error);
         bool getEnable(const int stepperNum) throw (std::runtime_error);
@@ -57,22 +71,71 @@ class TwoStep
         unsigned int get100uSDelay(int stepperNum) throw (std::runtime_error);
         void set100uSDelay(int stepperNum, int value) throw (std::runtime_error);
 
+        void move(int stepperNum, bool high, int steps, int delay, int current, int microsteps) throw (std::runtime_error);
+        void setMotionProfile(int stepperNum, int startDelay, int cruiseDelay, double acceleration) throw (std::runtime_error);
+        void moveProfiled(int stepperNum, bool high, int steps, int current, int microsteps) throw (std::runtime_error);
+
 		void getSwitchStatus(bool& r1_a, bool &r1_b, bool &r2_a, bool &r2_b) throw (std::runtime_error);
 
         int getVersion() throw (std::runtime_error);
 
 
 	private:
-		void release();
-		void shutdown();
+		// Shadow copy of each stepper's settings, -1 if unknown.
+		struct StepperSettings
+		{
+			int enable;
+			int dir;
+			int delay;
+			int current;
+			int microsteps;
+		};
+
+		struct CommandMetrics
+		{
+			MetricsHistogram *seconds;
+			MetricsCounter *failures;
+		};
+
+		void usbHotplug(LaserSharkUsbSession::HotplugEvent event);
+
+		static bool validStepper(int stepperNum);
+		void invalidateSettings();
+
+		// ub_mutex must be held when calling these.
+		unsigned char writeSetting(int stepperNum, int StepperSettings::*setting, int value);
+		unsigned char readSetting(int stepperNum, int StepperSettings::*setting, int &value);
+		void beginCommand(LaserSharkUsbSession::Priority priority);
+		unsigned char endCommand(const char *command, unsigned char res);
+		const CommandMetrics &commandMetrics(const char *command);
 
 		void stopAndDisable();
 
+		void runProfile(int stepperNum, bool high, std::vector<TwoStepMotionSegment> segments, int current, int microsteps);
+		void cancelProfile(int stepperMask);
+		void cleanupProfileThread();
+		bool waitForProfile(int stepperMask, std::chrono::steady_clock::time_point deadline) throw (std::runtime_error);
+
 		void handleBadResponse(unsigned char res) throw (std::runtime_error);
 
 		std::mutex ub_mutex;
-		bool devh_ub_claimed;
-		struct libusb_device_handle *devh_ub;
+		LaserSharkUsbSession *usb;
+		bool usb_open;
+		int hotplug_listener_id;
+		StepperSettings settings[TWOSTEP_STEPPER_COUNT];
+		// Last settings asked for, these are restored if the device is reattached.
+		StepperSettings configured[TWOSTEP_STEPPER_COUNT];
+		std::chrono::steady_clock::time_point command_start; // Only touched with the bus lock held.
+		std::map<const char*, CommandMetrics> command_metrics; // Keyed by the name literal's address, bus lock held.
+
+		std::mutex profile_mutex;
+		std::condition_variable profile_cv;
+		TwoStepMotionPlanner planners[TWOSTEP_STEPPER_COUNT];
+		std::thread *profile_thread;
+		bool profile_running;
+		int profile_stepper_mask;
+		std::atomic<bool> profile_cancel;
+		std::string profile_error_message;
 };
 
 #endif //_TWOSTEP_H_
@@ -0,0 +1,135 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "TwoStepMotionPlanner.h"
+#include <cmath>
+
+#define TWOSTEP_DELAY_UNITS_PER_SECOND 10000.0
+
+#define TWOSTEP_DEFAULT_DELAY 50 // 5ms
+// Every segment boundary costs a uart bridge round trip sent while the stepper moves, so ramps are limited to
+// a few segments of a reasonable length.
+#define TWOSTEP_MAX_RAMP_SEGMENTS 8
+#define TWOSTEP_MIN_SEGMENT_STEPS 16
+
+
+TwoStepMotionPlanner::TwoStepMotionPlanner()
+{
+	start_delay = TWOSTEP_DEFAULT_DELAY;
+	cruise_delay = TWOSTEP_DEFAULT_DELAY;
+	acceleration = 0;
+}
+
+
+/*
+	Moves start and end at start_delay and speed up to cruise_delay at acceleration steps/s^2. An acceleration
+	of 0, or a cruise_delay that isn't shorter than start_delay, runs whole moves at cruise_delay.
+*/
+void TwoStepMotionPlanner::setProfile(int start_delay, int cruise_delay, double acceleration)
+{
+	this->start_delay = start_delay > 0 ? start_delay : 1;
+	this->cruise_delay = cruise_delay > 0 ? cruise_delay : 1;
+	this->acceleration = acceleration > 0 ? acceleration : 0;
+}
+
+
+std::vector<TwoStepMotionSegment> TwoStepMotionPlanner::plan(int steps) const
+{
+	std::vector<TwoStepMotionSegment> segments;
+	if (steps <= 0) {
+		return segments;
+	}
+
+	TwoStepMotionSegment segment;
+	if (acceleration <= 0 || cruise_delay >= start_delay) {
+		segment.steps = steps;
+		segment.delay = cruise_delay;
+		segments.push_back(segment);
+		return segments;
+	}
+
+	double start_speed = TWOSTEP_DELAY_UNITS_PER_SECOND/start_delay;
+	double cruise_speed = TWOSTEP_DELAY_UNITS_PER_SECOND/cruise_delay;
+
+	// Ramp all the way to cruise speed, or only half way into the move if it is too short for that.
+	int ramp_steps = (int)std::ceil((cruise_speed*cruise_speed - start_speed*start_speed)/(2*acceleration));
+	if (ramp_steps > steps/2) {
+		ramp_steps = steps/2;
+	}
+
+	unsigned int ramp_segments = ramp_steps/TWOSTEP_MIN_SEGMENT_STEPS;
+	if (ramp_segments > TWOSTEP_MAX_RAMP_SEGMENTS) {
+		ramp_segments = TWOSTEP_MAX_RAMP_SEGMENTS;
+	}
+
+	if (ramp_segments == 0) {
+		// Too short to ramp, run it at the start speed.
+		segment.steps = steps;
+		segment.delay = start_delay;
+		segments.push_back(segment);
+		return segments;
+	}
+
+	std::vector<TwoStepMotionSegment> ramp;
+	int ramp_done = 0;
+	for (unsigned int i = 0; i < ramp_segments; i++) {
+		int end = (int)((long long)ramp_steps*(i + 1)/ramp_segments);
+		segment.steps = end - ramp_done;
+		segment.delay = delayForSpeed(std::sqrt(start_speed*start_speed + 2*acceleration*ramp_done));
+		ramp_done = end;
+		ramp.push_back(segment);
+	}
+
+	segments = ramp;
+	int cruise_steps = steps - 2*ramp_steps;
+	if (cruise_steps > 0) {
+		segment.steps = cruise_steps;
+		segment.delay = delayForSpeed(std::sqrt(start_speed*start_speed + 2*acceleration*ramp_steps));
+		segments.push_back(segment);
+	}
+	segments.insert(segments.end(), ramp.rbegin(), ramp.rend());
+
+	// Neighbouring segments that ended up at the same delay are merged.
+	std::vector<TwoStepMotionSegment> merged;
+	for (unsigned int i = 0; i < segments.size(); i++) {
+		if (!merged.empty() && merged.back().delay == segments[i].delay) {
+			merged.back().steps += segments[i].steps;
+		} else {
+			merged.push_back(segments[i]);
+		}
+	}
+
+	return merged;
+}
+
+
+/*
+	Rounds up, so a segment never runs faster than the requested speed or cruise_delay.
+*/
+int TwoStepMotionPlanner::delayForSpeed(double steps_per_second) const
+{
+	int delay = (int)std::ceil(TWOSTEP_DELAY_UNITS_PER_SECOND/steps_per_second - 1e-9);
+	if (delay < cruise_delay) {
+		delay = cruise_delay;
+	}
+	if (delay > start_delay) {
+		delay = start_delay;
+	}
+	return delay;
+}
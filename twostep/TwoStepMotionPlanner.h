@@ -0,0 +1,57 @@
+/*
+This file is part of the LaserShark 3d Printer host application.
+
+Copyright (C) 2014 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _TWOSTEPMOTIONPLANNER_H_
+#define _TWOSTEPMOTIONPLANNER_H_
+
+#include <vector>
+
+
+// A run of steps at a fixed step delay, in 100uS units like TwoStep::set100uSDelay.
+struct TwoStepMotionSegment
+{
+	int steps;
+	int delay;
+};
+
+
+/*
+	Splits a move into accelerate, cruise and decelerate segments. TwoStep steps at one delay at a time, so the
+	ramps are approximated by a few constant speed segments, each no faster than the acceleration allows at
+	its start. TwoStep::moveProfiled changes the delay between them without stopping.
+	Not intended to be thread safe.
+*/
+class TwoStepMotionPlanner
+{
+	public:
+		TwoStepMotionPlanner();
+
+		void setProfile(int start_delay, int cruise_delay, double acceleration);
+
+		std::vector<TwoStepMotionSegment> plan(int steps) const;
+
+	private:
+		int delayForSpeed(double steps_per_second) const;
+
+		int start_delay;
+		int cruise_delay;
+		double acceleration; // steps/s^2
+};
+
+#endif //_TWOSTEPMOTIONPLANNER_H_
@@ -0,0 +1,213 @@
+/**
+ * THIS FILE IS GENERATED BY binrpcstub FROM twostep_spec.json, DO NOT CHANGE IT!!!!!
+ */
+
+#ifndef _TWOSTEPBINRPCCLIENT_H_
+#define _TWOSTEPBINRPCCLIENT_H_
+
+#include "BinRpcClient.h"
+#include "twostepbinrpcmethods.h"
+
+class TwoStepBinRpcClient : public BinRpcClient
+{
+    public:
+        TwoStepBinRpcClient(const std::string &address) :
+            BinRpcClient(address, TWOSTEPBINRPC_SPEC_HASH)
+        {
+        }
+
+        std::string getTwoStepJSONVersion() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(0, p).getString();
+        }
+
+        void setSteps(const int& stepperNum, const int& steps) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            p.putInt(steps);
+            this->call(1, p);
+        }
+
+        void setSafeSteps(const int& stepperNum, const int& steps) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            p.putInt(steps);
+            this->call(2, p);
+        }
+
+        void setStepUntilSwitch(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            this->call(3, p);
+        }
+
+        void start(const bool& stepperOne, const bool& stepperTwo) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putBool(stepperOne);
+            p.putBool(stepperTwo);
+            this->call(4, p);
+        }
+
+        void stop(const bool& stepperOne, const bool& stepperTwo) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putBool(stepperOne);
+            p.putBool(stepperTwo);
+            this->call(5, p);
+        }
+
+        bool getIsMoving(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            return this->call(6, p).getBool();
+        }
+
+        void setEnable(const bool& enable, const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putBool(enable);
+            p.putInt(stepperNum);
+            this->call(7, p);
+        }
+
+        bool getEnable(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            return this->call(8, p).getBool();
+        }
+
+        void setMicrosteps(const int& stepperNum, const int& value) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            p.putInt(value);
+            this->call(9, p);
+        }
+
+        int getMicrosteps(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            return this->call(10, p).getInt();
+        }
+
+        void setDir(const bool& high, const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putBool(high);
+            p.putInt(stepperNum);
+            this->call(11, p);
+        }
+
+        bool getDir(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            return this->call(12, p).getBool();
+        }
+
+        void setCurrent(const int& stepperNum, const int& value) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            p.putInt(value);
+            this->call(13, p);
+        }
+
+        int getCurrent(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            return this->call(14, p).getInt();
+        }
+
+        void set100uSDelay(const int& stepperNum, const int& value) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            p.putInt(value);
+            this->call(15, p);
+        }
+
+        int get100uSDelay(const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperNum);
+            return this->call(16, p).getInt();
+        }
+
+        Json::Value getSwitchStatus() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            BinRpcReader r = this->call(17, p);
+            Json::Value result;
+            result["R1_A"] = r.getBool();
+            result["R1_B"] = r.getBool();
+            result["R2_A"] = r.getBool();
+            result["R2_B"] = r.getBool();
+            return result;
+        }
+
+        int getVersion() throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            return this->call(18, p).getInt();
+        }
+
+        bool waitForMotionComplete(const int& stepperMask, const int& timeoutMs) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(stepperMask);
+            p.putInt(timeoutMs);
+            return this->call(19, p).getBool();
+        }
+
+        void move(const int& current, const int& delay, const bool& high, const int& microsteps, const int& stepperNum, const int& steps) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(current);
+            p.putInt(delay);
+            p.putBool(high);
+            p.putInt(microsteps);
+            p.putInt(stepperNum);
+            p.putInt(steps);
+            this->call(20, p);
+        }
+
+        void setMotionProfile(const int& acceleration, const int& cruiseDelay, const int& startDelay, const int& stepperNum) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(acceleration);
+            p.putInt(cruiseDelay);
+            p.putInt(startDelay);
+            p.putInt(stepperNum);
+            this->call(21, p);
+        }
+
+        void moveProfiled(const int& current, const bool& high, const int& microsteps, const int& stepperNum, const int& steps) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putInt(current);
+            p.putBool(high);
+            p.putInt(microsteps);
+            p.putInt(stepperNum);
+            p.putInt(steps);
+            this->call(22, p);
+        }
+
+        Json::Value executeBatch(const Json::Value& calls) throw (std::runtime_error)
+        {
+            BinRpcWriter p;
+            p.putJson(calls);
+            return this->call(23, p).getJson();
+        }
+};
+
+#endif //_TWOSTEPBINRPCCLIENT_H_
@@ -0,0 +1,75 @@
+/**
+ * THIS FILE IS GENERATED BY binrpcstub FROM twostep_spec.json, DO NOT CHANGE IT!!!!!
+ */
+
+#ifndef _TWOSTEPBINRPCMETHODS_H_
+#define _TWOSTEPBINRPCMETHODS_H_
+
+#include "BinRpc.h"
+
+#define TWOSTEPBINRPC_SPEC_HASH 0xfcf691fbu
+
+static const BinRpcField TwoStepBinRpc_getTwoStepJSONVersion_returns[] = {{"value", BINRPC_STRING}};
+static const BinRpcField TwoStepBinRpc_setSteps_params[] = {{"stepperNum", BINRPC_INT}, {"steps", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_setSafeSteps_params[] = {{"stepperNum", BINRPC_INT}, {"steps", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_setStepUntilSwitch_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_start_params[] = {{"stepperOne", BINRPC_BOOL}, {"stepperTwo", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_stop_params[] = {{"stepperOne", BINRPC_BOOL}, {"stepperTwo", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_getIsMoving_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getIsMoving_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_setEnable_params[] = {{"enable", BINRPC_BOOL}, {"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getEnable_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getEnable_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_setMicrosteps_params[] = {{"stepperNum", BINRPC_INT}, {"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getMicrosteps_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getMicrosteps_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_setDir_params[] = {{"high", BINRPC_BOOL}, {"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getDir_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getDir_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_setCurrent_params[] = {{"stepperNum", BINRPC_INT}, {"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getCurrent_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getCurrent_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_set100uSDelay_params[] = {{"stepperNum", BINRPC_INT}, {"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_get100uSDelay_params[] = {{"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_get100uSDelay_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_getSwitchStatus_returns[] = {{"R1_A", BINRPC_BOOL}, {"R1_B", BINRPC_BOOL}, {"R2_A", BINRPC_BOOL}, {"R2_B", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_getVersion_returns[] = {{"value", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_waitForMotionComplete_params[] = {{"stepperMask", BINRPC_INT}, {"timeoutMs", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_waitForMotionComplete_returns[] = {{"value", BINRPC_BOOL}};
+static const BinRpcField TwoStepBinRpc_move_params[] = {{"current", BINRPC_INT}, {"delay", BINRPC_INT}, {"high", BINRPC_BOOL}, {"microsteps", BINRPC_INT}, {"stepperNum", BINRPC_INT}, {"steps", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_setMotionProfile_params[] = {{"acceleration", BINRPC_INT}, {"cruiseDelay", BINRPC_INT}, {"startDelay", BINRPC_INT}, {"stepperNum", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_moveProfiled_params[] = {{"current", BINRPC_INT}, {"high", BINRPC_BOOL}, {"microsteps", BINRPC_INT}, {"stepperNum", BINRPC_INT}, {"steps", BINRPC_INT}};
+static const BinRpcField TwoStepBinRpc_executeBatch_params[] = {{"calls", BINRPC_ARRAY}};
+static const BinRpcField TwoStepBinRpc_executeBatch_returns[] = {{"value", BINRPC_ARRAY}};
+
+// Indexed by method id.
+static const BinRpcMethod TwoStepBinRpcMethods[] = {
+    {"getTwoStepJSONVersion", NULL, 0, TwoStepBinRpc_getTwoStepJSONVersion_returns, 1, true},
+    {"setSteps", TwoStepBinRpc_setSteps_params, 2, NULL, 0, false},
+    {"setSafeSteps", TwoStepBinRpc_setSafeSteps_params, 2, NULL, 0, false},
+    {"setStepUntilSwitch", TwoStepBinRpc_setStepUntilSwitch_params, 1, NULL, 0, false},
+    {"start", TwoStepBinRpc_start_params, 2, NULL, 0, false},
+    {"stop", TwoStepBinRpc_stop_params, 2, NULL, 0, false},
+    {"getIsMoving", TwoStepBinRpc_getIsMoving_params, 1, TwoStepBinRpc_getIsMoving_returns, 1, false},
+    {"setEnable", TwoStepBinRpc_setEnable_params, 2, NULL, 0, false},
+    {"getEnable", TwoStepBinRpc_getEnable_params, 1, TwoStepBinRpc_getEnable_returns, 1, false},
+    {"setMicrosteps", TwoStepBinRpc_setMicrosteps_params, 2, NULL, 0, false},
+    {"getMicrosteps", TwoStepBinRpc_getMicrosteps_params, 1, TwoStepBinRpc_getMicrosteps_returns, 1, false},
+    {"setDir", TwoStepBinRpc_setDir_params, 2, NULL, 0, false},
+    {"getDir", TwoStepBinRpc_getDir_params, 1, TwoStepBinRpc_getDir_returns, 1, false},
+    {"setCurrent", TwoStepBinRpc_setCurrent_params, 2, NULL, 0, false},
+    {"getCurrent", TwoStepBinRpc_getCurrent_params, 1, TwoStepBinRpc_getCurrent_returns, 1, false},
+    {"set100uSDelay", TwoStepBinRpc_set100uSDelay_params, 2, NULL, 0, false},
+    {"get100uSDelay", TwoStepBinRpc_get100uSDelay_params, 1, TwoStepBinRpc_get100uSDelay_returns, 1, false},
+    {"getSwitchStatus", NULL, 0, TwoStepBinRpc_getSwitchStatus_returns, 4, false},
+    {"getVersion", NULL, 0, TwoStepBinRpc_getVersion_returns, 1, false},
+    {"waitForMotionComplete", TwoStepBinRpc_waitForMotionComplete_params, 2, TwoStepBinRpc_waitForMotionComplete_returns, 1, false},
+    {"move", TwoStepBinRpc_move_params, 6, NULL, 0, false},
+    {"setMotionProfile", TwoStepBinRpc_setMotionProfile_params, 4, NULL, 0, false},
+    {"moveProfiled", TwoStepBinRpc_moveProfiled_params, 5, NULL, 0, false},
+    {"executeBatch", TwoStepBinRpc_executeBatch_params, 1, TwoStepBinRpc_executeBatch_returns, 1, false}
+};
+
+#define TWOSTEPBINRPC_METHOD_COUNT 24
+
+#endif //_TWOSTEPBINRPCMETHODS_H_
@@ -0,0 +1,221 @@
+/**
+ * THIS FILE IS GENERATED BY binrpcstub FROM twostep_spec.json, DO NOT CHANGE IT!!!!!
+ */
+
+#ifndef _TWOSTEPJSONBATCH_H_
+#define _TWOSTEPJSONBATCH_H_
+
+#include <jsonrpc/rpc.h>
+
+class TwoStepJSONBatch
+{
+    public:
+        TwoStepJSONBatch() :
+            list(Json::arrayValue)
+        {
+        }
+
+        // What to pass to executeBatch.
+        const Json::Value& calls() const
+        {
+            return this->list;
+        }
+
+        void clear()
+        {
+            this->list = Json::Value(Json::arrayValue);
+        }
+
+        void getTwoStepJSONVersion()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getTwoStepJSONVersion", p);
+        }
+
+        void setSteps(const int& stepperNum, const int& steps)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            p["steps"] = steps;
+            this->add("setSteps", p);
+        }
+
+        void setSafeSteps(const int& stepperNum, const int& steps)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            p["steps"] = steps;
+            this->add("setSafeSteps", p);
+        }
+
+        void setStepUntilSwitch(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("setStepUntilSwitch", p);
+        }
+
+        void start(const bool& stepperOne, const bool& stepperTwo)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperOne"] = stepperOne;
+            p["stepperTwo"] = stepperTwo;
+            this->add("start", p);
+        }
+
+        void stop(const bool& stepperOne, const bool& stepperTwo)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperOne"] = stepperOne;
+            p["stepperTwo"] = stepperTwo;
+            this->add("stop", p);
+        }
+
+        void getIsMoving(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("getIsMoving", p);
+        }
+
+        void setEnable(const int& stepperNum, const bool& enable)
+        {
+            Json::Value p(Json::objectValue);
+            p["enable"] = enable;
+            p["stepperNum"] = stepperNum;
+            this->add("setEnable", p);
+        }
+
+        void getEnable(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("getEnable", p);
+        }
+
+        void setMicrosteps(const int& stepperNum, const int& value)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            p["value"] = value;
+            this->add("setMicrosteps", p);
+        }
+
+        void getMicrosteps(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("getMicrosteps", p);
+        }
+
+        void setDir(const int& stepperNum, const bool& high)
+        {
+            Json::Value p(Json::objectValue);
+            p["high"] = high;
+            p["stepperNum"] = stepperNum;
+            this->add("setDir", p);
+        }
+
+        void getDir(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("getDir", p);
+        }
+
+        void setCurrent(const int& stepperNum, const int& value)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            p["value"] = value;
+            this->add("setCurrent", p);
+        }
+
+        void getCurrent(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("getCurrent", p);
+        }
+
+        void set100uSDelay(const int& stepperNum, const int& value)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            p["value"] = value;
+            this->add("set100uSDelay", p);
+        }
+
+        void get100uSDelay(const int& stepperNum)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperNum"] = stepperNum;
+            this->add("get100uSDelay", p);
+        }
+
+        void getSwitchStatus()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getSwitchStatus", p);
+        }
+
+        void getVersion()
+        {
+            Json::Value p(Json::objectValue);
+            this->add("getVersion", p);
+        }
+
+        void waitForMotionComplete(const int& stepperMask, const int& timeoutMs)
+        {
+            Json::Value p(Json::objectValue);
+            p["stepperMask"] = stepperMask;
+            p["timeoutMs"] = timeoutMs;
+            this->add("waitForMotionComplete", p);
+        }
+
+        void move(const int& stepperNum, const bool& high, const int& steps, const int& delay, const int& current, const int& microsteps)
+        {
+            Json::Value p(Json::objectValue);
+            p["current"] = current;
+            p["delay"] = delay;
+            p["high"] = high;
+            p["microsteps"] = microsteps;
+            p["stepperNum"] = stepperNum;
+            p["steps"] = steps;
+            this->add("move", p);
+        }
+
+        void setMotionProfile(const int& stepperNum, const int& startDelay, const int& cruiseDelay, const int& acceleration)
+        {
+            Json::Value p(Json::objectValue);
+            p["acceleration"] = acceleration;
+            p["cruiseDelay"] = cruiseDelay;
+            p["startDelay"] = startDelay;
+            p["stepperNum"] = stepperNum;
+            this->add("setMotionProfile", p);
+        }
+
+        void moveProfiled(const int& stepperNum, const bool& high, const int& steps, const int& current, const int& microsteps)
+        {
+            Json::Value p(Json::objectValue);
+            p["current"] = current;
+            p["high"] = high;
+            p["microsteps"] = microsteps;
+            p["stepperNum"] = stepperNum;
+            p["steps"] = steps;
+            this->add("moveProfiled", p);
+        }
+
+    private:
+        Json::Value list;
+
+        void add(const char *method, const Json::Value& params)
+        {
+            Json::Value call;
+            call["method"] = method;
+            call["params"] = params;
+            this->list.append(call);
+        }
+};
+
+#endif //_TWOSTEPJSONBATCH_H_
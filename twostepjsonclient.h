@@ -19,6 +19,19 @@ class TwoStepJSONClient
             delete this->client;
         }
 
+        Json::Value executeBatch(const Json::Value& calls) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["calls"] = calls; 
+
+            Json::Value result = this->client->CallMethod("executeBatch",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value get100uSDelay(const int& stepperNum) throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -133,6 +146,41 @@ class TwoStepJSONClient
 
         }
 
+        Json::Value move(const int& stepperNum, const bool& high, const int& steps, const int& delay, const int& current, const int& microsteps) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["current"] = current; 
+p["delay"] = delay; 
+p["high"] = high; 
+p["microsteps"] = microsteps; 
+p["stepperNum"] = stepperNum; 
+p["steps"] = steps; 
+
+            Json::Value result = this->client->CallMethod("move",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
+        Json::Value moveProfiled(const int& stepperNum, const bool& high, const int& steps, const int& current, const int& microsteps) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["current"] = current; 
+p["high"] = high; 
+p["microsteps"] = microsteps; 
+p["stepperNum"] = stepperNum; 
+p["steps"] = steps; 
+
+            Json::Value result = this->client->CallMethod("moveProfiled",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         void printText(const std::string& text) throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -211,6 +259,22 @@ p["value"] = value;
 
         }
 
+        Json::Value setMotionProfile(const int& stepperNum, const int& startDelay, const int& cruiseDelay, const int& acceleration) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["acceleration"] = acceleration; 
+p["cruiseDelay"] = cruiseDelay; 
+p["startDelay"] = startDelay; 
+p["stepperNum"] = stepperNum; 
+
+            Json::Value result = this->client->CallMethod("setMotionProfile",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
         Json::Value setSafeSteps(const int& stepperNum, const int& steps) throw (jsonrpc::JsonRpcException)
         {
             Json::Value p;
@@ -280,6 +344,20 @@ p["stepperTwo"] = stepperTwo;
 
         }
 
+        Json::Value waitForMotionComplete(const int& stepperMask, const int& timeoutMs) throw (jsonrpc::JsonRpcException)
+        {
+            Json::Value p;
+            p["stepperMask"] = stepperMask; 
+p["timeoutMs"] = timeoutMs; 
+
+            Json::Value result = this->client->CallMethod("waitForMotionComplete",p);
+    if (result.isObject())
+        return result;
+     else 
+         throw jsonrpc::JsonRpcException(jsonrpc::Errors::ERROR_CLIENT_INVALID_RESPONSE, result.toStyledString());
+
+        }
+
     private:
         jsonrpc::Client* client;
 };